@@ -0,0 +1,39 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include <string>
+#include <cstdlib>
+#include <iostream>
+
+#include "DetectorAccuracyCheck.h"
+#include "DetectorConsistencyCheck.h"
+
+using namespace TUMAugmentedRealityExercise;
+
+// markertracking_check [frames=300] [seed=1], the same as the --accuracy-check mode of the app
+// markertracking_check --consistency [images=1000] [seed=1], the same as the --consistency-check mode
+int main(int argc, char* argv[])
+{
+	if(argc > 1 && std::string(argv[1]) == "--consistency")
+	{
+		DetectorConsistencyCheck consistency(argc > 3 ? strtoull(argv[3], NULL, 10) : 1);
+		ConsistencyReport consistent = consistency.Run(argc > 2 ? atoi(argv[2]) : 1000);
+
+		consistent.Print(std::cout);
+
+		return consistent.Passed ? 0 : 1;
+	}
+
+	DetectorAccuracyCheck check;
+	AccuracyReport report = check.Run(argc > 1 ? atoi(argv[1]) : 300, argc > 2 ? strtoull(argv[2], NULL, 10) : 1);
+
+	report.Print(std::cout);
+
+	return report.Passed ? 0 : 1;
+}
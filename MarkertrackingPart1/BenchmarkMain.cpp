@@ -0,0 +1,24 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include <string>
+#include <iostream>
+
+#include "KernelBenchmark.h"
+
+using namespace TUMAugmentedRealityExercise;
+
+// markertracking_bench [filter|-] [baseline.csv], the same as the --benchmark mode of the app
+int main(int argc, char* argv[])
+{
+	KernelBenchmark benchmark;
+	benchmark.AddDetectorKernels();
+
+	return benchmark.RunAgainstBaseline(argc > 1 && std::string(argv[1]) != "-" ? argv[1] : "", argc > 2 ? argv[2] : "", std::cout);
+}
@@ -8,22 +8,29 @@
  */
 
 #include "CameraCalibrationApp.h"
+#include "TraceRecorder.h"
 
 namespace TUMAugmentedRealityExercise
 {
-	CameraCalibrationApp::CameraCalibrationApp(void) : 
+	CameraCalibrationApp::CameraCalibrationApp(const std::string& outputFolder, const cv::Size& patternSize, float squareSize) : 
 		running(true), 
 		sampleChessboardImage(false), 
 		sampleChessboardImageFolder(false), 
 		calculateCalibration(false), 
 
+		outputFolder(outputFolder),
 		processor(), 
 		window("CameraCalibrationApp", &processor),
-		calibrator("./media")
+		calibrator(outputFolder, patternSize, squareSize),
+		sampler(calibrator),
+		cornersFound(false)
 	{
 		this->video = new CameraVideoSource();
 
 		this->fps.SetVideoSourceFPS(this->video->GetFPS());
+
+		// live samples are kept, so they can be calibrated offline later
+		this->calibrator.SetSaveImages(true);
 	}
 
 
@@ -34,15 +41,32 @@ namespace TUMAugmentedRealityExercise
 
 	int CameraCalibrationApp::Run(int argc, char* argv[])
 	{
+		// the spans are recorded if main was started with --trace
+		int frame = 0;
+
 		while(this->running)
 		{
+			TUMAR_TRACE_FRAME(frame++);
+
 			fps.BeginProcessing();
 
-			this->video->GetNextImage(this->buffer);
+			{
+				TUMAR_TRACE_SCOPE("grab");
+
+				this->video->GetNextImage(this->buffer);
+			}
+
+			// the search runs on the sampler thread, the preview doesn't wait for it
+			if(this->sampleChessboardImage && this->sampler.Submit(this->buffer))
+			{
+				this->sampleChessboardImage = false;
+			}
+
+			cv::Mat grey;
 
-			if(this->sampleChessboardImage)
+			if(this->sampler.Poll(grey, this->corners, this->cornersFound))
 			{
-				if(calibrator.SampleChessboardImage(this->buffer))
+				if(this->cornersFound && calibrator.AddSample(grey, this->corners))
 				{
 					std::cout << "Sampled " << calibrator.GetSampledImageCount() << " chessboard image!" << std::endl;
 				}
@@ -50,52 +74,58 @@ namespace TUMAugmentedRealityExercise
 				{
 					std::cout << "Sampling chessboard image failed!" << std::endl;
 				}
-
-				this->sampleChessboardImage = false;
 			}
 
 			if(this->sampleChessboardImageFolder)
 			{
-				std::vector<std::string> images;
-				images.push_back("chessboard00.bmp");
-				images.push_back("chessboard01.bmp");
-				images.push_back("chessboard02.bmp");
-				images.push_back("chessboard03.bmp");
-				images.push_back("chessboard04.bmp");
-				images.push_back("chessboard05.bmp");
-				images.push_back("chessboard06.bmp");
-				images.push_back("chessboard07.bmp");
-				images.push_back("chessboard08.bmp");
-				images.push_back("chessboard09.bmp");
-				images.push_back("chessboard10.bmp");
-				images.push_back("chessboard11.bmp");
-				images.push_back("chessboard12.bmp");
-				images.push_back("chessboard13.bmp");
-				images.push_back("chessboard14.bmp");
-				images.push_back("chessboard15.bmp");
-				images.push_back("chessboard16.bmp");
-				images.push_back("chessboard17.bmp");
-				images.push_back("chessboard18.bmp");
-				images.push_back("chessboard19.bmp");
-				images.push_back("chessboard20.bmp");
-
-				calibrator.SampleChessboardImages(images);
+				TUMAR_TRACE_SCOPE("sample chessboard folder");
+
+				ThreadPool pool;
+
+				std::string directory = this->outputFolder + "/chessboard";
+				int sampled = calibrator.SampleChessboardDirectory(directory, &pool);
+
+				std::cout << "Sampled " << sampled << " chessboard images from " << directory << ", " << calibrator.GetSampledImageCount() << " in total" << std::endl;
 
 				this->sampleChessboardImageFolder = false;
 			}
 
 			if(this->calculateCalibration)
 			{
+				TUMAR_TRACE_SCOPE("calibrate");
+
 				calibrator.CalculateCalibration();
 
 				this->calculateCalibration = false;
 			}
 
-			this->window.update(this->buffer);
+			{
+				TUMAR_TRACE_SCOPE("display");
+
+				if(this->corners.empty())
+				{
+					this->window.update(this->buffer);
+				}
+				else
+				{
+					this->buffer.copyTo(this->display);
+					cv::drawChessboardCorners(this->display, calibrator.GetPatternSize(), this->corners, true);
+
+					this->window.update(this->display);
+				}
+			}
 
 			fps.EndProcessing();
 
-			this->HandleKeyboardInput(cv::waitKey(fps.GetMsUntilNextFrame()));
+			int key;
+
+			{
+				TUMAR_TRACE_SCOPE("wait");
+
+				key = cv::waitKey(fps.GetMsUntilNextFrame());
+			}
+
+			this->HandleKeyboardInput(key);
 		}
 
 		return 0;
@@ -111,6 +141,9 @@ namespace TUMAugmentedRealityExercise
 		case 0x20: // SPACE
 			this->sampleChessboardImage = true;
 			break;
+		case 102:  // F
+			this->sampleChessboardImageFolder = true;
+			break;
 		case 27:   // ESCAPE
 			this->running = false;
 			break;
@@ -10,15 +10,18 @@
 #pragma once
 
 #include <iostream>
+#include <string>
 
-#include <opencv\cv.h>
-#include <opencv\highgui.h>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/calib3d.hpp>
 
 #include "VideoSource.h"
 #include "VideoWindow.h"
 #include "FPSMonitor.h"
 
 #include "ChessboardCameraCalibrator.h"
+#include "ChessboardSampler.h"
 
 namespace TUMAugmentedRealityExercise
 {
@@ -31,6 +34,10 @@ namespace TUMAugmentedRealityExercise
 		bool calculateCalibration;
 
 		cv::Mat buffer;
+		cv::Mat display;
+
+		// the calibration and the sampled images are written here, the chessboard key samples its chessboard subfolder
+		std::string outputFolder;
 
 		FPSMonitor fps;
 
@@ -40,10 +47,16 @@ namespace TUMAugmentedRealityExercise
 		NullImageProcessor processor;
 
 		ChessboardCameraCalibrator calibrator;
+		ChessboardSampler sampler;
+
+		// corners of the last searched frame, drawn over the preview
+		std::vector<cv::Point2f> corners;
+		bool cornersFound;
 
 		void HandleKeyboardInput(int key);
 	public:
-		CameraCalibrationApp(void);
+		// the pattern counts the inner corners of the board, the square size is the unit of the calibration
+		CameraCalibrationApp(const std::string& outputFolder = "./media", const cv::Size& patternSize = cv::Size(8, 6), float squareSize = 1.0f);
 		~CameraCalibrationApp(void);
 
 		int Run(int argc, char* argv[]);
@@ -0,0 +1,534 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "CandidateRecording.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include "MemoryStorage.h"
+#include "Profiler.h"
+#include "UndistortionMap.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	static_assert(sizeof(CandidateRecordingHeader) == 32, "CandidateRecordingHeader has to be packed");
+	static_assert(sizeof(CandidateFrameHeader) == 72, "CandidateFrameHeader has to be packed");
+	static_assert(sizeof(CandidateRecord) == 152, "CandidateRecord has to be packed");
+	static_assert(sizeof(CandidateStripe) == 24, "CandidateStripe has to be packed");
+
+	static const char CandidateRecordingMagic[4] = { 'T', 'A', 'R', 'C' };
+	static const int CandidateRecordingVersion = 1;
+
+	// the stripes read one pixel beyond their corners
+	static const int PatchMargin = 2;
+
+	// differences to the recording which are still counted as the same result
+	static const double StripeTolerance = 1e-3;
+	static const double CornerTolerance = 1e-3;
+	static const double TranslationTolerance = 1e-4;
+
+	static size_t GetPatchSize(const CandidateRecord& record, int type)
+	{
+		size_t bytes = (size_t) record.Patch[2] * record.Patch[3] * CV_ELEM_SIZE(type);
+
+		return (bytes + 7) & ~(size_t) 7;
+	}
+
+	static size_t GetCandidateSize(const CandidateRecord& record, int type)
+	{
+		return sizeof(CandidateRecord) + record.StripeCount * sizeof(CandidateStripe) + GetPatchSize(record, type);
+	}
+
+	static const CandidateStripe* GetStripes(const CandidateRecord& record)
+	{
+		return (const CandidateStripe*) (&record + 1);
+	}
+
+	static const unsigned char* GetPatch(const CandidateRecord& record)
+	{
+		return (const unsigned char*) (GetStripes(record) + record.StripeCount);
+	}
+
+	static void Append(std::vector<char>& buffer, const void* data, size_t size)
+	{
+		const char* bytes = (const char*) data;
+
+		buffer.insert(buffer.end(), bytes, bytes + size);
+	}
+
+	void CandidateReplayReport::Print(std::ostream& out) const
+	{
+		out << this->Frames << " frames, " << this->Candidates << " candidates, " << this->Detected << " markers detected" << std::endl;
+		out << 1e6 * this->Seconds / std::max(this->Candidates * this->Runs, 1) << "us per candidate over " << this->Runs << " runs" << std::endl;
+		out << "largest difference to the recording: stripe centers " << this->StripeDifference << "px, corners " << this->CornerDifference << "px, translation " << 100 * this->TranslationDifference << "%" << std::endl;
+
+		if(this->Mismatches == 0)
+			out << "same results as recorded" << std::endl;
+		else
+			out << this->Mismatches << " candidates DIFFER from the recording" << std::endl;
+	}
+
+	CandidateRecorder::CandidateRecorder(const std::string& file) :
+		file(file),
+		stream(file.c_str(), std::ios::out | std::ios::binary | std::ios::trunc),
+		pending(false)
+	{
+		if(!this->stream)
+			CV_Error(cv::Error::StsError, "can't create candidate recording " + file);
+
+		std::memset(&this->header, 0, sizeof(CandidateRecordingHeader));
+		std::memcpy(this->header.Magic, CandidateRecordingMagic, sizeof(CandidateRecordingMagic));
+
+		this->header.Version = CandidateRecordingVersion;
+
+		// rewritten with the size of the frames once it is known and with the counts when the recording ends
+		this->stream.write((const char*) &this->header, sizeof(CandidateRecordingHeader));
+		this->Check();
+	}
+
+	CandidateRecorder::~CandidateRecorder(void)
+	{
+		try
+		{
+			this->Close();
+		}
+		catch(const cv::Exception& e)
+		{
+			std::cerr << e.what() << std::endl;
+		}
+	}
+
+	void CandidateRecorder::Close(void)
+	{
+		if(!this->stream.is_open())
+			return;
+
+		if(this->pending)
+			this->WriteFrame();
+
+		this->WriteHeader();
+
+		this->stream.close();
+		this->Check();
+	}
+
+	void CandidateRecorder::Check(void)
+	{
+		if(this->stream)
+			return;
+
+		// nothing is written after the first error, the frames before it can still be replayed
+		if(this->stream.is_open())
+			this->stream.close();
+
+		CV_Error(cv::Error::StsError, "can't write candidate recording " + this->file);
+	}
+
+	void CandidateRecorder::WriteHeader(void)
+	{
+		std::streampos end = this->stream.tellp();
+
+		this->stream.seekp(0);
+		this->stream.write((const char*) &this->header, sizeof(CandidateRecordingHeader));
+		this->stream.seekp(end);
+
+		this->Check();
+	}
+
+	void CandidateRecorder::WriteFrame(void)
+	{
+		this->pending = false;
+
+		this->stream.write((const char*) &this->frame, sizeof(CandidateFrameHeader));
+
+		if(!this->candidates.empty())
+			this->stream.write(&this->candidates[0], this->candidates.size());
+
+		this->Check();
+
+		this->header.FrameCount++;
+		this->header.CandidateCount += this->frame.CandidateCount;
+	}
+
+	void CandidateRecorder::CaptureMarkerCode(const cv::Mat& code)
+	{
+	}
+
+	void CandidateRecorder::CaptureFrame(const cv::Mat& image, const DetectorContext& context, const StripeSamplingProfile& profile)
+	{
+		if(!this->stream.is_open())
+			CV_Error(cv::Error::StsError, "candidate recording " + this->file + " is closed");
+
+		if(this->pending)
+			this->WriteFrame();
+
+		if(this->header.Width == 0)
+		{
+			this->header.Width = image.cols;
+			this->header.Height = image.rows;
+			this->header.Type = image.type();
+
+			// the frames can't be read without the size, so a recording which is never closed still needs it
+			this->WriteHeader();
+		}
+
+		CV_Assert(image.cols == this->header.Width && image.rows == this->header.Height && image.type() == this->header.Type);
+
+		std::memset(&this->frame, 0, sizeof(CandidateFrameHeader));
+
+		this->frame.FrameNumber = this->header.FrameCount;
+		this->frame.MarkerSize = context.MarkerSize;
+		this->frame.FocalLength = context.FocalLength;
+		this->frame.PrincipalPoint[0] = context.PrincipalPoint.x;
+		this->frame.PrincipalPoint[1] = context.PrincipalPoint.y;
+		this->frame.CodeThreshold = context.CodeThreshold;
+		this->frame.Undistorted = context.Undistortion != NULL ? 1 : 0;
+
+		this->frame.MinStripesPerEdge = profile.MinStripesPerEdge;
+		this->frame.MaxStripesPerEdge = profile.MaxStripesPerEdge;
+		this->frame.StripeHeight = profile.StripeHeight;
+		this->frame.PixelsPerStripe = profile.PixelsPerStripe;
+		this->frame.StripeWidthFactor = profile.StripeWidthFactor;
+		this->frame.MinHalfStripeWidth = profile.MinHalfStripeWidth;
+
+		// the buffer keeps its capacity, so the candidates of later frames aren't allocated again
+		this->candidates.clear();
+		this->pending = true;
+	}
+
+	void CandidateRecorder::CaptureCandidate(const cv::Mat& image, const Quad& quad, const Marker& marker, bool detected)
+	{
+		// candidates processed outside of a frame can't be replayed
+		if(!this->pending)
+			return;
+
+		CandidateRecord record;
+		std::memset(&record, 0, sizeof(CandidateRecord));
+
+		double minX = quad.Corners[0].x, maxX = minX;
+		double minY = quad.Corners[0].y, maxY = minY;
+
+		for(int a = 0; a < 4; a++)
+		{
+			record.Quad[a][0] = quad.Corners[a].x;
+			record.Quad[a][1] = quad.Corners[a].y;
+
+			minX = std::min(minX, (double) quad.Corners[a].x);
+			maxX = std::max(maxX, (double) quad.Corners[a].x);
+			minY = std::min(minY, (double) quad.Corners[a].y);
+			maxY = std::max(maxY, (double) quad.Corners[a].y);
+		}
+
+		for(int a = 0; a < marker.Stripes.size(); a++)
+		{
+			const std::vector<cv::Point2d>& corners = marker.Stripes[a].Corners;
+
+			for(int b = 0; b < corners.size(); b++)
+			{
+				minX = std::min(minX, corners[b].x);
+				maxX = std::max(maxX, corners[b].x);
+				minY = std::min(minY, corners[b].y);
+				maxY = std::max(maxY, corners[b].y);
+			}
+		}
+
+		int left = std::max((int) std::floor(minX) - PatchMargin, 0);
+		int top = std::max((int) std::floor(minY) - PatchMargin, 0);
+		int right = std::min((int) std::ceil(maxX) + PatchMargin + 1, image.cols);
+		int bottom = std::min((int) std::ceil(maxY) + PatchMargin + 1, image.rows);
+
+		record.Patch[0] = left;
+		record.Patch[1] = top;
+		record.Patch[2] = std::max(right - left, 0);
+		record.Patch[3] = std::max(bottom - top, 0);
+
+		for(int a = 0; a < 4 && a < marker.EdgeStripeCounts.size(); a++)
+		{
+			record.EdgeStripeCounts[a] = marker.EdgeStripeCounts[a];
+		}
+
+		record.StripeCount = (int) marker.Stripes.size();
+
+		PackMarkerRecord(marker, this->frame.FrameNumber, 0, record.Result);
+
+		if(!detected)
+			record.Result.MarkerId = -1;
+
+		Append(this->candidates, &record, sizeof(CandidateRecord));
+
+		for(int a = 0; a < marker.Stripes.size(); a++)
+		{
+			const MarkerStripe& stripe = marker.Stripes[a];
+
+			CandidateStripe packed;
+			packed.Center[0] = (float) stripe.Center.x;
+			packed.Center[1] = (float) stripe.Center.y;
+			packed.SubPixelCenter[0] = (float) stripe.SubPixelCenter.x;
+			packed.SubPixelCenter[1] = (float) stripe.SubPixelCenter.y;
+			packed.Width = stripe.Width;
+			packed.Height = stripe.Height;
+
+			Append(this->candidates, &packed, sizeof(CandidateStripe));
+		}
+
+		size_t rowSize = record.Patch[2] * image.elemSize();
+
+		for(int y = 0; y < record.Patch[3]; y++)
+		{
+			Append(this->candidates, image.ptr<unsigned char>(top + y) + left * image.elemSize(), rowSize);
+		}
+
+		this->candidates.resize(this->candidates.size() + GetPatchSize(record, image.type()) - rowSize * record.Patch[3], 0);
+		this->frame.CandidateCount++;
+	}
+
+	int CandidateRecorder::GetFrameCount(void)
+	{
+		return this->header.FrameCount + (this->pending ? 1 : 0);
+	}
+
+	int CandidateRecorder::GetCandidateCount(void)
+	{
+		return this->header.CandidateCount + (this->pending ? this->frame.CandidateCount : 0);
+	}
+
+	CandidateReplay::CandidateReplay(const std::string& file) :
+		candidateCount(0),
+		undistorted(false)
+	{
+		std::ifstream stream(file.c_str(), std::ios::in | std::ios::binary);
+
+		if(!stream)
+			CV_Error(cv::Error::StsError, "can't open candidate recording " + file);
+
+		if(!stream.read((char*) &this->header, sizeof(CandidateRecordingHeader)) || std::memcmp(this->header.Magic, CandidateRecordingMagic, sizeof(CandidateRecordingMagic)) != 0 || this->header.Version != CandidateRecordingVersion)
+			CV_Error(cv::Error::StsError, "unsupported candidate recording " + file);
+
+		stream.seekg(0, std::ios::end);
+		size_t size = (size_t) stream.tellg();
+		stream.seekg(0, std::ios::beg);
+
+		// one allocation for the whole file, the vector's memory is aligned for doubles
+		this->buffer.resize(size);
+		stream.read(&this->buffer[0], size);
+
+		// a recording which wasn't closed has no counts in its header, its frames are read until the first incomplete one
+		size_t offset = sizeof(CandidateRecordingHeader);
+
+		while(this->header.Width > 0 && offset + sizeof(CandidateFrameHeader) <= size)
+		{
+			Frame frame;
+			frame.Header = (const CandidateFrameHeader*) &this->buffer[offset];
+
+			size_t next = offset + sizeof(CandidateFrameHeader);
+
+			for(int a = 0; a < frame.Header->CandidateCount && next + sizeof(CandidateRecord) <= size; a++)
+			{
+				const CandidateRecord* record = (const CandidateRecord*) &this->buffer[next];
+
+				next += GetCandidateSize(*record, this->header.Type);
+
+				if(next <= size)
+					frame.Candidates.push_back(record);
+			}
+
+			if(frame.Candidates.size() != frame.Header->CandidateCount)
+				break;
+
+			this->frames.push_back(frame);
+			this->candidateCount += frame.Header->CandidateCount;
+			this->undistorted = this->undistorted || frame.Header->Undistorted != 0;
+
+			offset = next;
+		}
+
+		if(this->frames.empty())
+			CV_Error(cv::Error::StsError, "empty candidate recording " + file);
+	}
+
+	CandidateReplay::~CandidateReplay(void)
+	{
+	}
+
+	int CandidateReplay::GetFrameCount(void) const
+	{
+		return (int) this->frames.size();
+	}
+
+	int CandidateReplay::GetCandidateCount(void) const
+	{
+		return this->candidateCount;
+	}
+
+	cv::Size CandidateReplay::GetResolution(void) const
+	{
+		return cv::Size(this->header.Width, this->header.Height);
+	}
+
+	bool CandidateReplay::IsUndistorted(void) const
+	{
+		return this->undistorted;
+	}
+
+	CandidateReplayReport CandidateReplay::Run(int runs, const UndistortionMap* undistortion)
+	{
+		CandidateReplayReport report;
+		report.Frames = (int) this->frames.size();
+		report.Candidates = this->candidateCount;
+		report.Runs = runs;
+
+		MarkerContainer markers;
+		MemoryStorage storage;
+		MarkerDetectionImageProcessor processor(&markers, &storage, DetectorContext());
+
+		cv::Mat image(this->header.Height, this->header.Width, this->header.Type);
+		int64 ticks = 0;
+
+		// the scopes of the stages would be part of the time, so they are profiled in a pass after the timed runs
+		bool profiling = Profiler::IsEnabled();
+		int passes = profiling ? runs + 1 : runs;
+
+		for(int run = 0; run < passes; run++)
+		{
+			Profiler::SetEnabled(run == runs);
+
+			for(int a = 0; a < this->frames.size(); a++)
+			{
+				const CandidateFrameHeader& header = *this->frames[a].Header;
+				const std::vector<const CandidateRecord*>& candidates = this->frames[a].Candidates;
+
+				DetectorContext context;
+				context.MarkerSize = header.MarkerSize;
+				context.FocalLength = header.FocalLength;
+				context.PrincipalPoint = cv::Point2f(header.PrincipalPoint[0], header.PrincipalPoint[1]);
+				context.CodeThreshold = header.CodeThreshold;
+				context.Undistortion = header.Undistorted != 0 ? undistortion : NULL;
+
+				processor.SetContext(context);
+				processor.SetStripeSamplingProfile(StripeSamplingProfile(header.MinStripesPerEdge, header.MaxStripesPerEdge, header.PixelsPerStripe, header.StripeHeight, header.StripeWidthFactor, header.MinHalfStripeWidth));
+
+				// only the patches are read, the rest of the image stays black
+				image.setTo(cv::Scalar::all(0));
+
+				for(int b = 0; b < candidates.size(); b++)
+				{
+					const CandidateRecord& record = *candidates[b];
+
+					if(record.Patch[2] == 0 || record.Patch[3] == 0)
+						continue;
+
+					cv::Mat patch(record.Patch[3], record.Patch[2], this->header.Type, (void*) GetPatch(record));
+					cv::Mat target = image(cv::Rect(record.Patch[0], record.Patch[1], record.Patch[2], record.Patch[3]));
+
+					patch.copyTo(target);
+				}
+
+				for(int b = 0; b < candidates.size(); b++)
+				{
+					const CandidateRecord& record = *candidates[b];
+
+					Quad quad;
+
+					for(int c = 0; c < 4; c++)
+					{
+						quad.Corners[c] = cv::Point(record.Quad[c][0], record.Quad[c][1]);
+					}
+
+					int64 start = cv::getTickCount();
+					bool detected = processor.ProcessCandidate(image, quad);
+
+					if(run < runs)
+						ticks += cv::getTickCount() - start;
+
+					if(run == 0)
+					{
+						report.Detected += detected ? 1 : 0;
+
+						this->Compare(record, detected ? &markers.back() : NULL, report);
+					}
+				}
+
+				markers.clear();
+				storage.Clear();
+			}
+		}
+
+		Profiler::SetEnabled(profiling);
+
+		report.Seconds = ticks / cv::getTickFrequency();
+
+		return report;
+	}
+
+	void CandidateReplay::Compare(const CandidateRecord& record, const Marker* marker, CandidateReplayReport& report) const
+	{
+		bool recorded = record.Result.MarkerId >= 0;
+
+		if(marker == NULL || !recorded)
+		{
+			if(marker != NULL || recorded)
+				report.Mismatches++;
+
+			return;
+		}
+
+		// packed like the recording, so both sides are rounded to floats the same way
+		MarkerRecord result;
+		PackMarkerRecord(*marker, record.Result.FrameNumber, 0, result);
+
+		bool same = result.MarkerId == record.Result.MarkerId && marker->Stripes.size() == record.StripeCount && (result.Error < 0) == (record.Result.Error < 0);
+
+		const CandidateStripe* stripes = GetStripes(record);
+
+		for(int a = 0; a < record.StripeCount && a < marker->Stripes.size(); a++)
+		{
+			double dx = (float) marker->Stripes[a].SubPixelCenter.x - stripes[a].SubPixelCenter[0];
+			double dy = (float) marker->Stripes[a].SubPixelCenter.y - stripes[a].SubPixelCenter[1];
+			double difference = std::sqrt(dx * dx + dy * dy);
+
+			report.StripeDifference = std::max(report.StripeDifference, difference);
+			same = same && difference <= StripeTolerance;
+		}
+
+		for(int a = 0; a < 4; a++)
+		{
+			double dx = result.Corners[a][0] - record.Result.Corners[a][0];
+			double dy = result.Corners[a][1] - record.Result.Corners[a][1];
+			double difference = std::sqrt(dx * dx + dy * dy);
+
+			report.CornerDifference = std::max(report.CornerDifference, difference);
+			same = same && difference <= CornerTolerance;
+		}
+
+		if(result.Error >= 0 && record.Result.Error >= 0)
+		{
+			double distance = 0;
+			double difference = 0;
+
+			for(int a = 0; a < 3; a++)
+			{
+				double d = result.Translation[a] - record.Result.Translation[a];
+
+				distance += record.Result.Translation[a] * record.Result.Translation[a];
+				difference += d * d;
+			}
+
+			difference = std::sqrt(difference) / std::max(std::sqrt(distance), 1e-9);
+
+			report.TranslationDifference = std::max(report.TranslationDifference, difference);
+			same = same && difference <= TranslationTolerance;
+		}
+
+		if(!same)
+			report.Mismatches++;
+	}
+}
@@ -0,0 +1,195 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <fstream>
+
+#include <opencv2/imgproc.hpp>
+
+#include "DetectorContext.h"
+#include "ImageProcessor.h"
+#include "MarkerRecord.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * layout of a candidate recording: this header followed by a frame header
+	 * for every frame and its candidates. all records are a multiple of 8 bytes,
+	 * so they stay aligned when the file is read at once.
+	 */
+	struct CandidateRecordingHeader
+	{
+		char Magic[4];
+		int Version;
+		int Width;
+		int Height;
+		int Type;
+		int FrameCount;
+		int CandidateCount;
+		int Reserved;
+	};
+
+	// the settings a frame was searched with, followed by CandidateCount candidates
+	struct CandidateFrameHeader
+	{
+		int FrameNumber;
+		int CandidateCount;
+
+		float MarkerSize;
+		float FocalLength;
+		float PrincipalPoint[2];
+		double CodeThreshold;
+
+		// 1 if the corners were undistorted before the pose was estimated
+		int Undistorted;
+
+		int MinStripesPerEdge;
+		int MaxStripesPerEdge;
+		int StripeHeight;
+		double PixelsPerStripe;
+		double StripeWidthFactor;
+		double MinHalfStripeWidth;
+	};
+
+	/**
+	 * one quad of the contour search, followed by StripeCount stripes and the
+	 * pixels of the patch, padded to a multiple of 8 bytes.
+	 */
+	struct CandidateRecord
+	{
+		int Quad[4][2];
+
+		// x, y, width and height of the part of the image the candidate reads
+		int Patch[4];
+
+		int EdgeStripeCounts[4];
+		int StripeCount;
+		int Reserved;
+
+		// MarkerId is -1 if the candidate was rejected
+		MarkerRecord Result;
+	};
+
+	struct CandidateStripe
+	{
+		float Center[2];
+		float SubPixelCenter[2];
+		int Width;
+		int Height;
+	};
+
+	/**
+	 * records the candidates of every frame together with their stripes, results
+	 * and the part of the binary image they were read from. set it as debug sink
+	 * of a single detector, the candidates of a frame are kept until the next one
+	 * starts.
+	 */
+	class CandidateRecorder : public DetectorDebugSink
+	{
+	private:
+		std::string file;
+		std::ofstream stream;
+		CandidateRecordingHeader header;
+
+		// the current frame, its candidate count is only known when the next frame starts
+		CandidateFrameHeader frame;
+		std::vector<char> candidates;
+		bool pending;
+
+		void WriteHeader(void);
+		void WriteFrame(void);
+
+		// closes the file and fails if a write didn't succeed
+		void Check(void);
+	public:
+		CandidateRecorder(const std::string& file);
+
+		// closes the recording, write errors are only printed
+		~CandidateRecorder(void);
+
+		// writes the last frame and the counts, fails if the recording is incomplete
+		void Close(void);
+
+		void CaptureMarkerCode(const cv::Mat& code);
+		void CaptureFrame(const cv::Mat& image, const DetectorContext& context, const StripeSamplingProfile& profile);
+		void CaptureCandidate(const cv::Mat& image, const Quad& quad, const Marker& marker, bool detected);
+
+		int GetFrameCount(void);
+		int GetCandidateCount(void);
+	};
+
+	struct CandidateReplayReport
+	{
+		int Frames;
+		int Candidates;
+		int Detected;
+		int Runs;
+
+		// time spent on the candidates over all runs
+		double Seconds;
+
+		// candidates of the first run whose decision, code, stripes, corners or pose differ from the recording
+		int Mismatches;
+
+		// largest differences of the detected markers in pixels and relative to the recorded distance
+		double StripeDifference;
+		double CornerDifference;
+		double TranslationDifference;
+
+		CandidateReplayReport(void) : Frames(0), Candidates(0), Detected(0), Runs(0), Seconds(0), Mismatches(0), StripeDifference(0), CornerDifference(0), TranslationDifference(0) {};
+
+		void Print(std::ostream& out) const;
+	};
+
+	/**
+	 * runs the stages after the contour search, stripes, corners, decoding and
+	 * pose estimation, on the candidates of a recording. the file is read at once,
+	 * the binary image of a frame is rebuilt from the patches of its candidates.
+	 */
+	class CandidateReplay
+	{
+	private:
+		struct Frame
+		{
+			const CandidateFrameHeader* Header;
+			std::vector<const CandidateRecord*> Candidates;
+		};
+
+		std::vector<char> buffer;
+		CandidateRecordingHeader header;
+
+		std::vector<Frame> frames;
+		int candidateCount;
+		bool undistorted;
+
+		void Compare(const CandidateRecord& record, const Marker* marker, CandidateReplayReport& report) const;
+	public:
+		CandidateReplay(const std::string& file);
+		~CandidateReplay(void);
+
+		int GetFrameCount(void) const;
+		int GetCandidateCount(void) const;
+		cv::Size GetResolution(void) const;
+
+		// true if any frame was recorded with undistortion
+		bool IsUndistorted(void) const;
+
+		/**
+		 * processes all candidates runs times and compares the first run to the recording.
+		 * the runs are timed with the profiler disabled, if it is enabled the stages are
+		 * profiled in one more pass. the undistortion is used for the frames recorded with
+		 * one, it has to be set to the resolution of the recording. may be NULL.
+		 */
+		CandidateReplayReport Run(int runs, const UndistortionMap* undistortion);
+	};
+}
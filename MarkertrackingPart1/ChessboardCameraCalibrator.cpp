@@ -9,19 +9,189 @@
 
 #include "ChessboardCameraCalibrator.h"
 
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <map>
+#include <fstream>
+#include <ctime>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
 namespace TUMAugmentedRealityExercise
 {
-	ChessboardCameraCalibrator::ChessboardCameraCalibrator(const std::string& outputFolder) :
-		patternSize(8, 6), 
+	/**
+	 * corners found in an image file, or none if the pattern wasn't found.
+	 */
+	struct CachedCorners
+	{
+		cv::Size ImageSize;
+		std::vector<cv::Point2f> Corners;
+	};
+
+	typedef std::map<unsigned long long, CachedCorners> CornerCache;
+
+	static const int MinQuickCheckWidth = 320;
+
+	static const int DefaultMaxViews = 30;
+
+	// views closer than this in descriptor space add little to the calibration
+	static const float RedundantViewDistance = 0.05f;
+
+	static const int ViewDescriptorSize = 5;
+
+	static float GetViewDistance(const float* a, const float* b)
+	{
+		float sum = 0;
+
+		for(int c = 0; c < ViewDescriptorSize; c++)
+		{
+			sum += (a[c] - b[c]) * (a[c] - b[c]);
+		}
+
+		return std::sqrt(sum);
+	}
+
+	static float GetLength(const cv::Point2f& a, const cv::Point2f& b)
+	{
+		return std::max(std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y)), 1e-3f);
+	}
+
+	// 64 bit FNV-1a of the file content, 0 if the file can't be read
+	static unsigned long long HashFile(const std::string& file)
+	{
+		std::ifstream stream(file.c_str(), std::ios::in | std::ios::binary);
+
+		if(!stream)
+			return 0;
+
+		unsigned long long hash = 14695981039346656037ULL;
+		char buffer[64 * 1024];
+
+		while(stream.read(buffer, sizeof(buffer)) || stream.gcount() > 0)
+		{
+			for(std::streamsize a = 0; a < stream.gcount(); a++)
+			{
+				hash = (hash ^ (unsigned char) buffer[a]) * 1099511628211ULL;
+			}
+		}
+
+		return hash;
+	}
+
+	// one line per image: hash, image size, number of corners and their coordinates
+	static void LoadCornerCache(const std::string& file, CornerCache& cache)
+	{
+		std::ifstream stream(file.c_str());
+		unsigned long long hash;
+		CachedCorners entry;
+		int count;
+
+		while(stream >> std::hex >> hash >> std::dec >> entry.ImageSize.width >> entry.ImageSize.height >> count)
+		{
+			entry.Corners.resize(std::max(count, 0));
+
+			for(int a = 0; a < entry.Corners.size(); a++)
+			{
+				stream >> entry.Corners[a].x >> entry.Corners[a].y;
+			}
+
+			if(stream)
+				cache[hash] = entry;
+		}
+	}
+
+	static void SaveCornerCache(const std::string& file, const CornerCache& cache)
+	{
+		std::ofstream stream(file.c_str(), std::ios::out | std::ios::trunc);
+
+		stream.precision(9);
+
+		for(CornerCache::const_iterator it = cache.begin(); it != cache.end(); ++it)
+		{
+			stream << std::hex << it->first << std::dec << " " << it->second.ImageSize.width << " " << it->second.ImageSize.height << " " << it->second.Corners.size();
+
+			for(int a = 0; a < it->second.Corners.size(); a++)
+			{
+				stream << " " << it->second.Corners[a].x << " " << it->second.Corners[a].y;
+			}
+
+			stream << "\n";
+		}
+	}
+
+	static bool IsImageFile(const std::string& file)
+	{
+		std::string extension = file.substr(file.find_last_of('.') + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+		return extension == "bmp" || extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "tif" || extension == "tiff" || extension == "pgm" || extension == "ppm";
+	}
+
+	static std::vector<std::string> ListImageFiles(const std::string& directory)
+	{
+		std::vector<std::string> files;
+
+#ifdef _WIN32
+		WIN32_FIND_DATAA entry;
+		HANDLE find = FindFirstFileA((directory + "/*").c_str(), &entry);
+
+		if(find != INVALID_HANDLE_VALUE)
+		{
+			do
+			{
+				if(!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && IsImageFile(entry.cFileName))
+					files.push_back(directory + "/" + entry.cFileName);
+			}
+			while(FindNextFileA(find, &entry));
+
+			FindClose(find);
+		}
+#else
+		DIR* dir = opendir(directory.c_str());
+
+		if(dir != NULL)
+		{
+			for(dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
+			{
+				if(entry->d_name[0] != '.' && IsImageFile(entry->d_name))
+					files.push_back(directory + "/" + entry->d_name);
+			}
+
+			closedir(dir);
+		}
+#endif
+
+		std::sort(files.begin(), files.end());
+
+		return files;
+	}
+
+	ChessboardCameraCalibrator::ChessboardCameraCalibrator(const std::string& outputFolder, const cv::Size& patternSize, float squareSize) :
+		patternSize(patternSize), 
+		squareSize(squareSize),
 		sampledCorners(), 
 		intrinsicParameters(cv::Mat::zeros(3, 3, CV_64FC1)),
 		distortionParameters(cv::Mat::zeros(1, 5, CV_64FC1)),
 		outputFolder(outputFolder),
-		sampledObjectPrototype()
+		saveImages(false),
+		sampledObjectPrototype(),
+		calibrated(false),
+		calibratedSampleCount(0),
+		maxViews(DefaultMaxViews)
 	{
 		for(int i = 0; i < patternSize.area(); i++)
 		{
-			this->sampledObjectPrototype.push_back(cv::Point3f(i / patternSize.width, i % patternSize.width, 0.0));
+			// the corners are found row by row
+			this->sampledObjectPrototype.push_back(cv::Point3f((i % patternSize.width) * squareSize, (i / patternSize.width) * squareSize, 0.0f));
 		}
 	}
 
@@ -45,25 +215,129 @@ namespace TUMAugmentedRealityExercise
 		return GetImageOutputFolder().append("/marked");
 	}
 
-	void ChessboardCameraCalibrator::SaveImage(const cv::Mat& image, bool marked)
+	std::string ChessboardCameraCalibrator::GetCornerCacheFile(void)
+	{
+		// the corners depend on the pattern, each pattern has its own cache
+		return this->outputFolder + "/corners_" + std::to_string((long long) this->patternSize.width) + "x" + std::to_string((long long) this->patternSize.height) + ".cache";
+	}
+
+	void ChessboardCameraCalibrator::SetSaveImages(bool saveImages)
+	{
+		this->saveImages = saveImages;
+	}
+
+	void ChessboardCameraCalibrator::SaveImage(const cv::Mat& image, bool marked, int n)
 	{
 		std::string file;
-		int n = GetSampledImageCount();		
 		std::string prefix = (n < 10 ? "_0" : "_");
 
 		file += marked ? GetMarkedImageOutputFolder() : GetImageOutputFolder();
 		file += "/chessboard" + prefix + std::to_string((long double) n) + ".bmp";
 
-		cvSaveImage(file.c_str(), &(CvMat) image);
+		cv::imwrite(file, image);
 	}
 
-	bool ChessboardCameraCalibrator::SampleChessboardImage(const cv::Mat& image)
+	const cv::Size& ChessboardCameraCalibrator::GetPatternSize(void) const
+	{
+		return this->patternSize;
+	}
+
+	bool ChessboardCameraCalibrator::FindCorners(const cv::Mat& grey, std::vector<cv::Point2f>& corners, bool quickCheck) const
+	{
+		int flags = cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE;
+		bool success = false;
+
+		if(quickCheck)
+		{
+			// frames without a board are rejected by the fast check before the full search
+			flags |= cv::CALIB_CB_FAST_CHECK;
+
+			// below this width the board gets too small to be found at half resolution
+			if(grey.cols >= 2 * MinQuickCheckWidth)
+			{
+				cv::Mat small;
+				cv::pyrDown(grey, small);
+
+				success = cv::findChessboardCorners(small, this->patternSize, corners, flags);
+
+				// a pixel of the small image covers 2x2 pixels of the full one, the corners are refined below
+				for(int a = 0; success && a < corners.size(); a++)
+				{
+					corners[a] = corners[a] * 2.0f + cv::Point2f(0.5f, 0.5f);
+				}
+			}
+		}
+
+		// small or distant boards may only be found at full resolution
+		if(!success)
+		{
+			success = cv::findChessboardCorners(grey, this->patternSize, corners, flags);
+		}
+
+		if(success)
+		{
+			cv::cornerSubPix(grey, corners, cv::Size(11, 11), cv::Size(-1, -1), cv::TermCriteria(cv::TermCriteria::EPS | cv::TermCriteria::COUNT, 30, 0.1));
+		}
+		else
+		{
+			corners.clear();
+		}
+
+		return success;
+	}
+
+	bool ChessboardCameraCalibrator::IsCompatibleSize(const cv::Size& size) const
+	{
+		return this->imageSize.area() == 0 || (long long) size.width * this->imageSize.height == (long long) size.height * this->imageSize.width;
+	}
+
+	bool ChessboardCameraCalibrator::AddCorners(const cv::Size& size, const std::vector<cv::Point2f>& corners)
 	{
 		if(this->imageSize.area() == 0)
 		{
-			this->imageSize = image.size();
+			this->imageSize = size;
+		}
+		else if(!this->IsCompatibleSize(size))
+		{
+			return false;
+		}
+
+		this->sampledCorners.push_back(corners);
+
+		if(size != this->imageSize)
+		{
+			float scale = (float) this->imageSize.width / size.width;
+
+			for(int a = 0; a < this->sampledCorners.back().size(); a++)
+			{
+				this->sampledCorners.back()[a] = this->sampledCorners.back()[a] * scale;
+			}
+		}
+
+		return true;
+	}
+
+	bool ChessboardCameraCalibrator::AddSample(const cv::Mat& image, const std::vector<cv::Point2f>& corners)
+	{
+		if(corners.size() != this->patternSize.area() || !this->AddCorners(image.size(), corners))
+			return false;
+
+		if(this->saveImages)
+		{
+			int n = GetSampledImageCount() - 1;
+			cv::Mat marked = image.clone();
+
+			SaveImage(image, false, n);
+			cv::drawChessboardCorners(marked, this->patternSize, corners, true);
+			SaveImage(marked, true, n);
 		}
-		else if(this->imageSize.area() != image.size().area())
+
+		return true;
+	}
+
+	bool ChessboardCameraCalibrator::SampleChessboardImage(const cv::Mat& image)
+	{
+		if(!this->IsCompatibleSize(image.size()))
 		{
 			return false;
 		}
@@ -72,96 +346,382 @@ namespace TUMAugmentedRealityExercise
 		
 		if(image.channels() == 3)
 		{
-			cv::cvtColor(image, grey, CV_BGR2GRAY);
+			cv::cvtColor(image, grey, cv::COLOR_BGR2GRAY);
 		}
 		else
 		{
 			grey = image;
 		}
 
-		std::vector<cv::Point2f > corners(this->patternSize.area());
+		std::vector<cv::Point2f > corners;
 
-		bool success = cvFindChessboardCorners(&(CvMat) grey, this->patternSize, (CvPoint2D32f*)&corners.front());
+		return this->FindCorners(grey, corners) && this->AddSample(grey, corners);
+	}
 
-		if(success)
+	int ChessboardCameraCalibrator::SampleChessboardImages(const std::vector<std::string>& files, ThreadPool* pool)
+	{
+		CornerCache cache;
+		LoadCornerCache(this->GetCornerCacheFile(), cache);
+
+		std::vector<unsigned long long> hashes(files.size());
+		std::vector<CachedCorners> results(files.size());
+		std::vector<char> found(files.size());
+		std::vector<char> cached(files.size());
+
+		int first = this->GetSampledImageCount();
+
+		std::function<void(int)> sample = [&](int a)
 		{
-			cvFindCornerSubPix(&(CvMat) grey, (CvPoint2D32f*)&corners.front(), corners.size(), cvSize(11, 11), cvSize(-1, -1), cvTermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 30, 0.1)); 
-			
-			SaveImage(grey, false);
-			cvDrawChessboardCorners(&(CvMat) grey, this->patternSize, (CvPoint2D32f*)&corners.front(), corners.size(), 1);
-			SaveImage(grey, true);
+			hashes[a] = HashFile(files[a]);
+
+			CornerCache::const_iterator entry = cache.find(hashes[a]);
+
+			if(hashes[a] != 0 && entry != cache.end())
+			{
+				results[a] = entry->second;
+				found[a] = !results[a].Corners.empty();
+				cached[a] = true;
+
+				return;
+			}
+
+			cv::Mat grey = cv::imread(files[a], cv::IMREAD_GRAYSCALE);
+
+			if(grey.empty())
+				return;
+
+			results[a].ImageSize = grey.size();
+			found[a] = this->FindCorners(grey, results[a].Corners);
+
+			// debug images are numbered in file order, the sampled count isn't known on this thread
+			if(found[a] && this->saveImages)
+			{
+				this->SaveImage(grey, false, first + a);
+				cv::drawChessboardCorners(grey, this->patternSize, results[a].Corners, true);
+				this->SaveImage(grey, true, first + a);
+			}
+		};
+
+		if(pool != NULL)
+		{
+			pool->ParallelFor((int) files.size(), sample);
+		}
+		else
+		{
+			for(int a = 0; a < files.size(); a++)
+			{
+				sample(a);
+			}
+		}
 
-			this->sampledCorners.push_back(corners);
+		// samples are added in file order, so the result doesn't depend on the scheduling
+		int sampled = 0;
+		bool changed = false;
+
+		for(int a = 0; a < files.size(); a++)
+		{
+			if(found[a] && this->AddCorners(results[a].ImageSize, results[a].Corners))
+				sampled++;
+
+			// images which couldn't be read aren't cached, they may be complete next time
+			if(!cached[a] && hashes[a] != 0 && results[a].ImageSize.area() > 0)
+			{
+				cache[hashes[a]] = results[a];
+				changed = true;
+			}
 		}
 
-		return success;
+		if(changed)
+			SaveCornerCache(this->GetCornerCacheFile(), cache);
+
+		return sampled;
 	}
 
-	void ChessboardCameraCalibrator::SampleChessboardImages(const std::vector<std::string> files)
+	int ChessboardCameraCalibrator::SampleChessboardDirectory(const std::string& directory, ThreadPool* pool)
 	{
-		for(int a = 0; a < files.size(); a++)
+		return this->SampleChessboardImages(ListImageFiles(directory), pool);
+	}
+
+	void ChessboardCameraCalibrator::SetMaxViews(int maxViews)
+	{
+		this->maxViews = std::max(maxViews, 0);
+	}
+
+	const std::vector<int>& ChessboardCameraCalibrator::GetSelectedViews(void) const
+	{
+		return this->selectedViews;
+	}
+
+	const std::vector<double>& ChessboardCameraCalibrator::GetViewErrors(void) const
+	{
+		return this->viewErrors;
+	}
+
+	/**
+	 * approximates the pose of the board from its outer corners: position and size in the
+	 * image and the foreshortening of opposite edges, which grows with the tilt.
+	 */
+	void ChessboardCameraCalibrator::DescribeView(int view, float* descriptor) const
+	{
+		const std::vector<cv::Point2f>& corners = this->sampledCorners[view];
+
+		const cv::Point2f& topLeft = corners.front();
+		const cv::Point2f& topRight = corners[this->patternSize.width - 1];
+		const cv::Point2f& bottomLeft = corners[corners.size() - this->patternSize.width];
+		const cv::Point2f& bottomRight = corners.back();
+
+		float width = (float) this->imageSize.width;
+		float height = (float) this->imageSize.height;
+
+		float area = 0.5f * std::abs((bottomRight.x - topLeft.x) * (bottomLeft.y - topRight.y) - (bottomLeft.x - topRight.x) * (bottomRight.y - topLeft.y));
+
+		descriptor[0] = (topLeft.x + topRight.x + bottomLeft.x + bottomRight.x) / (4 * width);
+		descriptor[1] = (topLeft.y + topRight.y + bottomLeft.y + bottomRight.y) / (4 * height);
+		descriptor[2] = std::sqrt(area / (width * height));
+		descriptor[3] = std::log(GetLength(topLeft, bottomLeft) / GetLength(topRight, bottomRight));
+		descriptor[4] = std::log(GetLength(topLeft, topRight) / GetLength(bottomLeft, bottomRight));
+	}
+
+	// farthest point sampling in descriptor space, starting with the first view
+	void ChessboardCameraCalibrator::SelectViews(void)
+	{
+		int count = this->GetSampledImageCount();
+
+		this->selectedViews.clear();
+
+		if(this->maxViews == 0 || count <= this->maxViews)
 		{
-			SampleChessboardImage(cv::Mat(cvLoadImageM(files[a].c_str(), 0)));
+			for(int a = 0; a < count; a++)
+			{
+				this->selectedViews.push_back(a);
+			}
+
+			return;
 		}
+
+		std::vector<float> descriptors(count * ViewDescriptorSize);
+		std::vector<float> distances(count, std::numeric_limits<float>::max());
+
+		for(int a = 0; a < count; a++)
+		{
+			this->DescribeView(a, &descriptors[a * ViewDescriptorSize]);
+		}
+
+		int next = 0;
+
+		while(this->selectedViews.size() < this->maxViews)
+		{
+			this->selectedViews.push_back(next);
+			distances[next] = -1;
+
+			for(int a = 0; a < count; a++)
+			{
+				if(distances[a] >= 0)
+					distances[a] = std::min(distances[a], GetViewDistance(&descriptors[a * ViewDescriptorSize], &descriptors[next * ViewDescriptorSize]));
+			}
+
+			next = (int) (std::max_element(distances.begin(), distances.end()) - distances.begin());
+		}
+
+		std::sort(this->selectedViews.begin(), this->selectedViews.end());
 	}
 
-	void ChessboardCameraCalibrator::CalculateCalibration(void)
+	// points out views sampled since the last calibration which look like an earlier one
+	void ChessboardCameraCalibrator::ReportNewViews(void)
+	{
+		float descriptor[ViewDescriptorSize];
+		float other[ViewDescriptorSize];
+
+		for(int a = this->calibratedSampleCount; a < this->GetSampledImageCount(); a++)
+		{
+			this->DescribeView(a, descriptor);
+
+			int closest = -1;
+			float distance = std::numeric_limits<float>::max();
+
+			for(int b = 0; b < a; b++)
+			{
+				this->DescribeView(b, other);
+
+				float d = GetViewDistance(descriptor, other);
+
+				if(d < distance)
+				{
+					distance = d;
+					closest = b;
+				}
+			}
+
+			if(closest >= 0 && distance < RedundantViewDistance)
+				std::cout << "view " << a << " is almost the same as view " << closest << ", move or tilt the board further" << std::endl;
+		}
+	}
+
+	void ChessboardCameraCalibrator::ReportViewErrors(void)
+	{
+		std::vector<double> errors;
+
+		for(int a = 0; a < this->selectedViews.size(); a++)
+		{
+			errors.push_back(this->viewErrors[this->selectedViews[a]]);
+		}
+
+		if(errors.empty())
+			return;
+
+		std::nth_element(errors.begin(), errors.begin() + errors.size() / 2, errors.end());
+		double median = errors[errors.size() / 2];
+
+		for(int a = 0; a < this->selectedViews.size(); a++)
+		{
+			int view = this->selectedViews[a];
+
+			std::cout << "view " << view << ": " << this->viewErrors[view] << (this->viewErrors[view] > 2 * median ? " (much worse than the others, resample it)" : "") << std::endl;
+		}
+	}
+
+	// the distortion is only known where corners were seen, so empty parts of the image are pointed out
+	void ChessboardCameraCalibrator::ReportCoverage(void)
 	{
-		cv::Mat objectPoints(this->sampledCorners.size() * this->sampledObjectPrototype.size(), 3, CV_32FC1);
-		cv::Mat imagePoints(this->sampledCorners.size() * this->sampledObjectPrototype.size(), 2, CV_32FC1);
-		cv::Mat pointCounts(this->sampledCorners.size(), 1, CV_32SC1);
+		static const char* rows[] = { "top", "middle", "bottom" };
+		static const char* columns[] = { "left", "center", "right" };
 
-		cv::Mat rotations(this->sampledCorners.size(), 3, CV_32FC1);
-		cv::Mat translations(this->sampledCorners.size(), 3, CV_32FC1);
+		int cells[3][3] = { { 0 } };
+		float tilt = 0;
 
-		for(int a = 0; a < this->sampledCorners.size(); a++)
+		for(int a = 0; a < this->selectedViews.size(); a++)
 		{
-			for(int b = 0; b < this->sampledObjectPrototype.size(); b++)
+			const std::vector<cv::Point2f>& corners = this->sampledCorners[this->selectedViews[a]];
+
+			for(int b = 0; b < corners.size(); b++)
 			{
-				int offset =  a * this->sampledObjectPrototype.size();
+				int row = std::min(std::max((int) (3 * corners[b].y / this->imageSize.height), 0), 2);
+				int column = std::min(std::max((int) (3 * corners[b].x / this->imageSize.width), 0), 2);
+
+				cells[row][column]++;
+			}
+
+			float descriptor[ViewDescriptorSize];
+			this->DescribeView(this->selectedViews[a], descriptor);
 
-				objectPoints.at<float>(offset + b, 0) = this->sampledObjectPrototype[b].x;
-				objectPoints.at<float>(offset + b, 1) = this->sampledObjectPrototype[b].y;
-				objectPoints.at<float>(offset + b, 2) = 0.0f;
+			tilt = std::max(tilt, std::max(std::abs(descriptor[3]), std::abs(descriptor[4])));
+		}
 
-				imagePoints.at<float>(offset + b, 0) = this->sampledCorners[a][b].x;
-				imagePoints.at<float>(offset + b, 1) = this->sampledCorners[a][b].y;
+		for(int row = 0; row < 3; row++)
+		{
+			for(int column = 0; column < 3; column++)
+			{
+				if(cells[row][column] == 0)
+					std::cout << "no corners in the " << rows[row] << " " << columns[column] << " of the image, add views with the board there" << std::endl;
 			}
+		}
+
+		if(tilt < 0.1f)
+			std::cout << "all views face the camera, add views with a tilted board" << std::endl;
+	}
+
+	void ChessboardCameraCalibrator::CalculateCalibration(void)
+	{
+		if(this->sampledCorners.empty())
+			return;
+
+		this->ReportNewViews();
+		this->SelectViews();
+
+		int viewCount = this->selectedViews.size();
+		int pointCount = this->sampledObjectPrototype.size();
 
-			pointCounts.at<int>(a, 0) = this->sampledObjectPrototype.size();
+		std::vector<std::vector<cv::Point3f> > objectPoints(viewCount, this->sampledObjectPrototype);
+		std::vector<std::vector<cv::Point2f> > imagePoints;
+
+		std::vector<cv::Mat> rotations;
+		std::vector<cv::Mat> translations;
+
+		for(int a = 0; a < viewCount; a++)
+		{
+			imagePoints.push_back(this->sampledCorners[this->selectedViews[a]]);
 		}
 		
 		try
 		{
-			double error = cvCalibrateCamera2(
-				&(CvMat) objectPoints, 
-				&(CvMat) imagePoints,
-				&(CvMat) pointCounts, 
+			double error = cv::calibrateCamera(
+				objectPoints, 
+				imagePoints,
 				this->imageSize, 
-				&(CvMat) this->intrinsicParameters, 
-				&(CvMat) this->distortionParameters,
-				&(CvMat) rotations,
-				&(CvMat) translations
+				this->intrinsicParameters, 
+				this->distortionParameters,
+				rotations,
+				translations,
+				this->calibrated ? cv::CALIB_USE_INTRINSIC_GUESS : 0
 			);
+
+			this->calibrated = true;
+			this->calibratedSampleCount = this->GetSampledImageCount();
+
+			this->viewErrors.assign(this->GetSampledImageCount(), -1.0);
+
+			std::vector<cv::Point2f> projected;
+
+			for(int a = 0; a < viewCount; a++)
+			{
+				const std::vector<cv::Point2f>& corners = this->sampledCorners[this->selectedViews[a]];
+
+				cv::projectPoints(this->sampledObjectPrototype, rotations[a], translations[a], this->intrinsicParameters, this->distortionParameters, projected);
+
+				double sum = 0;
+
+				for(int b = 0; b < pointCount; b++)
+				{
+					sum += (projected[b].x - corners[b].x) * (projected[b].x - corners[b].x) + (projected[b].y - corners[b].y) * (projected[b].y - corners[b].y);
+				}
+
+				this->viewErrors[this->selectedViews[a]] = std::sqrt(sum / pointCount);
+			}
 			
 			std::cout << "[" << intrinsicParameters.at<double>(0, 0) << ", " << intrinsicParameters.at<double>(0, 1) << ", " << intrinsicParameters.at<double>(0, 2) << "]" << std::endl;
 			std::cout << "[" << intrinsicParameters.at<double>(1, 0) << ", " << intrinsicParameters.at<double>(1, 1) << ", " << intrinsicParameters.at<double>(1, 2) << "]" << std::endl;
 			std::cout << "[" << intrinsicParameters.at<double>(2, 0) << ", " << intrinsicParameters.at<double>(2, 1) << ", " << intrinsicParameters.at<double>(2, 2) << "]" << std::endl;
 			std::cout << std::endl;
-			std::cout << "[" << distortionParameters.at<double>(0, 0) << ", " << distortionParameters.at<double>(0, 1) << ", " << distortionParameters.at<double>(0, 2) << ", " << distortionParameters.at<double>(0, 3) << ", " << distortionParameters.at<double>(0, 4) << "]" << std::endl;
+			std::cout << "[" << distortionParameters.at<double>(0) << ", " << distortionParameters.at<double>(1) << ", " << distortionParameters.at<double>(2) << ", " << distortionParameters.at<double>(3) << ", " << distortionParameters.at<double>(4) << "]" << std::endl;
 			
-			std::cout << error << std::endl;			
-
-			CvFileStorage* storage = cvOpenFileStorage((this->outputFolder + "/camera.xml").c_str(), 0, CV_STORAGE_WRITE);
+			std::cout << error << " using " << viewCount << " of " << this->GetSampledImageCount() << " views" << std::endl;
 
-			cvWrite(storage, "intrinsic", &(CvMat) this->intrinsicParameters);
-			cvWrite(storage, "distortion", &(CvMat) this->distortionParameters);
+			this->ReportViewErrors();
+			this->ReportCoverage();
 
-			cvReleaseFileStorage(&storage);
+			this->SaveCalibration(error);
 		}
 		catch(cv::Exception& e)
 		{
 			std::cout << e.what() << std::endl;
 		}
 	}
+
+	void ChessboardCameraCalibrator::SaveCalibration(double error)
+	{
+		char timestamp[32];
+		time_t now = time(NULL);
+		strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+		cv::FileStorage storage(this->outputFolder + "/camera.xml", cv::FileStorage::WRITE);
+
+		if(!storage.isOpened())
+		{
+			std::cout << "can't write " << this->outputFolder << "/camera.xml" << std::endl;
+			return;
+		}
+
+		storage << "calibration_time" << std::string(timestamp);
+		storage << "image_width" << this->imageSize.width;
+		storage << "image_height" << this->imageSize.height;
+		storage << "pattern_width" << this->patternSize.width;
+		storage << "pattern_height" << this->patternSize.height;
+
+		// the translations of poses estimated with this calibration are in this unit
+		storage << "square_size" << this->squareSize;
+		storage << "rms" << error;
+
+		storage << "intrinsic" << this->intrinsicParameters;
+		storage << "distortion" << this->distortionParameters;
+	}
 }
@@ -10,40 +10,115 @@
 #pragma once
 
 #include <iostream>
+#include <string>
+#include <vector>
 
-#include <opencv\cv.h>
-#include <opencv\highgui.h>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+#include "ThreadPool.h"
 
 namespace TUMAugmentedRealityExercise
 {
 	class ChessboardCameraCalibrator
 	{
 	private:
+		// inner corners per row and column, and the side length of a square in the unit of the calibration
 		cv::Size patternSize;
+		float squareSize;
+
+		// the size of the first sample, samples of the same aspect ratio are scaled to it
 		cv::Size imageSize;
 
 		const std::string outputFolder;
 
+		bool saveImages;
+
 		cv::Mat intrinsicParameters;
 		cv::Mat distortionParameters;
 
 		std::vector<cv::Point3f> sampledObjectPrototype;
 		std::vector<std::vector<cv::Point2f> > sampledCorners;
 
+		// the intrinsics of the last calibration are the initial guess of the next one
+		bool calibrated;
+		int calibratedSampleCount;
+
+		int maxViews;
+		std::vector<int> selectedViews;
+		std::vector<double> viewErrors;
+
+		void DescribeView(int view, float* descriptor) const;
+		void SelectViews(void);
+
+		void ReportNewViews(void);
+		void ReportViewErrors(void);
+		void ReportCoverage(void);
+
 		std::string GetImageOutputFolder(void);
 		std::string GetMarkedImageOutputFolder(void);
+		std::string GetCornerCacheFile(void);
+
+		void SaveImage(const cv::Mat& image, bool marked, int number);
+
+		bool IsCompatibleSize(const cv::Size& size) const;
+		bool AddCorners(const cv::Size& size, const std::vector<cv::Point2f>& corners);
 
-		void SaveImage(const cv::Mat& image, bool marked);
+		void SaveCalibration(double error);
 	public:
-		ChessboardCameraCalibrator(const std::string& outputFolder);
+		ChessboardCameraCalibrator(const std::string& outputFolder, const cv::Size& patternSize = cv::Size(8, 6), float squareSize = 1.0f);
 		~ChessboardCameraCalibrator(void);
 
 		int GetSampledImageCount(void);
 
+		const cv::Size& GetPatternSize(void) const;
+
+		/**
+		 * finds the inner corners of the chessboard in a grey image. with the quick check frames
+		 * without a board are rejected by the fast check of OpenCV, and the board is searched in
+		 * a half resolution copy first and only refined in the full image. boards which aren't
+		 * found at half resolution are searched in the full image. only reads the members which
+		 * don't change while sampling, so it can run on several threads at once.
+		 */
+		bool FindCorners(const cv::Mat& grey, std::vector<cv::Point2f>& corners, bool quickCheck = false) const;
+
+		/**
+		 * adds corners found by FindCorners. the corners of an image with another size but the same
+		 * aspect ratio as the earlier samples are scaled, other sizes are rejected.
+		 */
+		bool AddSample(const cv::Mat& image, const std::vector<cv::Point2f>& corners);
+
+		// writes every sampled image and a copy with the detected corners to the output folder, off by default
+		void SetSaveImages(bool saveImages);
+
 		bool SampleChessboardImage(const cv::Mat& image);
 
-		void SampleChessboardImages(const std::vector<std::string> files);
+		/**
+		 * detects the corners of the images on the pool and the calling thread. the corners of
+		 * each image are cached in the output folder by a hash of the file content, so a file
+		 * which was seen before is neither decoded nor searched again. returns the number of
+		 * sampled images.
+		 */
+		int SampleChessboardImages(const std::vector<std::string>& files, ThreadPool* pool = NULL);
+
+		// samples all images of the directory in the order of their names
+		int SampleChessboardDirectory(const std::string& directory, ThreadPool* pool = NULL);
+
+		// at most this many views are calibrated at once, chosen to cover many board poses. 0 uses all views
+		void SetMaxViews(int maxViews);
+
+		// the views used by the last calibration
+		const std::vector<int>& GetSelectedViews(void) const;
+
+		// rms reprojection error of every sampled view in the last calibration, -1 if it wasn't used
+		const std::vector<double>& GetViewErrors(void) const;
 
+		/**
+		 * calibrates from a diverse subset of the sampled views, starting from the previous
+		 * result if there is one. prints the error of every view and hints which views to add.
+		 * writes camera.xml to the output folder, along with the image size, the rms error and
+		 * the time of the calibration.
+		 */
 		void CalculateCalibration(void);
 	};
 }
@@ -0,0 +1,127 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "ChessboardSampler.h"
+#include "TraceRecorder.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	ChessboardSampler::ChessboardSampler(const ChessboardCameraCalibrator& calibrator) :
+		calibrator(calibrator),
+		found(false),
+		busy(false),
+		hasResult(false),
+		running(true)
+	{
+		this->thread = std::thread(&ChessboardSampler::Search, this);
+	}
+
+	ChessboardSampler::~ChessboardSampler(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->running = false;
+		}
+
+		this->imageAvailable.notify_all();
+		this->thread.join();
+	}
+
+	bool ChessboardSampler::IsBusy(void)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		return this->busy;
+	}
+
+	bool ChessboardSampler::Submit(const cv::Mat& frame)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+
+			if(this->busy)
+				return false;
+
+			// the last image may still be used by whoever polled it, so the new one gets its own buffer
+			this->image.release();
+
+			if(frame.channels() == 3)
+			{
+				cv::cvtColor(frame, this->image, cv::COLOR_BGR2GRAY);
+			}
+			else
+			{
+				frame.copyTo(this->image);
+			}
+
+			this->busy = true;
+			this->hasResult = false;
+		}
+
+		this->imageAvailable.notify_one();
+
+		return true;
+	}
+
+	bool ChessboardSampler::Poll(cv::Mat& grey, std::vector<cv::Point2f>& corners, bool& found)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		if(!this->hasResult)
+			return false;
+
+		grey = this->image;
+		corners = this->corners;
+		found = this->found;
+
+		this->hasResult = false;
+		this->busy = false;
+
+		return true;
+	}
+
+	void ChessboardSampler::Search(void)
+	{
+		TraceRecorder::SetThreadName("chessboard");
+
+		std::vector<cv::Point2f> corners;
+
+		for(;;)
+		{
+			cv::Mat grey;
+
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+
+				this->imageAvailable.wait(lock, [this]() { return (this->busy && !this->hasResult) || !this->running; });
+
+				if(!this->running)
+					return;
+
+				grey = this->image;
+			}
+
+			bool found;
+
+			{
+				TUMAR_TRACE_SCOPE("find chessboard");
+
+				found = this->calibrator.FindCorners(grey, corners, true);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+
+				this->corners.swap(corners);
+				this->found = found;
+				this->hasResult = true;
+			}
+		}
+	}
+}
@@ -0,0 +1,64 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <opencv2/imgproc.hpp>
+
+#include "ChessboardCameraCalibrator.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * searches the chessboard corners of a frame on a background thread, so
+	 * the preview keeps running while a frame without a board is rejected.
+	 * only one frame is searched at a time, the result is picked up by the
+	 * thread which submitted it and added to the calibrator there.
+	 */
+	class ChessboardSampler
+	{
+	private:
+		const ChessboardCameraCalibrator& calibrator;
+
+		cv::Mat image;
+		std::vector<cv::Point2f> corners;
+		bool found;
+
+		bool busy;
+		bool hasResult;
+
+		std::mutex mutex;
+		std::condition_variable imageAvailable;
+		bool running;
+
+		std::thread thread;
+
+		void Search(void);
+	public:
+		ChessboardSampler(const ChessboardCameraCalibrator& calibrator);
+		~ChessboardSampler(void);
+
+		// true from submitting a frame until its result is picked up
+		bool IsBusy(void);
+
+		// copies the frame, returns false if the last frame is still searched
+		bool Submit(const cv::Mat& frame);
+
+		/**
+		 * returns true once per submitted frame when its search is done and hands
+		 * out the grey image which was searched and its corners.
+		 */
+		bool Poll(cv::Mat& grey, std::vector<cv::Point2f>& corners, bool& found);
+	};
+}
@@ -11,5 +11,8 @@
 
 namespace TUMAugmentedRealityExercise
 {
-	DebugImage* DebugImage::instance = NULL;
+	void DebugImage::CaptureMarkerCode(const cv::Mat& code)
+	{
+		code.copyTo(this->Buffer);
+	}
 }
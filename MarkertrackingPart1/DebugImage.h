@@ -9,19 +9,21 @@
 
 #pragma once
 
-#include <opencv\cv.h>
+#include <opencv2/imgproc.hpp>
+
+#include "DetectorContext.h"
 
 namespace TUMAugmentedRealityExercise
 {
-	class DebugImage
+	class DebugImage : public DetectorDebugSink
 	{
 	public:
-		static DebugImage* instance;
-		
 		cv::Mat Buffer;
 
-		DebugImage(void) { instance = this; };
-		~DebugImage(void) { instance = NULL; };
+		DebugImage(void) {};
+		~DebugImage(void) {};
+
+		void CaptureMarkerCode(const cv::Mat& code);
 	};
 }
 
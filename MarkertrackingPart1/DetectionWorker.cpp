@@ -0,0 +1,252 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "DetectionWorker.h"
+
+#include <chrono>
+#include <sstream>
+#include <iostream>
+
+#include "TraceRecorder.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	void DetectionResult::swap(DetectionResult& other)
+	{
+		std::swap(this->CameraId, other.CameraId);
+		std::swap(this->FrameNumber, other.FrameNumber);
+		std::swap(this->Timestamp, other.Timestamp);
+
+		this->Markers.swap(other.Markers);
+	}
+
+	DetectionResultStream::DetectionResultStream(int capacity) :
+		capacity(std::max(capacity, 1)),
+		droppedResults(0)
+	{
+	}
+
+	DetectionResultStream::~DetectionResultStream(void)
+	{
+	}
+
+	void DetectionResultStream::Push(DetectionResult& result)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+
+			if(this->results.size() == this->capacity)
+			{
+				this->results.pop_front();
+				this->droppedResults++;
+			}
+
+			this->results.push_back(DetectionResult());
+			this->results.back().swap(result);
+		}
+
+		this->resultAvailable.notify_one();
+	}
+
+	bool DetectionResultStream::Poll(DetectionResult& result)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		if(this->results.empty())
+			return false;
+
+		result.swap(this->results.front());
+		this->results.pop_front();
+
+		return true;
+	}
+
+	bool DetectionResultStream::Wait(DetectionResult& result, int timeoutMs)
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+
+		if(!this->resultAvailable.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return !this->results.empty(); }))
+			return false;
+
+		result.swap(this->results.front());
+		this->results.pop_front();
+
+		return true;
+	}
+
+	int DetectionResultStream::GetDroppedResults(void)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		return this->droppedResults;
+	}
+
+	DetectionWorker::DetectionWorker(int cameraId, VideoSource* source, DetectionResultStream* stream, const DetectorContext& context, const UndistortionMap* calibration, MemoryStoragePool* pool) :
+		cameraId(cameraId),
+		source(source),
+		stream(stream),
+		pool(pool),
+		storage(pool->Lease()),
+		detector(&markers, storage, context),
+		frameNumber(0),
+		running(false)
+	{
+		this->chain.add(&this->grey);
+		this->chain.add(&this->threshold);
+		this->chain.add(&this->detector);
+
+		// the detector undistorts with the worker's copy, which is scaled to the resolution of this camera
+		DetectorContext own = context;
+		own.Undistortion = NULL;
+
+		if(calibration != NULL && calibration->IsCalibrated())
+		{
+			this->undistortion = *calibration;
+
+			own.FocalLength = this->undistortion.GetFocalLength();
+			own.PrincipalPoint = this->undistortion.GetPrincipalPoint();
+			own.Undistortion = &this->undistortion;
+		}
+
+		this->detector.SetContext(own);
+	}
+
+	DetectionWorker::~DetectionWorker(void)
+	{
+		this->Stop();
+
+		this->pool->Release(this->storage);
+
+		delete this->source;
+	}
+
+	void DetectionWorker::Start(void)
+	{
+		if(this->running)
+			return;
+
+		// the thread of a worker whose source ended is still joinable
+		if(this->thread.joinable())
+			this->thread.join();
+
+		this->running = true;
+		this->thread = std::thread(&DetectionWorker::Run, this);
+	}
+
+	void DetectionWorker::Stop(void)
+	{
+		this->running = false;
+
+		if(this->thread.joinable())
+			this->thread.join();
+	}
+
+	bool DetectionWorker::IsRunning(void)
+	{
+		return this->running;
+	}
+
+	int DetectionWorker::GetCameraId(void)
+	{
+		return this->cameraId;
+	}
+
+	int DetectionWorker::GetProcessedFrames(void)
+	{
+		return this->frameNumber;
+	}
+
+	void DetectionWorker::Run(void)
+	{
+		std::ostringstream name;
+		name << "camera " << this->cameraId;
+		TraceRecorder::SetThreadName(name.str());
+
+		// an exception must not leave the thread, it would terminate the whole application
+		try
+		{
+			this->Detect();
+		}
+		catch(cv::Exception& e)
+		{
+			std::cerr << "camera " << this->cameraId << ": " << e.what() << std::endl;
+		}
+		catch(std::exception& e)
+		{
+			std::cerr << "camera " << this->cameraId << ": " << e.what() << std::endl;
+		}
+
+		this->running = false;
+	}
+
+	void DetectionWorker::Detect(void)
+	{
+		double ticksPerMs = cv::getTickFrequency() / 1000;
+
+		// an async source knows when the frame was actually grabbed, the worker only sees when it was dequeued
+		AsyncVideoSource* async = dynamic_cast<AsyncVideoSource*>(this->source);
+
+		while(this->running)
+		{
+			TUMAR_TRACE_FRAME(this->frameNumber);
+
+			MemoryFrameScope scope(this->storage);
+
+			{
+				TUMAR_TRACE_SCOPE("grab");
+
+				this->source->GetNextImage(this->frame);
+			}
+
+			// the camera is gone or the file ended
+			if(this->frame.empty())
+				break;
+
+			this->UpdateCalibration(this->frame.size());
+
+			DetectionResult result;
+			result.CameraId = this->cameraId;
+			result.FrameNumber = this->frameNumber++;
+			result.Timestamp = async != NULL ? async->GetTimestamp() : cv::getTickCount() / ticksPerMs;
+
+			{
+				TUMAR_TRACE_SCOPE("process");
+
+				this->chain.process(this->frame, this->processed);
+			}
+
+			// hand the markers over to the stream, the container is empty afterwards
+			result.Markers.swap(this->markers);
+
+			// the stripe buffers don't survive the frame scope
+			for(MarkerContainer::iterator it = result.Markers.begin(); it != result.Markers.end(); ++it)
+			{
+				for(int a = 0; a < it->Stripes.size(); a++)
+				{
+					it->Stripes[a].Buffer = cv::Mat();
+				}
+			}
+
+			this->stream->Push(result);
+		}
+	}
+
+	void DetectionWorker::UpdateCalibration(const cv::Size& resolution)
+	{
+		// the camera may run at another resolution than the one it was calibrated at
+		if(!this->undistortion.SetResolution(resolution))
+			return;
+
+		DetectorContext context = this->detector.GetContext();
+		context.FocalLength = this->undistortion.GetFocalLength();
+		context.PrincipalPoint = this->undistortion.GetPrincipalPoint();
+
+		this->detector.SetContext(context);
+	}
+}
@@ -0,0 +1,127 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include <opencv2/imgproc.hpp>
+
+#include "ImageProcessor.h"
+#include "VideoSource.h"
+#include "MemoryStorage.h"
+#include "UndistortionMap.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	class DetectionResult
+	{
+	public:
+		int CameraId;
+		int FrameNumber;
+
+		// grab time in ms, on the cv::getTickCount() clock
+		double Timestamp;
+
+		MarkerContainer Markers;
+
+		DetectionResult(void) : CameraId(0), FrameNumber(0), Timestamp(0) {};
+
+		void swap(DetectionResult& other);
+	};
+
+	/**
+	 * bounded queue merging the results of several detection workers in the
+	 * order they were produced. a full stream drops its oldest result.
+	 */
+	class DetectionResultStream
+	{
+	private:
+		std::deque<DetectionResult> results;
+		int capacity;
+		int droppedResults;
+
+		std::mutex mutex;
+		std::condition_variable resultAvailable;
+	public:
+		DetectionResultStream(int capacity = 64);
+		~DetectionResultStream(void);
+
+		// takes the content of the result, it is left empty
+		void Push(DetectionResult& result);
+
+		// returns false if there is no result
+		bool Poll(DetectionResult& result);
+
+		// returns false if no result arrived within the timeout
+		bool Wait(DetectionResult& result, int timeoutMs);
+
+		int GetDroppedResults(void);
+	};
+
+	/**
+	 * grabs and processes the frames of one video source on a dedicated
+	 * thread. each worker has its own detector chain, buffers, marker
+	 * container and copy of the calibration, so workers don't share any
+	 * mutable state except the stream. the calibration is scaled to the
+	 * resolution of the worker's frames. the worker stops on its own when the
+	 * source returns an empty frame.
+	 */
+	class DetectionWorker
+	{
+	private:
+		int cameraId;
+		VideoSource* source;
+		DetectionResultStream* stream;
+
+		MemoryStoragePool* pool;
+		MemoryStorage* storage;
+
+		GreyscaleImageProcessor grey;
+		AdaptiveThresholdImageProcessor threshold;
+		MarkerDetectionImageProcessor detector;
+		ImageProcessorChain chain;
+
+		MarkerContainer markers;
+
+		UndistortionMap undistortion;
+
+		cv::Mat frame;
+		cv::Mat processed;
+
+		std::atomic<int> frameNumber;
+		std::atomic<bool> running;
+		std::thread thread;
+
+		void Run(void);
+		void Detect(void);
+
+		void UpdateCalibration(const cv::Size& resolution);
+	public:
+		/**
+		 * the source is owned by the worker, a storage is leased from the pool while the worker exists.
+		 * the calibration is copied, it may be NULL.
+		 */
+		DetectionWorker(int cameraId, VideoSource* source, DetectionResultStream* stream, const DetectorContext& context, const UndistortionMap* calibration, MemoryStoragePool* pool);
+		~DetectionWorker(void);
+
+		void Start(void);
+		void Stop(void);
+
+		// false once the worker was stopped or its source ended or failed
+		bool IsRunning(void);
+
+		int GetCameraId(void);
+		int GetProcessedFrames(void);
+	};
+}
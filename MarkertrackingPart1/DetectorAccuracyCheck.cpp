@@ -0,0 +1,168 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "DetectorAccuracyCheck.h"
+#include "Pipeline.h"
+#include "MemoryStorage.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace TUMAugmentedRealityExercise
+{
+	static const int FrameWidth = 640;
+	static const int FrameHeight = 480;
+	static const float FocalLength = 500;
+	static const float MarkerSize = 5;
+
+	// a detected marker further from the truth than this is a different marker
+	static const double MatchDistance = 3.0;
+
+	// the corners of a marker may start at any of its corners, the best of the 4 orders counts
+	static double GetCornerError(const Marker& detected, const SyntheticMarker& truth)
+	{
+		if(detected.SubPixelCorners.size() != 4)
+			return std::numeric_limits<double>::max();
+
+		double best = std::numeric_limits<double>::max();
+
+		for(int rotation = 0; rotation < 4; rotation++)
+		{
+			double sum = 0;
+
+			for(int a = 0; a < 4; a++)
+			{
+				cv::Point2f difference = detected.SubPixelCorners[(a + rotation) % 4] - truth.Corners[a];
+
+				sum += difference.x * difference.x + difference.y * difference.y;
+			}
+
+			best = std::min(best, std::sqrt(sum / 4));
+		}
+
+		return best;
+	}
+
+	void AccuracyReport::Print(std::ostream& out) const
+	{
+		out << this->Frames << " frames, " << this->Detected << " of " << this->Markers << " markers detected (" << 100.0 * this->Detected / std::max(this->Markers, 1) << "%), ";
+		out << this->FalsePositives << " false positives" << std::endl;
+		out << "corner error " << this->CornerError << "px, translation error " << 100 * this->TranslationError << "%, normal error " << this->NormalError << " degrees" << std::endl;
+		out << (this->Passed ? "passed" : "FAILED") << std::endl;
+	}
+
+	DetectorAccuracyCheck::DetectorAccuracyCheck(const AccuracyThresholds& thresholds, const SyntheticFrameSettings& settings) :
+		thresholds(thresholds),
+		settings(settings)
+	{
+	}
+
+	DetectorAccuracyCheck::~DetectorAccuracyCheck(void)
+	{
+	}
+
+	AccuracyReport DetectorAccuracyCheck::Run(int frames, unsigned long long seed)
+	{
+		SyntheticMarkerRenderer renderer(cv::Size(FrameWidth, FrameHeight), FocalLength, MarkerSize, seed, this->settings);
+
+		DetectorContext context;
+		context.MarkerSize = MarkerSize;
+		context.FocalLength = FocalLength;
+		context.PrincipalPoint = renderer.GetPrincipalPoint();
+
+		MarkerContainer markers;
+		MemoryStorage storage;
+
+		GreyscaleImageProcessor grey;
+		AdaptiveThresholdImageProcessor adaptive;
+		MarkerDetectionImageProcessor marker(&markers, &storage, context);
+
+		Pipeline<GreyscaleImageProcessor, AdaptiveThresholdImageProcessor, MarkerDetectionImageProcessor> pipeline(grey, adaptive, marker);
+
+		std::vector<SyntheticMarker> truth;
+		std::vector<char> matched;
+
+		cv::Mat frame;
+		cv::Mat output;
+
+		AccuracyReport report;
+
+		for(int a = 0; a < frames; a++)
+		{
+			renderer.Render(frame, truth, 1 + a % 3);
+			pipeline.process(frame, output);
+
+			matched.assign(markers.size(), false);
+
+			for(int b = 0; b < truth.size(); b++)
+			{
+				int closest = -1;
+				double error = MatchDistance;
+
+				for(int c = 0; c < markers.size(); c++)
+				{
+					double e = GetCornerError(markers[c], truth[b]);
+
+					if(markers[c].MarkerId == truth[b].MarkerId && e < error)
+					{
+						closest = c;
+						error = e;
+					}
+				}
+
+				report.Markers++;
+
+				if(closest < 0)
+					continue;
+
+				matched[closest] = true;
+				report.Detected++;
+
+				// the translation doesn't depend on which corner the detector starts at, neither does the normal
+				const float* pose = markers[closest].Pose;
+				const float* rotation = truth[b].Rotation;
+				const float* translation = truth[b].Translation;
+
+				double dx = pose[3] - translation[0];
+				double dy = pose[7] - translation[1];
+				double dz = pose[11] - translation[2];
+				double distance = std::sqrt(translation[0] * translation[0] + translation[1] * translation[1] + translation[2] * translation[2]);
+
+				double cosine = pose[2] * rotation[2] + pose[6] * rotation[5] + pose[10] * rotation[8];
+
+				report.CornerError += error;
+				report.TranslationError += std::sqrt(dx * dx + dy * dy + dz * dz) / distance;
+				report.NormalError += std::acos(std::min(std::max(cosine, -1.0), 1.0)) * 180.0 / 3.14159265358979323846;
+			}
+
+			report.FalsePositives += (int) std::count(matched.begin(), matched.end(), false);
+			report.Frames++;
+
+			markers.clear();
+			storage.Clear();
+		}
+
+		if(report.Detected > 0)
+		{
+			report.CornerError /= report.Detected;
+			report.TranslationError /= report.Detected;
+			report.NormalError /= report.Detected;
+		}
+
+		report.Passed =
+			report.Detected >= this->thresholds.MinDetectionRate * report.Markers &&
+			report.FalsePositives <= this->thresholds.MaxFalsePositiveRate * report.Frames &&
+			report.CornerError <= this->thresholds.MaxCornerError &&
+			report.TranslationError <= this->thresholds.MaxTranslationError &&
+			report.NormalError <= this->thresholds.MaxNormalError;
+
+		return report;
+	}
+}
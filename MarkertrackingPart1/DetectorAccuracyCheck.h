@@ -0,0 +1,85 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <ostream>
+
+#include "SyntheticMarkerRenderer.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * limits a detector has to stay within on the synthetic frames. the
+	 * defaults are the worst of 20 seeds with 300 frames each plus a margin
+	 * of about four standard deviations over the seeds.
+	 */
+	struct AccuracyThresholds
+	{
+		double MinDetectionRate;
+
+		// false positives per frame
+		double MaxFalsePositiveRate;
+
+		// mean rms distance of the sub pixel corners to the true ones in pixels
+		double MaxCornerError;
+
+		// mean distance of the estimated to the true marker center, relative to its distance to the camera
+		double MaxTranslationError;
+
+		// mean angle between the estimated and the true marker normal in degrees
+		double MaxNormalError;
+
+		AccuracyThresholds(void) :
+			MinDetectionRate(0.8),
+			MaxFalsePositiveRate(0.25),
+			MaxCornerError(1.1),
+			MaxTranslationError(0.015),
+			MaxNormalError(3)
+		{
+		};
+	};
+
+	struct AccuracyReport
+	{
+		int Frames;
+		int Markers;
+		int Detected;
+		int FalsePositives;
+
+		// means over the detected markers
+		double CornerError;
+		double TranslationError;
+		double NormalError;
+
+		bool Passed;
+
+		AccuracyReport(void) : Frames(0), Markers(0), Detected(0), FalsePositives(0), CornerError(0), TranslationError(0), NormalError(0), Passed(false) {};
+
+		void Print(std::ostream& out) const;
+	};
+
+	/**
+	 * runs the marker detection and pose estimation on synthetic frames and
+	 * compares the results to the ground truth. the frames only depend on the
+	 * seed, so a changed result means the detector changed.
+	 */
+	class DetectorAccuracyCheck
+	{
+	private:
+		AccuracyThresholds thresholds;
+		SyntheticFrameSettings settings;
+	public:
+		DetectorAccuracyCheck(const AccuracyThresholds& thresholds = AccuracyThresholds(), const SyntheticFrameSettings& settings = SyntheticFrameSettings());
+		~DetectorAccuracyCheck(void);
+
+		// renders 1 to 3 markers per frame
+		AccuracyReport Run(int frames, unsigned long long seed);
+	};
+}
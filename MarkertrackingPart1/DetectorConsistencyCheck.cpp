@@ -0,0 +1,315 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "DetectorConsistencyCheck.h"
+#include "QuadFinder.h"
+#include "ImageProcessor.h"
+
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+namespace TUMAugmentedRealityExercise
+{
+	static const int MaxBands = 16;
+
+	// the corners of all quads in a comparable order, the search order differs between bands
+	static std::vector<std::vector<int> > SortQuads(const QuadContainer& quads)
+	{
+		std::vector<std::vector<int> > sorted(quads.size());
+
+		for(int a = 0; a < quads.size(); a++)
+		{
+			for(int b = 0; b < 4; b++)
+			{
+				sorted[a].push_back(quads[a].Corners[b].x);
+				sorted[a].push_back(quads[a].Corners[b].y);
+			}
+		}
+
+		std::sort(sorted.begin(), sorted.end());
+
+		return sorted;
+	}
+
+	// the number of pixels which differ, the first one is returned in at
+	static int CountDifferences(const cv::Mat& found, const cv::Mat& expected, cv::Point& at)
+	{
+		if(found.size() != expected.size() || found.type() != expected.type())
+		{
+			at = cv::Point(-1, -1);
+			return std::max(expected.rows * expected.cols, 1);
+		}
+
+		int differences = 0;
+
+		for(int y = 0; y < expected.rows; y++)
+		{
+			const unsigned char* a = found.ptr<unsigned char>(y);
+			const unsigned char* b = expected.ptr<unsigned char>(y);
+
+			for(int x = 0; x < expected.cols; x++)
+			{
+				if(a[x] == b[x])
+					continue;
+
+				if(differences++ == 0)
+					at = cv::Point(x, y);
+			}
+		}
+
+		return differences;
+	}
+
+	static void RecordDifferences(ConsistencyResult& result, int image, const cv::Mat& input, const cv::Mat& found, const cv::Mat& expected)
+	{
+		cv::Point at;
+		int differences = CountDifferences(found, expected, at);
+
+		result.Cases++;
+
+		if(differences == 0 || result.Failures++ > 0)
+			return;
+
+		std::ostringstream failure;
+		failure << "image " << image << " of " << input.cols << "x" << input.rows << " with " << input.channels() << " channels: " << differences << " pixels differ, first at " << at.x << "," << at.y;
+
+		result.FirstFailure = failure.str();
+	}
+
+	void ConsistencyReport::Print(std::ostream& out) const
+	{
+		for(int a = 0; a < this->Results.size(); a++)
+		{
+			const ConsistencyResult& result = this->Results[a];
+
+			out << result.Name << ": " << result.Failures << " of " << result.Cases << " cases differ";
+
+			if(result.Failures > 0)
+				out << ", first " << result.FirstFailure;
+
+			out << std::endl;
+		}
+
+		out << (this->Passed ? "passed" : "FAILED") << std::endl;
+	}
+
+	DetectorConsistencyCheck::DetectorConsistencyCheck(unsigned long long seed) :
+		rng(seed)
+	{
+	}
+
+	DetectorConsistencyCheck::~DetectorConsistencyCheck(void)
+	{
+	}
+
+	void DetectorConsistencyCheck::RenderBinary(cv::Mat& binary)
+	{
+		binary.create(this->rng.uniform(150, 550), this->rng.uniform(200, 700), CV_8UC1);
+		binary.setTo(cv::Scalar(this->rng.uniform(0, 2) * 255));
+
+		int shapes = this->rng.uniform(1, 26);
+
+		for(int a = 0; a < shapes; a++)
+		{
+			double centerX = this->rng.uniform(0, binary.cols);
+			double centerY = this->rng.uniform(0, binary.rows);
+			double radius = this->rng.uniform(10, 130);
+
+			// edges along a row meet the seams between the bands most often
+			double angle = this->rng.uniform(0, 2) == 0 ? 0 : this->rng.uniform(0.0, 3.14159265358979323846);
+
+			unsigned char value = (unsigned char) (this->rng.uniform(0, 2) * 255);
+			bool ring = this->rng.uniform(0, 3) == 0;
+
+			double c = std::cos(angle), s = std::sin(angle);
+			int reach = (int) (radius * 1.5);
+
+			for(int y = std::max((int) centerY - reach, 0); y < std::min((int) centerY + reach, binary.rows); y++)
+			{
+				unsigned char* row = binary.ptr<unsigned char>(y);
+
+				for(int x = std::max((int) centerX - reach, 0); x < std::min((int) centerX + reach, binary.cols); x++)
+				{
+					double dx = x - centerX, dy = y - centerY;
+					double distance = std::max(std::abs(dx * c + dy * s), std::abs(dy * c - dx * s));
+
+					if(distance < radius && (!ring || distance > 0.6 * radius))
+						row[x] = value;
+				}
+			}
+		}
+
+		// noise cuts contours into many small pieces at the seams
+		int noise = this->rng.uniform(0, 4) * 1500;
+
+		for(int a = 0; a < noise; a++)
+		{
+			binary.at<unsigned char>(this->rng.uniform(0, binary.rows), this->rng.uniform(0, binary.cols)) ^= 255;
+		}
+	}
+
+	void DetectorConsistencyCheck::RenderColor(cv::Mat& color)
+	{
+		// sizes below and around the block size of the adaptive threshold have the most border cases
+		int rows = this->rng.uniform(0, 4) == 0 ? this->rng.uniform(1, 80) : this->rng.uniform(80, 500);
+		int cols = this->rng.uniform(0, 4) == 0 ? this->rng.uniform(1, 80) : this->rng.uniform(80, 650);
+		int channels = this->rng.uniform(0, 4) == 0 ? 1 : 3;
+
+		// a view into a larger image has a stride different from its width
+		int left = this->rng.uniform(0, 2) * this->rng.uniform(1, 9);
+		int top = this->rng.uniform(0, 2) * this->rng.uniform(1, 9);
+
+		cv::Mat image(rows + top + this->rng.uniform(0, 9), cols + left + this->rng.uniform(0, 9), CV_MAKETYPE(CV_8U, channels));
+
+		double gradientX = this->rng.uniform(-2.0, 2.0), gradientY = this->rng.uniform(-2.0, 2.0);
+		int base = this->rng.uniform(0, 256);
+
+		for(int y = 0; y < image.rows; y++)
+		{
+			unsigned char* pixel = image.ptr<unsigned char>(y);
+
+			for(int x = 0; x < image.cols * channels; x++)
+			{
+				pixel[x] = cv::saturate_cast<unsigned char>(base + gradientX * (x / channels) + gradientY * y + this->rng.uniform(-20, 21));
+			}
+		}
+
+		int blocks = this->rng.uniform(0, 16);
+
+		for(int a = 0; a < blocks; a++)
+		{
+			int x = this->rng.uniform(0, image.cols), y = this->rng.uniform(0, image.rows);
+			cv::Rect block(x, y, std::min(this->rng.uniform(1, 120), image.cols - x), std::min(this->rng.uniform(1, 120), image.rows - y));
+
+			image(block).setTo(cv::Scalar(this->rng.uniform(0, 256), this->rng.uniform(0, 256), this->rng.uniform(0, 256)));
+		}
+
+		color = image(cv::Rect(left, top, cols, rows));
+	}
+
+	ConsistencyResult DetectorConsistencyCheck::CheckContourBands(int images)
+	{
+		ConsistencyResult result("contour bands");
+
+		QuadFinder serial;
+		std::vector<QuadFinder*> banded;
+
+		for(int bands = 2; bands <= MaxBands; bands++)
+		{
+			banded.push_back(new QuadFinder());
+			banded.back()->SetBandCount(bands);
+		}
+
+		cv::Mat binary;
+
+		for(int a = 0; a < images; a++)
+		{
+			this->RenderBinary(binary);
+
+			std::vector<std::vector<int> > expected = SortQuads(serial.Find(binary));
+
+			for(int b = 0; b < banded.size(); b++)
+			{
+				std::vector<std::vector<int> > found = SortQuads(banded[b]->Find(binary));
+
+				result.Cases++;
+
+				if(found == expected)
+					continue;
+
+				if(result.Failures++ == 0)
+				{
+					std::ostringstream failure;
+					failure << "image " << a << " with " << banded[b]->GetBandCount() << " bands: " << found.size() << " instead of " << expected.size() << " quads";
+
+					result.FirstFailure = failure.str();
+				}
+			}
+		}
+
+		for(int a = 0; a < banded.size(); a++)
+		{
+			delete banded[a];
+		}
+
+		return result;
+	}
+
+	ConsistencyResult DetectorConsistencyCheck::CheckAdaptiveThreshold(int images)
+	{
+		ConsistencyResult result("adaptive threshold");
+
+		AdaptiveThresholdImageProcessor threshold;
+		cv::Mat color, grey, found, expected;
+
+		for(int a = 0; a < images; a++)
+		{
+			this->RenderColor(color);
+
+			threshold.ProcessColor(color, found);
+
+			if(color.channels() == 3)
+				cv::cvtColor(color, grey, cv::COLOR_BGR2GRAY);
+			else
+				grey = color;
+
+			cv::adaptiveThreshold(grey, expected, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY, AdaptiveThresholdImageProcessor::BlockSize, AdaptiveThresholdImageProcessor::Offset);
+
+			RecordDifferences(result, a, color, found, expected);
+		}
+
+		return result;
+	}
+
+	ConsistencyResult DetectorConsistencyCheck::CheckThreshold(int images)
+	{
+		ConsistencyResult result("threshold");
+
+		ThresholdImageProcessor threshold;
+		cv::Mat color, grey, found, expected;
+
+		for(int a = 0; a < images; a++)
+		{
+			this->RenderColor(color);
+
+			// fractional thresholds are rounded down by both
+			threshold.threshold = this->rng.uniform(0, 2) == 0 ? this->rng.uniform(0, 256) : this->rng.uniform(0.0, 255.0);
+			threshold.ProcessColor(color, found);
+
+			if(color.channels() == 3)
+				cv::cvtColor(color, grey, cv::COLOR_BGR2GRAY);
+			else
+				grey = color;
+
+			cv::threshold(grey, expected, threshold.threshold, 255, cv::THRESH_BINARY);
+
+			RecordDifferences(result, a, color, found, expected);
+		}
+
+		return result;
+	}
+
+	ConsistencyReport DetectorConsistencyCheck::Run(int images)
+	{
+		ConsistencyReport report;
+		report.Results.push_back(this->CheckContourBands(images));
+		report.Results.push_back(this->CheckAdaptiveThreshold(images));
+		report.Results.push_back(this->CheckThreshold(images));
+
+		report.Passed = true;
+
+		for(int a = 0; a < report.Results.size(); a++)
+		{
+			report.Passed = report.Passed && report.Results[a].Failures == 0;
+		}
+
+		return report;
+	}
+}
@@ -0,0 +1,73 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace TUMAugmentedRealityExercise
+{
+	struct ConsistencyResult
+	{
+		std::string Name;
+
+		int Cases;
+		int Failures;
+
+		// the first case which differed
+		std::string FirstFailure;
+
+		ConsistencyResult(const std::string& name = "") : Name(name), Cases(0), Failures(0) {};
+	};
+
+	struct ConsistencyReport
+	{
+		std::vector<ConsistencyResult> Results;
+
+		bool Passed;
+
+		ConsistencyReport(void) : Passed(false) {};
+
+		void Print(std::ostream& out) const;
+	};
+
+	/**
+	 * checks that the fast paths of the detector give exactly the results of
+	 * the straightforward ones on random images. the images only depend on the
+	 * seed, so a failure can be reproduced.
+	 */
+	class DetectorConsistencyCheck
+	{
+	private:
+		cv::RNG rng;
+
+		// random rotated squares, rings and noise on a black or white background
+		void RenderBinary(cv::Mat& binary);
+
+		// smooth gradients, blocks and noise in an image of odd size, sometimes a view into a larger one
+		void RenderColor(cv::Mat& color);
+
+		// the quads found in horizontal bands have to be the ones found in one piece, for 2 to 16 bands
+		ConsistencyResult CheckContourBands(int images);
+
+		// the fused colour thresholds have to match cv::cvtColor followed by the OpenCV threshold byte for byte
+		ConsistencyResult CheckAdaptiveThreshold(int images);
+		ConsistencyResult CheckThreshold(int images);
+	public:
+		DetectorConsistencyCheck(unsigned long long seed = 1);
+		~DetectorConsistencyCheck(void);
+
+		ConsistencyReport Run(int images);
+	};
+}
@@ -0,0 +1,82 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <opencv2/imgproc.hpp>
+
+// define TUMAR_NO_DEBUG_CAPTURE to remove all debug captures from the detector
+#ifdef TUMAR_NO_DEBUG_CAPTURE
+#define TUMAR_DEBUG_CAPTURE(context, call) do { } while(0)
+#else
+#define TUMAR_DEBUG_CAPTURE(context, call) do { if((context).Debug != NULL) (context).Debug->call; } while(0)
+#endif
+
+namespace TUMAugmentedRealityExercise
+{
+	class UndistortionMap;
+	class StripeSamplingProfile;
+	class Marker;
+	class Quad;
+	class DetectorContext;
+
+	/**
+	 * receives intermediate images of the detector, it is called from the
+	 * thread running the detector.
+	 */
+	class DetectorDebugSink
+	{
+	public:
+		virtual ~DetectorDebugSink(void) {};
+
+		// the 6x6 binary code sampled from the last marker with a valid border
+		virtual void CaptureMarkerCode(const cv::Mat& code) = 0;
+
+		// the binary image of a frame and the settings it is searched with, before its candidates
+		virtual void CaptureFrame(const cv::Mat& /* image */, const DetectorContext& /* context */, const StripeSamplingProfile& /* profile */) {};
+
+		// a quad found by the contour search and the marker built from it, detected is false if it was rejected
+		virtual void CaptureCandidate(const cv::Mat& /* image */, const Quad& /* quad */, const Marker& /* marker */, bool /* detected */) {};
+	};
+
+	/**
+	 * everything a detector needs to know besides the image. each detector
+	 * keeps its own copy, so detectors running in parallel share nothing.
+	 */
+	class DetectorContext
+	{
+	public:
+		// side length of the markers, the unit of the estimated translation
+		float MarkerSize;
+
+		// focal length and principal point in pixels
+		float FocalLength;
+		cv::Point2f PrincipalPoint;
+
+		// removes the lens distortion from the corners before the pose is estimated, may be NULL
+		const UndistortionMap* Undistortion;
+
+		// grey value separating black and white code cells
+		double CodeThreshold;
+
+		// may be NULL
+		DetectorDebugSink* Debug;
+
+		DetectorContext(void) :
+			MarkerSize(1),
+			// approximate focal length for logitech quickcam 4000 at 320*240 resolution
+			FocalLength(400),
+			PrincipalPoint(0, 0),
+			Undistortion(NULL),
+			CodeThreshold(100),
+			Debug(NULL)
+		{
+		};
+	};
+}
@@ -31,6 +31,12 @@ namespace TUMAugmentedRealityExercise
 	void FPSMonitor::BeginProcessing(void)
 	{
 		this->processingStart = cv::getTickCount();
+		this->grabEnd = this->processingStart;
+	}
+
+	void FPSMonitor::EndGrab(void)
+	{
+		this->grabEnd = cv::getTickCount();
 	}
 
 	void FPSMonitor::EndProcessing(void)
@@ -43,6 +49,11 @@ namespace TUMAugmentedRealityExercise
 		return (this->processingEnd - this->processingStart) / this->ticksPerMs;
 	}
 
+	double FPSMonitor::GetProcessingMs(void)
+	{
+		return (this->processingEnd - this->grabEnd) / this->ticksPerMs;
+	}
+
 	int FPSMonitor::GetMsUntilNextFrame(void)
 	{
 		return std::max(1, (int)(this->msPerFrame - this->GetElapsedMs()));
@@ -10,17 +10,18 @@
 #pragma once
 
 #include <iostream>
-#include <opencv\cv.h>
+#include <opencv2/imgproc.hpp>
 
 namespace TUMAugmentedRealityExercise
 {
 	class FPSMonitor
 	{
 	private:
-		int msPerFrame;
+		double msPerFrame;
 		double ticksPerMs;
 
 		double processingStart;
+		double grabEnd;
 		double processingEnd;
 	public:
 		FPSMonitor(void);
@@ -30,10 +31,16 @@ namespace TUMAugmentedRealityExercise
 
 		void BeginProcessing(void);
 
+		// the grab may block until the camera delivers the next frame
+		void EndGrab(void);
+
 		void EndProcessing(void);
 
 		double GetElapsedMs(void);
 
+		// the time spent on the frame after it was grabbed
+		double GetProcessingMs(void);
+
 		int GetMsUntilNextFrame(void);
 	};
 }
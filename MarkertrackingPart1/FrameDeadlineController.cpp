@@ -0,0 +1,106 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "FrameDeadlineController.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	// weight of the newest frame in the smoothed times
+	static const double Smoothing = 0.2;
+
+	// frames the smoothed time has to stay above the target, or below the slack threshold, before the level changes
+	static const int DegradeAfterFrames = 5;
+	static const int RestoreAfterFrames = 30;
+
+	// restoring a level is only tried if a frame is clearly cheaper than the target
+	static const double SlackFactor = 0.7;
+
+	// degrading the detection doesn't help if it is only a small part of the frame
+	static const double MinDetectionShare = 0.2;
+
+	FrameDeadlineController::FrameDeadlineController(double targetMs, int maxLevel) :
+		level(0),
+		targetMs(targetMs),
+		averageMs(0),
+		averageDetectionMs(0),
+		framesOverTarget(0),
+		framesWithSlack(0)
+	{
+		this->levels.push_back(DetectionQuality(StripeSamplingProfile(), 1, 0.5));
+		this->levels.push_back(DetectionQuality(StripeSamplingProfile::Fast(), 1, 0.5));
+		this->levels.push_back(DetectionQuality(StripeSamplingProfile::Fast(), 5, 0.5));
+		this->levels.push_back(DetectionQuality(StripeSamplingProfile::Fast(), 15, 0.25));
+
+		int last = (int) this->levels.size() - 1;
+
+		this->maxLevel = maxLevel < 0 ? last : std::min(maxLevel, last);
+	}
+
+	FrameDeadlineController::~FrameDeadlineController(void)
+	{
+	}
+
+	bool FrameDeadlineController::Update(double frameMs, double detectionMs)
+	{
+		this->averageMs += Smoothing * (frameMs - this->averageMs);
+		this->averageDetectionMs += Smoothing * (detectionMs - this->averageDetectionMs);
+
+		bool over = this->averageMs > this->targetMs;
+		bool slack = this->averageMs < SlackFactor * this->targetMs;
+
+		this->framesOverTarget = over ? this->framesOverTarget + 1 : 0;
+		this->framesWithSlack = slack ? this->framesWithSlack + 1 : 0;
+
+		if(this->framesOverTarget >= DegradeAfterFrames && this->level < this->maxLevel && this->averageDetectionMs >= MinDetectionShare * this->averageMs)
+		{
+			this->level++;
+			this->framesOverTarget = 0;
+
+			return true;
+		}
+
+		if(this->framesWithSlack >= RestoreAfterFrames && this->level > 0)
+		{
+			this->level--;
+			this->framesWithSlack = 0;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void FrameDeadlineController::Apply(MarkerDetectionImageProcessor& detector) const
+	{
+		const DetectionQuality& quality = this->levels[this->level];
+
+		detector.SetStripeSamplingProfile(quality.Profile);
+		detector.SetTracking(quality.RedetectionInterval, quality.TrackingMargin);
+	}
+
+	int FrameDeadlineController::GetLevel(void) const
+	{
+		return this->level;
+	}
+
+	int FrameDeadlineController::GetLevelCount(void) const
+	{
+		return (int) this->levels.size();
+	}
+
+	double FrameDeadlineController::GetTargetMs(void) const
+	{
+		return this->targetMs;
+	}
+
+	double FrameDeadlineController::GetAverageMs(void) const
+	{
+		return this->averageMs;
+	}
+}
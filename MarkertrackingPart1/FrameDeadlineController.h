@@ -0,0 +1,70 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "ImageProcessor.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * one step of the quality ladder of the marker detection.
+	 */
+	class DetectionQuality
+	{
+	public:
+		StripeSamplingProfile Profile;
+
+		// see MarkerDetectionImageProcessor::SetTracking
+		int RedetectionInterval;
+		double TrackingMargin;
+
+		DetectionQuality(const StripeSamplingProfile& profile, int redetectionInterval, double trackingMargin) : Profile(profile), RedetectionInterval(redetectionInterval), TrackingMargin(trackingMargin) {};
+	};
+
+	/**
+	 * keeps the processing time of a frame below a target by lowering the
+	 * quality of the marker detection while frames overrun and raising it
+	 * again once there is enough slack. the level only changes after the
+	 * smoothed frame time stayed above or below the target for a while, and
+	 * the detection is only degraded if it takes a noticeable share of the
+	 * frame.
+	 */
+	class FrameDeadlineController
+	{
+	private:
+		std::vector<DetectionQuality> levels;
+		int level;
+		int maxLevel;
+
+		double targetMs;
+		double averageMs;
+		double averageDetectionMs;
+
+		int framesOverTarget;
+		int framesWithSlack;
+	public:
+		// level 0 is full quality, maxLevel bounds the loss of accuracy
+		FrameDeadlineController(double targetMs = 16.0, int maxLevel = -1);
+		~FrameDeadlineController(void);
+
+		// frameMs is the time spent on the frame after the grab. returns true if the level changed and has to be applied
+		bool Update(double frameMs, double detectionMs);
+
+		void Apply(MarkerDetectionImageProcessor& detector) const;
+
+		int GetLevel(void) const;
+		int GetLevelCount(void) const;
+
+		double GetTargetMs(void) const;
+		double GetAverageMs(void) const;
+	};
+}
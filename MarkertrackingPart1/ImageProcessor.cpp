@@ -8,162 +8,406 @@
  */
 
 #include "ImageProcessor.h"
+#include "Profiler.h"
 
 namespace TUMAugmentedRealityExercise
 {
+	// the fixed point weights cvtColor uses for cv::COLOR_BGR2GRAY, so the fused stages give the same grey values
+	struct GreyWeights
+	{
+		int Blue;
+		int Green;
+		int Red;
+		int Shift;
+	};
+
+	// OpenCV 3 and older OpenCV 4 releases round to 14 bits, newer ones to 15 bits
+	static const GreyWeights CandidateGreyWeights[] = {
+		{ 1868, 9617, 4899, 14 },
+		{ 3735, 19235, 9798, 15 }
+	};
+
+	static int ConvertToGrey(const unsigned char* pixel, const GreyWeights& weights)
+	{
+		return (pixel[0] * weights.Blue + pixel[1] * weights.Green + pixel[2] * weights.Red + (1 << (weights.Shift - 1))) >> weights.Shift;
+	}
+
+	// picks the weights which reproduce the linked cvtColor on a ramp of each channel
+	static GreyWeights ProbeGreyWeights(void)
+	{
+		cv::Mat ramps(1, 3 * 256, CV_8UC3, cv::Scalar(0, 0, 0));
+		cv::Mat grey;
+
+		for(int a = 0; a < ramps.cols; a++)
+		{
+			ramps.ptr<unsigned char>(0)[3 * a + a / 256] = (unsigned char) (a % 256);
+		}
+
+		cv::cvtColor(ramps, grey, cv::COLOR_BGR2GRAY);
+
+		int best = 0;
+		int bestDifferences = ramps.cols + 1;
+
+		for(int a = 0; a < sizeof(CandidateGreyWeights) / sizeof(CandidateGreyWeights[0]); a++)
+		{
+			int differences = 0;
+
+			for(int b = 0; b < ramps.cols; b++)
+			{
+				if(ConvertToGrey(ramps.ptr<unsigned char>(0) + 3 * b, CandidateGreyWeights[a]) != grey.at<unsigned char>(0, b))
+					differences++;
+			}
+
+			if(differences < bestDifferences)
+			{
+				best = a;
+				bestDifferences = differences;
+			}
+		}
+
+		return CandidateGreyWeights[best];
+	}
+
+	static void ConvertRowToGrey(const cv::Mat& input, int row, unsigned char* grey)
+	{
+		// probed once, the initialization of a local static is thread safe
+		static const GreyWeights weights = ProbeGreyWeights();
+
+		const unsigned char* pixel = input.ptr<unsigned char>(row);
+
+		if(input.channels() == 1)
+		{
+			std::copy(pixel, pixel + input.cols, grey);
+			return;
+		}
+
+		for(int x = 0; x < input.cols; x++, pixel += 3)
+		{
+			grey[x] = (unsigned char) ConvertToGrey(pixel, weights);
+		}
+	}
+
 	void NullImageProcessor::process(cv::Mat& input, cv::Mat& output)
 	{
+		TUMAR_PROFILE_SCOPE("NullImageProcessor::process");
+
 		output = input;
 	}
 
 	void ResizeImageProcessor::process(cv::Mat& input, cv::Mat& output)
 	{
+		TUMAR_PROFILE_SCOPE("ResizeImageProcessor::process");
+
 		cv::resize(input, output, cv::Size(), this->factor, this->factor, 0);
 	}
 
 	void GreyscaleImageProcessor::process(cv::Mat& input, cv::Mat& output)
 	{
-		cv::cvtColor(input, output, CV_BGR2GRAY);
+		TUMAR_PROFILE_SCOPE("GreyscaleImageProcessor::process");
+
+		cv::cvtColor(input, output, cv::COLOR_BGR2GRAY);
 	}
 
 	void ThresholdImageProcessor::process(cv::Mat& input, cv::Mat& output)
 	{
-		cv::threshold(input, output, this->threshold, 255, CV_THRESH_BINARY);
+		TUMAR_PROFILE_SCOPE("ThresholdImageProcessor::process");
+
+		cv::threshold(input, output, this->threshold, 255, cv::THRESH_BINARY);
 	}
 
-	void AdaptiveThresholdImageProcessor::process(cv::Mat& input, cv::Mat& output)
+	void ThresholdImageProcessor::ProcessColor(const cv::Mat& input, cv::Mat& output)
 	{
-		cv::adaptiveThreshold(input, output, 255, CV_ADAPTIVE_THRESH_MEAN_C, CV_THRESH_BINARY, 55, 5);
+		TUMAR_PROFILE_SCOPE("ThresholdImageProcessor::ProcessColor");
+
+		CV_Assert(input.depth() == CV_8U && (input.channels() == 3 || input.channels() == 1));
+
+		output.create(input.size(), CV_8UC1);
+
+		// like cv::threshold, a fractional threshold is rounded down
+		int threshold = cvFloor(this->threshold);
+
+		for(int y = 0; y < input.rows; y++)
+		{
+			unsigned char* row = output.ptr<unsigned char>(y);
+
+			ConvertRowToGrey(input, y, row);
+
+			for(int x = 0; x < input.cols; x++)
+			{
+				row[x] = row[x] > threshold ? 255 : 0;
+			}
+		}
 	}
 
-	MarkerDetectionImageProcessor::MarkerDetectionImageProcessor(const MemoryStorage* memory, MarkerContainer* markers) : memory(memory), markers(markers)
+	void AdaptiveThresholdImageProcessor::process(cv::Mat& input, cv::Mat& output)
 	{
+		TUMAR_PROFILE_SCOPE("AdaptiveThresholdImageProcessor::process");
+
+		cv::adaptiveThreshold(input, output, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY, BlockSize, Offset);
 	}
 
-	void MarkerDetectionImageProcessor::process(cv::Mat& input, cv::Mat& output)
+	void AdaptiveThresholdImageProcessor::ProcessColor(const cv::Mat& input, cv::Mat& output)
 	{
-		cv::Mat image = input.clone();
-		CvSeq* contours;
-		
-		cvFindContours(&(CvMat)image, this->memory->GetPointer(), &contours, sizeof(CvContour), CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE);
-		
-		for(; contours; contours = contours->h_next)
+		TUMAR_PROFILE_SCOPE("AdaptiveThresholdImageProcessor::ProcessColor");
+
+		CV_Assert(input.depth() == CV_8U && (input.channels() == 3 || input.channels() == 1));
+
+		const int radius = BlockSize / 2;
+		const int area = BlockSize * BlockSize;
+
+		int width = input.cols;
+		int height = input.rows;
+
+		output.create(input.size(), CV_8UC1);
+
+		// row y of the image lives in row y % BlockSize, the window never spans more rows
+		this->rows.create(BlockSize, width, CV_8UC1);
+		this->columnSums.assign(width, 0);
+
+		int* sums = &this->columnSums.front();
+
+		for(int y = 0; y <= std::min(radius, height - 1); y++)
+		{
+			ConvertRowToGrey(input, y, this->rows.ptr<unsigned char>(y));
+		}
+
+		// the borders are replicated like cv::adaptiveThreshold does
+		for(int y = -radius; y <= radius; y++)
 		{
-			CvRect boundingbox = cvBoundingRect(contours, 0);
+			const unsigned char* grey = this->rows.ptr<unsigned char>(std::min(std::max(y, 0), height - 1));
 
-			if(boundingbox.width < 35 || boundingbox.height < 35 || boundingbox.width > input.cols - 10)
+			for(int x = 0; x < width; x++)
 			{
-				continue;
+				sums[x] += grey[x];
 			}
+		}
+
+		for(int y = 0; y < height; y++)
+		{
+			const unsigned char* grey = this->rows.ptr<unsigned char>(y % BlockSize);
+			unsigned char* binary = output.ptr<unsigned char>(y);
 
-			CvSeq* rectangle = cvApproxPoly(contours, sizeof(CvContour), this->memory->GetPointer(), CV_POLY_APPROX_DP, cvContourPerimeter(contours) * 0.02, 0);
+			int sum = (radius + 1) * sums[0];
 
-			if(rectangle->total == 4)
+			for(int x = 1; x <= radius; x++)
 			{
-				Marker marker((std::vector<cv::Point>) cv::Seq<cv::Point>(rectangle));
+				sum += sums[std::min(x, width - 1)];
+			}
 
-				for(int a = 0; a < marker.Corners.size(); a++)
-				{
-					cv::Point current = marker.Corners[a];
-					cv::Point next = marker.Corners[(a + 1) < marker.Corners.size() ? a + 1 : 0];
+			for(int x = 0; x < width; x++)
+			{
+				// rounded mean, the sum is never exactly halfway as the area is odd
+				int mean = (2 * sum + area) / (2 * area);
 
-					// interpolate 6 points between 2 corner points
-					cv::Point2d line(next.x - current.x, next.y - current.y);
-					cv::Point2d intermediate(current.x, current.y);
+				binary[x] = grey[x] - mean > -Offset ? 255 : 0;
 
-					cv::Point2d increment = (1.0 / 7.0) * line;
+				sum += sums[std::min(x + radius + 1, width - 1)] - sums[std::max(x - radius, 0)];
+			}
 
-					double halfStripeWidth = std::max(0.4 * length(increment), 2.5);						
+			if(y + 1 == height)
+				break;
 
-					cv::Point2d direction = normalize(line);
-					cv::Point2d normal = normalize(cv::Point2d(line.y, -line.x)); 
+			// the row leaving the window shares its slot with the one entering it
+			const unsigned char* leaving = this->rows.ptr<unsigned char>(std::max(y - radius, 0) % BlockSize);
 
-					for(int b = 0; b < 6; b++)
-					{
-						intermediate += increment;
+			for(int x = 0; x < width; x++)
+			{
+				sums[x] -= leaving[x];
+			}
 
-						cv::Point2d stripeTopLeftCorner  = (intermediate + direction) + (1.0 * normal * halfStripeWidth);
-						cv::Point2d stripeTopRightCorner  = (intermediate + direction) + (-1.0 * normal * halfStripeWidth);
-						cv::Point2d stripeBottomLeftCorner  = (intermediate - direction) + (1.0 * normal * halfStripeWidth);
-						cv::Point2d stripeBottomRightCorner  = (intermediate - direction) + (-1.0 * normal * halfStripeWidth);
+			int entering = std::min(y + radius + 1, height - 1);
+			unsigned char* added = this->rows.ptr<unsigned char>(entering % BlockSize);
 
-						MarkerStripe stripe;
-						stripe.Center = intermediate;
-						stripe.IterationNormalX = -1.0 * normal;
-						stripe.IterationNormalY = -1.0 * direction;
+			if(entering == y + radius + 1)
+				ConvertRowToGrey(input, entering, added);
 
-						stripe.Width = 2 * halfStripeWidth;
-						stripe.Height = 3;
+			for(int x = 0; x < width; x++)
+			{
+				sums[x] += added[x];
+			}
+		}
+	}
 
-						stripe.Corners.push_back(stripeTopLeftCorner);
-						stripe.Corners.push_back(stripeTopRightCorner);
-						stripe.Corners.push_back(stripeBottomRightCorner);
-						stripe.Corners.push_back(stripeBottomLeftCorner);
+	MarkerDetectionImageProcessor::MarkerDetectionImageProcessor(MarkerContainer* markers, MemoryStorage* storage, const DetectorContext& context, const StripeSamplingProfile& profile) : 
+		markers(markers), 
+		storage(storage), 
+		quadFinder(), 
+		profile(profile), 
+		context(context), 
+		redetectionInterval(1), 
+		trackingMargin(0.5), 
+		framesSinceDetection(0), 
+		lastProcessingMs(0)
+	{
+	}
 
-						stripe.SampleFromImage(input);
-						stripe.CalculateSubPixelCenter();
+	void MarkerDetectionImageProcessor::SetStripeSamplingProfile(const StripeSamplingProfile& profile)
+	{
+		this->profile = profile;
+	}
 
-						marker.Stripes.push_back(stripe);
-					}
-				}
+	const DetectorContext& MarkerDetectionImageProcessor::GetContext(void) const
+	{
+		return this->context;
+	}
 
-				marker.CalculateSubPixelCorners();
+	void MarkerDetectionImageProcessor::SetContext(const DetectorContext& context)
+	{
+		this->context = context;
+	}
 
-				if(marker.SampleFromImageAndDecode(input))
-				{
-					marker.EstimatePose();
+	void MarkerDetectionImageProcessor::SetContourBands(int bands)
+	{
+		this->quadFinder.SetBandCount(bands);
+	}
 
-					this->markers->push_back(marker);
-				}
-			}
-		}		
+	void MarkerDetectionImageProcessor::SetTracking(int redetectionInterval, double margin)
+	{
+		this->redetectionInterval = std::max(redetectionInterval, 1);
+		this->trackingMargin = margin;
 	}
 
-	MarkerHighlightImageProcessor::MarkerHighlightImageProcessor(const MarkerContainer* markers) : markers(markers)
+	double MarkerDetectionImageProcessor::GetLastProcessingMs(void) const
 	{
+		return this->lastProcessingMs;
 	}
 
-	void MarkerHighlightImageProcessor::process(cv::Mat& input, cv::Mat& output)
+	bool MarkerDetectionImageProcessor::ProcessCandidate(const cv::Mat& image, const Quad& quad)
 	{
-		output = input;
+		TUMAR_PROFILE_SCOPE("MarkerDetectionImageProcessor::candidate");
+
+		Marker marker(std::vector<cv::Point>(quad.Corners, quad.Corners + 4));
 
-		// iterate over all markers
-		for(MarkerContainer::const_iterator it = this->markers->begin(); it != this->markers->end(); ++it)
 		{
-			this->HighlightMarker(output, *it);
+			// one scope for all stripes of the candidate, a scope per stripe would cost more than some of them take
+			TUMAR_PROFILE_SCOPE("MarkerDetectionImageProcessor::stripes");
+
+			for(int a = 0; a < marker.Corners.size(); a++)
+			{
+				cv::Point current = marker.Corners[a];
+				cv::Point next = marker.Corners[(a + 1) < marker.Corners.size() ? a + 1 : 0];
+
+				// interpolate points between 2 corner points, the number depends on the edge length
+				cv::Point2d line(next.x - current.x, next.y - current.y);
+				cv::Point2d intermediate(current.x, current.y);
+
+				int stripeCount = this->profile.GetStripeCount(length(line));
+
+				cv::Point2d increment = (1.0 / (stripeCount + 1)) * line;
+
+				double halfStripeWidth = this->profile.GetHalfStripeWidth(length(increment));
+				double halfStripeHeight = (this->profile.StripeHeight - 1) / 2;
+
+				cv::Point2d direction = normalize(line);
+				cv::Point2d normal = normalize(cv::Point2d(line.y, -line.x)); 
+
+				for(int b = 0; b < stripeCount; b++)
+				{
+					intermediate += increment;
+
+					cv::Point2d stripeTopLeftCorner  = (intermediate + direction * halfStripeHeight) + (1.0 * normal * halfStripeWidth);
+					cv::Point2d stripeTopRightCorner  = (intermediate + direction * halfStripeHeight) + (-1.0 * normal * halfStripeWidth);
+					cv::Point2d stripeBottomLeftCorner  = (intermediate - direction * halfStripeHeight) + (1.0 * normal * halfStripeWidth);
+					cv::Point2d stripeBottomRightCorner  = (intermediate - direction * halfStripeHeight) + (-1.0 * normal * halfStripeWidth);
+
+					MarkerStripe stripe;
+					stripe.Center = intermediate;
+					stripe.IterationNormalX = -1.0 * normal;
+					stripe.IterationNormalY = -1.0 * direction;
+
+					stripe.Width = 2 * halfStripeWidth;
+					stripe.Height = this->profile.StripeHeight;
+
+					stripe.Corners.push_back(stripeTopLeftCorner);
+					stripe.Corners.push_back(stripeTopRightCorner);
+					stripe.Corners.push_back(stripeBottomRightCorner);
+					stripe.Corners.push_back(stripeBottomLeftCorner);
+
+					stripe.SampleFromImage(image, *this->storage);
+					stripe.CalculateSubPixelCenter();
+
+					marker.Stripes.push_back(stripe);
+				}
+
+				marker.EdgeStripeCounts.push_back(stripeCount);
+			}
 		}
+
+		marker.CalculateSubPixelCorners();
+
+		bool detected = marker.SampleFromImageAndDecode(image, this->context);
+
+		if(detected)
+			marker.EstimatePose(this->context);
+
+		TUMAR_DEBUG_CAPTURE(this->context, CaptureCandidate(image, quad, marker, detected));
+
+		if(detected)
+			this->markers->push_back(marker);
+
+		return detected;
 	}
-	
-	void MarkerHighlightImageProcessor::HighlightMarker(cv::Mat& image, const Marker& marker)
+
+	void MarkerDetectionImageProcessor::process(cv::Mat& input, cv::Mat& /* output */)
 	{
-		int RectangleCorners[] = { 4 };
-		
-		const cv::Point* first = &marker.Corners.front();
+		TUMAR_PROFILE_SCOPE("MarkerDetectionImageProcessor::process");
 
-		cv::polylines(image, &first, RectangleCorners, 1, true, cv::Scalar(0, 0, 255), 1);
+		// expects the thresholded image, a colour or grey frame wired in by mistake would never contain a marker
+		CV_Assert(input.type() == CV_8UC1);
 
-		int r = 0;
+		int64 start = cv::getTickCount();
+		int first = (int) this->markers->size();
 
-		for(int a = 0; a < marker.SubPixelCorners.size(); a++)
-		{
-			cv::circle(image, marker.SubPixelCorners[a], 2, cv::Scalar(255 - r, 0, r), 2);
-			r += 60;
-		}
+		bool tracking = !this->trackingRegions.empty() && ++this->framesSinceDetection < this->redetectionInterval;
+
+		if(!tracking)
+			this->framesSinceDetection = 0;
+
+		TUMAR_DEBUG_CAPTURE(this->context, CaptureFrame(input, this->context, this->profile));
+
+		const QuadContainer& quads = tracking ? this->quadFinder.Find(input, this->trackingRegions) : this->quadFinder.Find(input);
+		int detected = 0;
+
+		TUMAR_PROFILE_COUNT("MarkerDetectionImageProcessor::candidates", quads.size());
 		
-		for(int a = 0; a < marker.Corners.size(); a++)
+		for(QuadContainer::const_iterator it = quads.begin(); it != quads.end(); ++it)
 		{
-			cv::circle(image, marker.Corners[a], 1, cv::Scalar(0, 255, 0), 1);
+			if(this->ProcessCandidate(input, *it))
+				detected++;
 		}
 
-		std::vector<cv::Point> stripeCorners;
+		TUMAR_PROFILE_COUNT("MarkerDetectionImageProcessor::markers", detected);
 
-		for(int a = 0; a < marker.Stripes.size(); a++)
+		// search around the markers of this frame next time
+		this->trackingRegions.clear();
+
+		if(this->redetectionInterval > 1)
 		{
-			stripeCorners.assign(marker.Stripes[a].Corners.begin(), marker.Stripes[a].Corners.end());
-			const cv::Point* firstStripeCorner = &stripeCorners.front();
+			for(int a = first; a < this->markers->size(); a++)
+			{
+				cv::Rect bounds = cv::boundingRect(cv::Mat((*this->markers)[a].Corners));
+				int margin = (int) (this->trackingMargin * std::max(bounds.width, bounds.height));
 
-			cv::polylines(image, &firstStripeCorner, RectangleCorners, 1, true, cv::Scalar(a*10, 255 - a * 10, 0));
+				this->trackingRegions.push_back(cv::Rect(bounds.x - margin, bounds.y - margin, bounds.width + 2 * margin, bounds.height + 2 * margin));
+			}
 		}
+
+		this->lastProcessingMs = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+	}
+
+	MarkerHighlightImageProcessor::MarkerHighlightImageProcessor(const MarkerContainer* markers, OverlaySnapshot::DetailLevel detail) : markers(markers), detail(detail)
+	{
+	}
+
+	void MarkerHighlightImageProcessor::process(cv::Mat& input, cv::Mat& output)
+	{
+		TUMAR_PROFILE_SCOPE("MarkerHighlightImageProcessor::process");
+
+		// the input may still be used by someone else, so it is never drawn on
+		input.copyTo(output);
+
+		this->snapshot.Capture(*this->markers);
+		this->snapshot.Draw(output, this->detail);
 	}
 
 	ImageProcessorChain::ImageProcessorChain(void) : processors()
@@ -182,6 +426,8 @@ namespace TUMAugmentedRealityExercise
 
 	void ImageProcessorChain::process(cv::Mat& input, cv::Mat& output)
 	{
+		TUMAR_PROFILE_SCOPE("ImageProcessorChain::process");
+
 		cv::Mat lastResult = input;
 
 		for (std::vector<ImageProcessor*>::iterator it = this->processors.begin(); it != this->processors.end(); ++it) 
@@ -12,11 +12,12 @@
 #include <string>
 #include <iostream>
 
-#include <opencv\cv.h>
-#include <opencv\highgui.h>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
 
-#include "MemoryStorage.h"
 #include "Marker.h"
+#include "QuadFinder.h"
+#include "OverlayRenderer.h"
 
 namespace TUMAugmentedRealityExercise
 {
@@ -64,38 +65,94 @@ namespace TUMAugmentedRealityExercise
 		~ThresholdImageProcessor(void) {};
 
 		void process(cv::Mat& input, cv::Mat& output);
+
+		// thresholds a BGR image, converting each pixel to grey on the fly, without a grey image in between
+		void ProcessColor(const cv::Mat& input, cv::Mat& output);
 	};
 
 	class AdaptiveThresholdImageProcessor : public ImageProcessor
 	{
+	private:
+		// the grey rows of the current window and their column sums, only used by ProcessColor
+		cv::Mat rows;
+		std::vector<int> columnSums;
 	public:
+		// side length of the square the mean is taken from and the offset subtracted from it
+		static const int BlockSize = 55;
+		static const int Offset = 5;
+
 		AdaptiveThresholdImageProcessor(void) {};
 		~AdaptiveThresholdImageProcessor(void) {};
 
 		void process(cv::Mat& input, cv::Mat& output);
+
+		/**
+		 * thresholds a BGR image in one pass over its rows. only the rows of the current window are
+		 * converted to grey and kept, the result is the same as converting the whole image first.
+		 */
+		void ProcessColor(const cv::Mat& input, cv::Mat& output);
 	};
 
 	class MarkerDetectionImageProcessor : public ImageProcessor
 	{
 	private:
-		const MemoryStorage* memory;
 		MarkerContainer* markers;
+		MemoryStorage* storage;
+
+		QuadFinder quadFinder;
+		StripeSamplingProfile profile;
+		DetectorContext context;
+
+		int redetectionInterval;
+		double trackingMargin;
+		int framesSinceDetection;
+		std::vector<cv::Rect> trackingRegions;
 
+		double lastProcessingMs;
 	public:
-		MarkerDetectionImageProcessor(const MemoryStorage* memory, MarkerContainer* markers);
+		// the stripes of the detected markers live in the storage until it is cleared
+		MarkerDetectionImageProcessor(MarkerContainer* markers, MemoryStorage* storage, const DetectorContext& context, const StripeSamplingProfile& profile = StripeSamplingProfile());
 		~MarkerDetectionImageProcessor(void) {};
 
+		void SetStripeSamplingProfile(const StripeSamplingProfile& profile);
+
+		const DetectorContext& GetContext(void) const;
+		void SetContext(const DetectorContext& context);
+
+		// number of horizontal bands traced in parallel, 1 traces the whole image on the calling thread
+		void SetContourBands(int bands);
+
+		/**
+		 * with an interval above 1 only the surroundings of the markers found in the last frame
+		 * are searched, the whole image is searched every interval frames or when no marker was found.
+		 * the margin is relative to the size of a marker.
+		 */
+		void SetTracking(int redetectionInterval, double margin);
+
+		double GetLastProcessingMs(void) const;
+
+		/**
+		 * samples the stripes of one quad, locates its corners, decodes it and estimates its pose.
+		 * adds the marker to the container and returns true if it was decoded.
+		 */
+		bool ProcessCandidate(const cv::Mat& image, const Quad& quad);
+
 		void process(cv::Mat& input, cv::Mat& output);
 	};
 
+	/**
+	 * draws the markers onto a copy of the input on the calling thread, see
+	 * OverlayRenderer for drawing on a background thread.
+	 */
 	class MarkerHighlightImageProcessor : public ImageProcessor
 	{
 	private:
 		const MarkerContainer* markers;
 
-		void HighlightMarker(cv::Mat& image, const Marker& marker);
+		OverlaySnapshot snapshot;
+		OverlaySnapshot::DetailLevel detail;
 	public:
-		MarkerHighlightImageProcessor(const MarkerContainer* markers);
+		MarkerHighlightImageProcessor(const MarkerContainer* markers, OverlaySnapshot::DetailLevel detail = OverlaySnapshot::Stripes);
 		~MarkerHighlightImageProcessor(void) {};
 
 		void process(cv::Mat& input, cv::Mat& output);
@@ -0,0 +1,585 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "KernelBenchmark.h"
+#include "SyntheticMarkerRenderer.h"
+#include "Pipeline.h"
+#include "PoseEstimation.h"
+#include "VectorUtil.h"
+#include "Profiler.h"
+
+#include <cstdlib>
+#include <new>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#ifdef TUMAR_COUNT_ALLOCATIONS
+
+// only counted while a kernel is measured, so the other threads don't share a counter
+static std::atomic<bool> countingAllocations(false);
+static std::atomic<long long> allocations(0);
+
+// kernel calls to count the allocations of
+static const int AllocationOps = 1000;
+
+void* operator new(size_t size)
+{
+	if(countingAllocations.load(std::memory_order_relaxed))
+		allocations.fetch_add(1, std::memory_order_relaxed);
+
+	void* memory = malloc(size > 0 ? size : 1);
+
+	if(memory == NULL)
+		throw std::bad_alloc();
+
+	return memory;
+}
+
+void operator delete(void* memory) throw()
+{
+	free(memory);
+}
+
+#endif
+
+namespace TUMAugmentedRealityExercise
+{
+	// kernel calls between two looks at the clock
+	static const int BatchSize = 16;
+
+	static const int FrameWidth = 640;
+	static const int FrameHeight = 480;
+	static const float FocalLength = 500;
+	static const float MarkerSize = 5;
+
+	// seeds tried to find a frame with a detected marker
+	static const int MaxDetectionAttempts = 10;
+
+	// a marker about 30 units in front of the camera, slightly tilted, relative to the principal point
+	static const CvPoint2D32f FixedQuad[4] = { { -40.3f, -35.2f }, { 45.1f, -38.7f }, { 48.9f, 42.6f }, { -37.5f, 39.8f } };
+
+	// the lines through the first two edges of the quad, like cv::fitLine returns them
+	static const cv::Vec4f FixedLineA(0.9992f, -0.0405f, 2.4f, -36.95f);
+	static const cv::Vec4f FixedLineB(0.0473f, 0.9989f, 47.0f, 1.95f);
+
+	// written by the kernels, so the compiler can't drop their results
+	struct KernelSink
+	{
+		volatile float Value;
+
+		KernelSink(void) : Value(0) {};
+	};
+
+	struct PoseKernelInput
+	{
+		CvPoint2D32f Quad[4];
+		CvPoint3D32f Points3D[4];
+
+		// the initial pose of the quad, the optimization starts from it
+		float Rotation[4];
+		float Translation[3];
+
+		float Parameters[7];
+
+		PoseKernelInput(void)
+		{
+			float c = MarkerSize / 2;
+
+			CvPoint3D32f points3D[4] = { { -c, c, 0.0f }, { -c, -c, 0.0f }, { c, -c, 0.0f }, { c, c, 0.0f } };
+
+			std::copy(FixedQuad, FixedQuad + 4, this->Quad);
+			std::copy(points3D, points3D + 4, this->Points3D);
+
+			getInitialPose(this->Rotation, this->Translation, this->Quad, MarkerSize, FocalLength);
+
+			std::copy(this->Rotation, this->Rotation + 4, this->Parameters);
+			std::copy(this->Translation, this->Translation + 3, this->Parameters + 4);
+		};
+	};
+
+	// a marker detected in a synthetic frame, the kernels only read it
+	struct MarkerKernelInput
+	{
+		cv::Mat Image;
+		DetectorContext Context;
+
+		// holds the stripe buffers of the markers
+		MemoryStorage Storage;
+		MarkerContainer Markers;
+
+		// the thresholded code cells of the first marker
+		cv::Mat Cells;
+	};
+
+	static std::shared_ptr<MarkerKernelInput> DetectMarker(unsigned long long seed)
+	{
+		std::shared_ptr<MarkerKernelInput> input = std::make_shared<MarkerKernelInput>();
+
+		input->Context.MarkerSize = MarkerSize;
+		input->Context.FocalLength = FocalLength;
+
+		for(int a = 0; a < MaxDetectionAttempts && input->Markers.empty(); a++)
+		{
+			SyntheticMarkerRenderer renderer(cv::Size(FrameWidth, FrameHeight), FocalLength, MarkerSize, seed + a);
+			input->Context.PrincipalPoint = renderer.GetPrincipalPoint();
+
+			GreyscaleImageProcessor grey;
+			AdaptiveThresholdImageProcessor adaptive;
+			MarkerDetectionImageProcessor marker(&input->Markers, &input->Storage, input->Context);
+
+			Pipeline<GreyscaleImageProcessor, AdaptiveThresholdImageProcessor, MarkerDetectionImageProcessor> pipeline(grey, adaptive, marker);
+
+			std::vector<SyntheticMarker> truth;
+			cv::Mat frame;
+			cv::Mat output;
+
+			input->Markers.clear();
+			input->Storage.Clear();
+
+			renderer.Render(frame, truth, 1);
+			pipeline.process(frame, output);
+
+			// the output is a buffer of the pipeline
+			input->Image = output.clone();
+		}
+
+		if(input->Markers.empty())
+			return std::shared_ptr<MarkerKernelInput>();
+
+		// the same cells SampleFromImageAndDecode reads the code from
+		cv::Point2f points[4] = { cv::Point2f(-0.5, -0.5), cv::Point2f(5.5, -0.5), cv::Point2f(5.5, 5.5), cv::Point2f(-0.5, 5.5) };
+		cv::Mat transform = cv::getPerspectiveTransform(&input->Markers[0].SubPixelCorners.front(), points);
+
+		cv::warpPerspective(input->Image, input->Cells, transform, cv::Size(6, 6));
+		cv::threshold(input->Cells, input->Cells, input->Context.CodeThreshold, 255, cv::THRESH_BINARY);
+
+		return input;
+	}
+
+	KernelBenchmark::KernelBenchmark(double runMs, int runs) :
+		runMs(runMs),
+		runs(runs)
+	{
+	}
+
+	KernelBenchmark::~KernelBenchmark(void)
+	{
+	}
+
+	void KernelBenchmark::Add(const std::string& name, const KernelFactory& factory)
+	{
+		Entry entry;
+		entry.Name = name;
+		entry.Factory = factory;
+
+		this->entries.push_back(entry);
+	}
+
+	void KernelBenchmark::AddDetectorKernels(unsigned long long seed)
+	{
+		this->Add("calcHomography", []() -> Kernel
+		{
+			std::shared_ptr<PoseKernelInput> input = std::make_shared<PoseKernelInput>();
+			std::shared_ptr<KernelSink> sink = std::make_shared<KernelSink>();
+
+			return [input, sink]()
+			{
+				float homography[9];
+				calcHomography(homography, input->Quad);
+
+				sink->Value = homography[0];
+			};
+		});
+
+		this->Add("getInitialPose", []() -> Kernel
+		{
+			std::shared_ptr<PoseKernelInput> input = std::make_shared<PoseKernelInput>();
+			std::shared_ptr<KernelSink> sink = std::make_shared<KernelSink>();
+
+			return [input, sink]()
+			{
+				float rotation[4], translation[3];
+				getInitialPose(rotation, translation, input->Quad, MarkerSize, FocalLength);
+
+				sink->Value = translation[2];
+			};
+		});
+
+		this->Add("computeJacobian", []() -> Kernel
+		{
+			std::shared_ptr<PoseKernelInput> input = std::make_shared<PoseKernelInput>();
+			std::shared_ptr<KernelSink> sink = std::make_shared<KernelSink>();
+
+			return [input, sink]()
+			{
+				float jacobian[14];
+				computeJacobian(jacobian, input->Parameters, input->Points3D[2], FocalLength);
+
+				sink->Value = jacobian[0];
+			};
+		});
+
+		this->Add("optimizePose", []() -> Kernel
+		{
+			std::shared_ptr<PoseKernelInput> input = std::make_shared<PoseKernelInput>();
+			std::shared_ptr<KernelSink> sink = std::make_shared<KernelSink>();
+
+			// every op starts from the initial pose again
+			return [input, sink]()
+			{
+				float rotation[4], translation[3];
+				std::copy(input->Rotation, input->Rotation + 4, rotation);
+				std::copy(input->Translation, input->Translation + 3, translation);
+
+				optimizePose(rotation, translation, 4, input->Quad, input->Points3D, FocalLength);
+
+				sink->Value = translation[2];
+			};
+		});
+
+		this->Add("estimateSquarePose", []() -> Kernel
+		{
+			std::shared_ptr<PoseKernelInput> input = std::make_shared<PoseKernelInput>();
+			std::shared_ptr<KernelSink> sink = std::make_shared<KernelSink>();
+
+			return [input, sink]()
+			{
+				float pose[16];
+				estimateSquarePose(pose, input->Quad, MarkerSize, FocalLength);
+
+				sink->Value = pose[11];
+			};
+		});
+
+		this->Add("intersect", []() -> Kernel
+		{
+			cv::Vec4f a = FixedLineA;
+			cv::Vec4f b = FixedLineB;
+			std::shared_ptr<KernelSink> sink = std::make_shared<KernelSink>();
+
+			return [a, b, sink]()
+			{
+				cv::Point2f corner = intersect(a, b);
+
+				sink->Value = corner.x;
+			};
+		});
+
+		std::shared_ptr<MarkerKernelInput> input = DetectMarker(seed);
+
+		if(!input)
+		{
+			std::cerr << "no marker detected in the synthetic frames, skipping the marker kernels" << std::endl;
+			return;
+		}
+
+		this->Add("MarkerStripe::SampleFromImage", [input]() -> Kernel
+		{
+			const Marker& marker = input->Markers[0];
+
+			std::shared_ptr<MemoryStorage> storage = std::make_shared<MemoryStorage>();
+			MarkerStripe stripe = marker.Stripes[marker.Stripes.size() / 2];
+
+			return [input, storage, stripe]() mutable
+			{
+				storage->Clear();
+				stripe.Buffer = cv::Mat();
+
+				stripe.SampleFromImage(input->Image, *storage);
+			};
+		});
+
+		this->Add("MarkerStripe::CalculateSubPixelCenter", [input]() -> Kernel
+		{
+			const Marker& marker = input->Markers[0];
+
+			// the buffer stays in the storage of the input
+			MarkerStripe stripe = marker.Stripes[marker.Stripes.size() / 2];
+
+			return [input, stripe]() mutable
+			{
+				stripe.CalculateSubPixelCenter();
+			};
+		});
+
+		this->Add("Marker::CalculateSubPixelCorners", [input]() -> Kernel
+		{
+			std::shared_ptr<Marker> marker = std::make_shared<Marker>(input->Markers[0]);
+
+			return [marker]()
+			{
+				marker->CalculateSubPixelCorners();
+			};
+		});
+
+		this->Add("Marker::ReadCode", [input]() -> Kernel
+		{
+			std::shared_ptr<KernelSink> sink = std::make_shared<KernelSink>();
+
+			return [input, sink]()
+			{
+				int rotation;
+				int code = Marker::ReadCode(input->Cells, rotation);
+
+				sink->Value = (float) (code + rotation);
+			};
+		});
+
+		// the first call rotates the corners to the code, so the following ones see the same marker
+		this->Add("Marker::SampleFromImageAndDecode", [input]() -> Kernel
+		{
+			std::shared_ptr<Marker> marker = std::make_shared<Marker>(input->Markers[0]);
+
+			return [input, marker]()
+			{
+				marker->SampleFromImageAndDecode(input->Image, input->Context);
+			};
+		});
+	}
+
+	double KernelBenchmark::Measure(Kernel& kernel, double seconds, long long& ops)
+	{
+		int64 start = cv::getTickCount();
+		int64 limit = (int64) (seconds * cv::getTickFrequency());
+		int64 elapsed;
+
+		ops = 0;
+
+		do
+		{
+			for(int a = 0; a < BatchSize; a++)
+			{
+				kernel();
+			}
+
+			ops += BatchSize;
+			elapsed = cv::getTickCount() - start;
+		}
+		while(elapsed < limit);
+
+		return elapsed / cv::getTickFrequency();
+	}
+
+	double KernelBenchmark::MeasureThroughput(const KernelFactory& factory, int threads)
+	{
+		// the factories aren't thread safe, every thread gets its kernel before they start
+		std::vector<Kernel> kernels;
+		std::vector<double> opsPerSecond(threads, 0.0);
+		std::vector<std::thread> workers;
+		std::atomic<bool> start(false);
+
+		for(int a = 0; a < threads; a++)
+		{
+			kernels.push_back(factory());
+		}
+
+		for(int a = 0; a < threads; a++)
+		{
+			workers.push_back(std::thread([this, a, &kernels, &opsPerSecond, &start]()
+			{
+				while(!start.load())
+				{
+					std::this_thread::yield();
+				}
+
+				long long ops;
+				double seconds = Measure(kernels[a], this->runMs / 1000, ops);
+
+				opsPerSecond[a] = ops / seconds;
+			}));
+		}
+
+		start = true;
+
+		double total = 0;
+
+		for(int a = 0; a < threads; a++)
+		{
+			workers[a].join();
+			total += opsPerSecond[a];
+		}
+
+		return total / threads;
+	}
+
+	BenchmarkResultContainer KernelBenchmark::Run(const std::string& filter)
+	{
+		BenchmarkResultContainer results;
+
+		int threads = std::max((int) std::thread::hardware_concurrency(), 1);
+
+		bool profiling = Profiler::IsEnabled();
+		Profiler::SetEnabled(false);
+
+		for(std::vector<Entry>::const_iterator it = this->entries.begin(); it != this->entries.end(); ++it)
+		{
+			if(it->Name.find(filter) == std::string::npos)
+				continue;
+
+			Kernel kernel = it->Factory();
+
+			BenchmarkResult result;
+			result.Name = it->Name;
+
+			long long ops;
+			std::vector<double> nsPerOp;
+
+			// warm up the caches and the branch predictors
+			Measure(kernel, this->runMs / 1000, ops);
+
+			for(int a = 0; a < this->runs; a++)
+			{
+				double seconds = Measure(kernel, this->runMs / 1000, ops);
+
+				nsPerOp.push_back(seconds * 1e9 / ops);
+			}
+
+			std::nth_element(nsPerOp.begin(), nsPerOp.begin() + nsPerOp.size() / 2, nsPerOp.end());
+			result.NsPerOp = nsPerOp[nsPerOp.size() / 2];
+
+#ifdef TUMAR_COUNT_ALLOCATIONS
+			long long before = allocations.load();
+			countingAllocations = true;
+
+			for(int a = 0; a < AllocationOps; a++)
+			{
+				kernel();
+			}
+
+			countingAllocations = false;
+			result.AllocationsPerOp = (double) (allocations.load() - before) / AllocationOps;
+#endif
+
+			result.OpsPerSecondPerCore = this->MeasureThroughput(it->Factory, threads);
+
+			results.push_back(result);
+		}
+
+		Profiler::SetEnabled(profiling);
+
+		return results;
+	}
+
+	int KernelBenchmark::RunAgainstBaseline(const std::string& filter, const std::string& baselineFile, std::ostream& out)
+	{
+		BenchmarkResultContainer results = this->Run(filter);
+		BenchmarkResultContainer baseline;
+
+		bool hasBaseline = !baselineFile.empty() && Load(baselineFile, baseline);
+
+		Print(out, results, hasBaseline ? &baseline : NULL);
+
+		if(!baselineFile.empty() && !hasBaseline)
+		{
+			if(!Save(baselineFile, results))
+			{
+				std::cerr << "can't write baseline " << baselineFile << std::endl;
+				return 1;
+			}
+
+			out << "wrote baseline " << baselineFile << std::endl;
+		}
+
+		return 0;
+	}
+
+	void KernelBenchmark::Print(std::ostream& out, const BenchmarkResultContainer& results, const BenchmarkResultContainer* baseline)
+	{
+		out << std::left << std::setw(40) << "kernel" << std::right << std::setw(12) << "ns/op" << std::setw(12) << "new/op" << std::setw(16) << "ops/s/core";
+
+		if(baseline != NULL)
+			out << std::setw(12) << "speedup";
+
+		out << std::endl;
+
+		for(BenchmarkResultContainer::const_iterator it = results.begin(); it != results.end(); ++it)
+		{
+			out << std::left << std::setw(40) << it->Name << std::right << std::fixed;
+			out << std::setprecision(1) << std::setw(12) << it->NsPerOp;
+
+			if(it->AllocationsPerOp < 0)
+				out << std::setw(12) << "-";
+			else
+				out << std::setprecision(2) << std::setw(12) << it->AllocationsPerOp;
+
+			out << std::setprecision(0) << std::setw(16) << it->OpsPerSecondPerCore;
+
+			if(baseline != NULL)
+			{
+				for(BenchmarkResultContainer::const_iterator base = baseline->begin(); base != baseline->end(); ++base)
+				{
+					if(base->Name == it->Name && it->NsPerOp > 0)
+						out << std::setprecision(2) << std::setw(11) << base->NsPerOp / it->NsPerOp << "x";
+				}
+			}
+
+			out << std::endl;
+		}
+
+		out.unsetf(std::ios::fixed);
+	}
+
+	bool KernelBenchmark::Save(const std::string& file, const BenchmarkResultContainer& results)
+	{
+		std::ofstream out(file.c_str());
+
+		if(!out)
+			return false;
+
+		out << "kernel,ns_per_op,operator_new_per_op,ops_per_second_per_core" << std::endl;
+
+		for(BenchmarkResultContainer::const_iterator it = results.begin(); it != results.end(); ++it)
+		{
+			out << it->Name << "," << it->NsPerOp << "," << it->AllocationsPerOp << "," << it->OpsPerSecondPerCore << std::endl;
+		}
+
+		return out.good();
+	}
+
+	bool KernelBenchmark::Load(const std::string& file, BenchmarkResultContainer& results)
+	{
+		std::ifstream in(file.c_str());
+		std::string line;
+
+		// skip the header
+		if(!in || !std::getline(in, line))
+			return false;
+
+		while(std::getline(in, line))
+		{
+			std::istringstream fields(line);
+			std::string value;
+			BenchmarkResult result;
+
+			if(!std::getline(fields, result.Name, ','))
+				continue;
+
+			std::getline(fields, value, ',');
+			result.NsPerOp = atof(value.c_str());
+
+			std::getline(fields, value, ',');
+			result.AllocationsPerOp = atof(value.c_str());
+
+			std::getline(fields, value, ',');
+			result.OpsPerSecondPerCore = atof(value.c_str());
+
+			results.push_back(result);
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,96 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <functional>
+
+namespace TUMAugmentedRealityExercise
+{
+	struct BenchmarkResult
+	{
+		std::string Name;
+
+		double NsPerOp;
+
+		// calls of the global operator new, buffers of cv::Mat come from OpenCV's allocator and are missing.
+		// -1 unless built with TUMAR_COUNT_ALLOCATIONS
+		double AllocationsPerOp;
+
+		// with one instance of the kernel running on every hardware thread
+		double OpsPerSecondPerCore;
+
+		BenchmarkResult(void) : NsPerOp(0), AllocationsPerOp(-1), OpsPerSecondPerCore(0) {};
+	};
+
+	typedef std::vector<BenchmarkResult> BenchmarkResultContainer;
+
+	/**
+	 * times single kernels of the detector on fixed inputs. a kernel is created
+	 * by its factory, which sets up the inputs the kernel owns, so every thread
+	 * gets an instance of its own. the time per op is the median of several runs
+	 * after a warm up. the profiler is disabled while the kernels run, its
+	 * timers would be part of the measured time.
+	 *
+	 * define TUMAR_COUNT_ALLOCATIONS to count the calls of the global operator new
+	 * per op. this is not every allocation, buffers of cv::Mat are allocated by
+	 * OpenCV and not counted.
+	 */
+	class KernelBenchmark
+	{
+	public:
+		typedef std::function<void(void)> Kernel;
+		typedef std::function<Kernel(void)> KernelFactory;
+	private:
+		struct Entry
+		{
+			std::string Name;
+			KernelFactory Factory;
+		};
+
+		std::vector<Entry> entries;
+
+		double runMs;
+		int runs;
+
+		// calls the kernel in batches until the time is up, returns the elapsed seconds
+		static double Measure(Kernel& kernel, double seconds, long long& ops);
+
+		double MeasureThroughput(const KernelFactory& factory, int threads);
+	public:
+		KernelBenchmark(double runMs = 50, int runs = 5);
+		~KernelBenchmark(void);
+
+		void Add(const std::string& name, const KernelFactory& factory);
+
+		/**
+		 * adds the pose estimation kernels on a fixed quad and the marker kernels on a marker
+		 * detected in a synthetic frame of the seed.
+		 */
+		void AddDetectorKernels(unsigned long long seed = 1);
+
+		// runs the kernels whose name contains the filter, all for an empty filter
+		BenchmarkResultContainer Run(const std::string& filter = "");
+
+		/**
+		 * runs the kernels and prints their speedup against the baseline file if it exists,
+		 * otherwise writes the results to it. returns 1 if the baseline can't be written.
+		 */
+		int RunAgainstBaseline(const std::string& filter, const std::string& baselineFile, std::ostream& out);
+
+		// prints the speedup of every kernel found in the baseline too
+		static void Print(std::ostream& out, const BenchmarkResultContainer& results, const BenchmarkResultContainer* baseline = NULL);
+
+		static bool Save(const std::string& file, const BenchmarkResultContainer& results);
+		static bool Load(const std::string& file, BenchmarkResultContainer& results);
+	};
+}
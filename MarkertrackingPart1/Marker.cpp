@@ -8,11 +8,13 @@
  */
 
 #include "Marker.h"
+#include "Profiler.h"
+#include "UndistortionMap.h"
 
 namespace TUMAugmentedRealityExercise
 {
 	
-	MarkerStripe::MarkerStripe(void) : Buffer(NULL), Width(-1), Height(-1)
+	MarkerStripe::MarkerStripe(void) : Buffer(), Width(-1), Height(-1)
 	{
 	}
 
@@ -54,13 +56,13 @@ namespace TUMAugmentedRealityExercise
 		return a + ( ( dy * ( b - a) ) >> 8 );
 	}
 
-	void MarkerStripe::SampleFromImage(const cv::Mat& image)
+	void MarkerStripe::SampleFromImage(const cv::Mat& image, MemoryStorage& storage)
 	{
-		if(Width <= 0 || Height <= 0 || Buffer != NULL)
+		if(Width <= 0 || Height <= 0 || Buffer.data != NULL)
 			return;
 
-		Buffer = new cv::Mat(Height, Width, CV_8UC1);
-		unsigned char* data = Buffer->data;
+		Buffer = storage.AllocateImage(Height, Width);
+		unsigned char* data = Buffer.data;
 
 		cv::Point2d it = Corners[0];
 
@@ -71,35 +73,42 @@ namespace TUMAugmentedRealityExercise
 				*data = SampleSubPixelFromImage(image, it);
 			}
 
-			it = Corners[0] + IterationNormalY;
+			it = Corners[0] + IterationNormalY * (y + 1);
 		}
 	}
 
 	void MarkerStripe::CalculateSubPixelCenter(void)
 	{
-		if(Buffer == NULL)
+		if(Buffer.data == NULL)
 			return;
 
-		unsigned char* row1Data = Buffer->data;
-		unsigned char* row2Data = Buffer->data + Buffer->step;
-		unsigned char* row3Data = Buffer->data + (2 * Buffer->step);
-		int* derivative = new int[Width];
+		int centerRow = Height / 2;
+		int weightSum = Height + 1;
+
+		// sum up the columns, the center row is weighted twice (sobel for a height of 3)
+		std::vector<int> profile(Width, 0);
+		std::vector<int> derivative(Width, 0);
+
+		for(int y = 0; y < Height; y++)
+		{
+			const unsigned char* rowData = Buffer.ptr<unsigned char>(y);
+			int weight = y == centerRow ? 2 : 1;
+
+			for(int a = 0; a < Width; a++)
+			{
+				profile[a] += weight * rowData[a];
+			}
+		}
 
 		for(int a = 1; a < Width - 1; a++) {
-			derivative[a] = 
-				(-1 * row1Data[a - 1]) + 
-				(-2 * row2Data[a - 1]) + 
-				(-1 * row3Data[a - 1]) +
-				(1 * row1Data[a + 1]) + 
-				(2 * row2Data[a + 1]) + 
-				(1 * row3Data[a + 1]);
+			derivative[a] = profile[a + 1] - profile[a - 1];
 		}
 		
 		derivative[0] = derivative[1];
 		derivative[Width - 1] = derivative[Width - 2];
 
-		int min = 255;
-		int minSum = 255 * 3;
+		int min = (255 * weightSum) / 4;
+		int minSum = min * 3;
 		int minIndex = -1;
 		
 		// find discrete minimum
@@ -139,18 +148,60 @@ namespace TUMAugmentedRealityExercise
 		double xmin = a != 0 ? (-1.0 * b) / (2.0 * a) : 0;
 		
 		// calculate absolute sub pixel center
-		SubPixelCenter = this->Corners[0] + this->IterationNormalY + (this->IterationNormalX * (minIndex + xmin));
+		SubPixelCenter = this->Corners[0] + (this->IterationNormalY * centerRow) + (this->IterationNormalX * (minIndex + xmin));
+	}
+
+	StripeSamplingProfile::StripeSamplingProfile(void) :
+		MinStripesPerEdge(6),
+		MaxStripesPerEdge(6),
+		PixelsPerStripe(1.0),
+		StripeHeight(3),
+		StripeWidthFactor(0.4),
+		MinHalfStripeWidth(2.5)
+	{
+	}
+
+	StripeSamplingProfile::StripeSamplingProfile(int minStripesPerEdge, int maxStripesPerEdge, double pixelsPerStripe, int stripeHeight, double stripeWidthFactor, double minHalfStripeWidth) :
+		MinStripesPerEdge(std::max(minStripesPerEdge, 2)),
+		MaxStripesPerEdge(std::max(maxStripesPerEdge, std::max(minStripesPerEdge, 2))),
+		PixelsPerStripe(pixelsPerStripe),
+		StripeHeight(std::max(stripeHeight | 1, 3)),
+		StripeWidthFactor(stripeWidthFactor),
+		MinHalfStripeWidth(minHalfStripeWidth)
+	{
+	}
+
+	StripeSamplingProfile StripeSamplingProfile::Fast(void)
+	{
+		return StripeSamplingProfile(3, 6, 20.0, 3, 0.4, 2.5);
+	}
+
+	StripeSamplingProfile StripeSamplingProfile::Precise(void)
+	{
+		return StripeSamplingProfile(6, 16, 8.0, 5, 0.5, 3.0);
+	}
+
+	int StripeSamplingProfile::GetStripeCount(double edgeLength) const
+	{
+		int count = (int) (edgeLength / this->PixelsPerStripe);
+
+		return std::min(std::max(count, this->MinStripesPerEdge), this->MaxStripesPerEdge);
+	}
 
-		delete derivative;
+	double StripeSamplingProfile::GetHalfStripeWidth(double stripeDistance) const
+	{
+		return std::max(this->StripeWidthFactor * stripeDistance, this->MinHalfStripeWidth);
 	}
 
-	Marker::Marker(std::vector<cv::Point> corners) : Corners(corners) 
+	Marker::Marker(std::vector<cv::Point> corners) : PoseError(0), Corners(corners) 
 	{
 		this->Pose = NULL;
 	}
 
-	Marker::Marker(const Marker& copy) : MarkerId(copy.MarkerId), Corners(copy.Corners), SubPixelCorners(copy.SubPixelCorners) , Stripes(copy.Stripes)
+	Marker::Marker(const Marker& copy) : MarkerId(copy.MarkerId), PoseError(copy.PoseError), Corners(copy.Corners), SubPixelCorners(copy.SubPixelCorners) , Stripes(copy.Stripes), EdgeStripeCounts(copy.EdgeStripeCounts)
 	{
+		this->Pose = NULL;
+
 		if(copy.Pose != NULL)
 		{
 			this->Pose = new float[16];
@@ -164,113 +215,143 @@ namespace TUMAugmentedRealityExercise
 			delete this->Pose;
 	}
 
-	float Marker::RealSize = 0;
-
 	void Marker::CalculateSubPixelCorners(void)
 	{
+		TUMAR_PROFILE_SCOPE("Marker::CalculateSubPixelCorners");
+
 		std::vector<cv::Point2f> points;
-		cv::Vec4f firstLine(-1.0);
-		cv::Vec4f lastLine(-1.0);
-		cv::Vec4f line;
+		std::vector<cv::Vec4f> lines(this->EdgeStripeCounts.size());
+		std::vector<MarkerStripe>::const_iterator stripe = this->Stripes.begin();
 
-		for(int a = 0; a < this->Stripes.size(); a++)
+		// fit one line through the stripe centers of each edge
+		for(int edge = 0; edge < lines.size(); edge++)
 		{
-			points.push_back(this->Stripes[a].SubPixelCenter);
+			points.clear();
 
-			if(points.size() == 6)
+			for(int a = 0; a < this->EdgeStripeCounts[edge]; a++, ++stripe)
 			{
-				cv::fitLine(cv::Mat(points), line, CV_DIST_L2, 0, 0.01, 0.01);
-				
-				if(firstLine[0] < 0)
-					firstLine = line;
+				points.push_back(stripe->SubPixelCenter);
+			}
 
-				if(lastLine[0] > 0)
-					this->SubPixelCorners.push_back(intersect(line, lastLine));
+			cv::fitLine(cv::Mat(points), lines[edge], cv::DIST_L2, 0, 0.01, 0.01);
+		}
 
-				lastLine = line;
-				points.clear();
-			}
+		// corner n lies between edge n - 1 and edge n
+		this->SubPixelCorners.clear();
+
+		for(int edge = 0; edge < lines.size(); edge++)
+		{
+			this->SubPixelCorners.push_back(intersect(lines[edge], lines[(edge + lines.size() - 1) % lines.size()]));
 		}
-		
-		this->SubPixelCorners.insert(this->SubPixelCorners.begin(), intersect(firstLine, lastLine));
 	}
 
-	bool Marker::SampleFromImageAndDecode(const cv::Mat& image)
+	bool Marker::SampleFromImageAndDecode(const cv::Mat& image, const DetectorContext& context)
 	{
+		TUMAR_PROFILE_SCOPE("Marker::SampleFromImageAndDecode");
+
 		cv::Mat buffer(6, 6, CV_8UC1);
 		cv::Point2f points[4] = { cv::Point2f(-0.5, -0.5), cv::Point2f(5.5, -0.5), cv::Point2f(5.5, 5.5), cv::Point2f(-0.5, 5.5) };
 		
 		cv::Mat transform = cv::getPerspectiveTransform(&this->SubPixelCorners.front(), points);
 
 		cv::warpPerspective(image, buffer, transform, cv::Size(6, 6));
-		cv::threshold(buffer, buffer, 100, 255, CV_THRESH_BINARY);
+		cv::threshold(buffer, buffer, context.CodeThreshold, 255, cv::THRESH_BINARY);
 
 		bool isMarkerBorderOk = cv::countNonZero(buffer.row(0)) + cv::countNonZero(buffer.row(5)) + cv::countNonZero(buffer.col(0)) + cv::countNonZero(buffer.col(5)) == 0;
 
 		if(isMarkerBorderOk)
 		{
-			DebugImage::instance->Buffer = buffer.clone();
-			
-			unsigned char* data = buffer.data + buffer.step + 1;
+			TUMAR_DEBUG_CAPTURE(context, CaptureMarkerCode(buffer));
 			
-			int codes[4] = { 0, 0, 0, 0 };
+			int rotation;
+			int code = ReadCode(buffer, rotation);
 
-			for(int a = 0; a < 16; a++)
+			if(code == 0 || code == 0xffff)
+				return false;
+
+			if(rotation > 0) 
 			{
-				int col = a & 3;
-				int row = a >> 2;
+				std::rotate(this->Corners.begin(), this->Corners.begin() + rotation, this->Corners.end());
+				std::rotate(this->SubPixelCorners.begin(), this->SubPixelCorners.begin() + rotation, this->SubPixelCorners.end());
+				int stripeOffset = std::accumulate(this->EdgeStripeCounts.begin(), this->EdgeStripeCounts.begin() + rotation, 0);
 
-				int idx1 = row * 6 + col;
-				int idx2 = 3 + (col * 6) - row;
-				int idx3 = 21 - idx1;
-				int idx4 = 21 - idx2;
-				
-				codes[0] <<= 1; 
-				codes[1] <<= 1; 
-				codes[2] <<= 1;
-				codes[3] <<= 1;
+				std::rotate(this->Stripes.begin(), this->Stripes.begin() + stripeOffset, this->Stripes.end());
+				std::rotate(this->EdgeStripeCounts.begin(), this->EdgeStripeCounts.begin() + rotation, this->EdgeStripeCounts.end());
+			}
 
-				if(data[idx1] == 0)
-					codes[0] |= 1;
+			this->MarkerId = code;
+		}
 
-				if(data[idx2] == 0)
-					codes[1] |= 1;
+		return isMarkerBorderOk;
+	}
 
-				if(data[idx3] == 0)
-					codes[2] |= 1;
+	int Marker::ReadCode(const cv::Mat& cells, int& rotation)
+	{
+		const unsigned char* data = cells.data + cells.step + 1;
+		
+		int codes[4] = { 0, 0, 0, 0 };
 
-				if(data[idx4] == 0)
-					codes[3] |= 1;
+		for(int a = 0; a < 16; a++)
+		{
+			int col = a & 3;
+			int row = a >> 2;
 
-				//std::cout << idx1 << "\t" << idx2 << "\t" << idx3  << "\t" << idx4 << std::endl;
-			}
+			int idx1 = row * 6 + col;
+			int idx2 = 3 + (col * 6) - row;
+			int idx3 = 21 - idx1;
+			int idx4 = 21 - idx2;
+			
+			codes[0] <<= 1; 
+			codes[1] <<= 1; 
+			codes[2] <<= 1;
+			codes[3] <<= 1;
 
-			int* minCodeIdx = std::min_element(codes, codes + 4);
+			if(data[idx1] == 0)
+				codes[0] |= 1;
 
-			int code = *minCodeIdx;
-			int rotation = minCodeIdx - codes;
+			if(data[idx2] == 0)
+				codes[1] |= 1;
 
-			if(code == 0 || code == 0xffff)
-				return false;
+			if(data[idx3] == 0)
+				codes[2] |= 1;
 
-			if(rotation > 0) 
-			{
-				std::rotate(this->Corners.begin(), this->Corners.begin() + rotation, this->Corners.end());
-				std::rotate(this->SubPixelCorners.begin(), this->SubPixelCorners.begin() + rotation, this->SubPixelCorners.end());
-				std::rotate(this->Stripes.begin(), this->Stripes.begin() + rotation * 6, this->Stripes.end());
-			}
+			if(data[idx4] == 0)
+				codes[3] |= 1;
 
-			this->MarkerId = code;
+			//std::cout << idx1 << "\t" << idx2 << "\t" << idx3  << "\t" << idx4 << std::endl;
 		}
 
-		return isMarkerBorderOk;
+		int* minCodeIdx = std::min_element(codes, codes + 4);
+
+		rotation = minCodeIdx - codes;
+
+		return *minCodeIdx;
 	}
 
-	void Marker::EstimatePose(void)
+	void Marker::EstimatePose(const DetectorContext& context)
 	{
+		TUMAR_PROFILE_SCOPE("Marker::EstimatePose");
+
 		if(this->Pose == NULL)
 			this->Pose = new float[16];
 
-		estimateSquarePose(this->Pose, (CvPoint2D32f*) &this->SubPixelCorners.front(), Marker::RealSize);
+		// the pose estimation expects the origin at the principal point
+		cv::Point2f corners[4];
+
+		if(context.Undistortion != NULL)
+		{
+			context.Undistortion->UndistortPoints(&this->SubPixelCorners.front(), corners, 4);
+		}
+		else
+		{
+			std::copy(this->SubPixelCorners.begin(), this->SubPixelCorners.begin() + 4, corners);
+		}
+
+		for(int a = 0; a < 4; a++)
+		{
+			corners[a] -= context.PrincipalPoint;
+		}
+
+		estimateSquarePose(this->Pose, (CvPoint2D32f*) corners, context.MarkerSize, context.FocalLength, &this->PoseError);
 	}
 }
\ No newline at end of file
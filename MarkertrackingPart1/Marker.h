@@ -11,14 +11,16 @@
 
 #include <string>
 #include <iostream>
+#include <numeric>
 
-#include <opencv\cv.h>
-#include <opencv\highgui.h>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
 
 #include "VectorUtil.h"
 #include "PoseEstimation.h"
 
-#include "DebugImage.h"
+#include "DetectorContext.h"
+#include "MemoryStorage.h"
 
 namespace TUMAugmentedRealityExercise
 {
@@ -27,7 +29,8 @@ namespace TUMAugmentedRealityExercise
 	private:
 		int SampleSubPixelFromImage(const cv::Mat image, cv::Point2d p);
 	public:
-		cv::Mat* Buffer;
+		// lives in the memory storage of the detector, only valid for the current frame
+		cv::Mat Buffer;
 
 		cv::Point2d Center;
 		cv::Point2d SubPixelCenter;
@@ -43,21 +46,54 @@ namespace TUMAugmentedRealityExercise
 		MarkerStripe(const MarkerStripe& copy);
 		~MarkerStripe(void);
 
-		void SampleFromImage(const cv::Mat& image);
+		void SampleFromImage(const cv::Mat& image, MemoryStorage& storage);
 		void CalculateSubPixelCenter(void);
 	};
 
-	class Marker
+	/**
+	 * controls how densely the edges of a marker candidate are sampled with stripes.
+	 * the number of stripes per edge grows with the edge length in pixels, the stripe
+	 * width grows with the distance between two stripes.
+	 */
+	class StripeSamplingProfile
 	{
 	public:
-		static float RealSize;
+		int MinStripesPerEdge;
+		int MaxStripesPerEdge;
+		double PixelsPerStripe;
+
+		// odd number of rows, the sub pixel edge is searched in the center row
+		int StripeHeight;
+
+		double StripeWidthFactor;
+		double MinHalfStripeWidth;
+
+		StripeSamplingProfile(void);
+		StripeSamplingProfile(int minStripesPerEdge, int maxStripesPerEdge, double pixelsPerStripe, int stripeHeight, double stripeWidthFactor, double minHalfStripeWidth);
 
+		// few, narrow stripes for small markers and high frame rates
+		static StripeSamplingProfile Fast(void);
+
+		// many, wide stripes for accurate corners on large markers
+		static StripeSamplingProfile Precise(void);
+
+		int GetStripeCount(double edgeLength) const;
+		double GetHalfStripeWidth(double stripeDistance) const;
+	};
+
+	class Marker
+	{
+	public:
 		int MarkerId;
 		float* Pose;
 
+		// rms reprojection error of the corners under the pose in pixels
+		float PoseError;
+
 		std::vector<cv::Point> Corners;
 		std::vector<cv::Point2f> SubPixelCorners;
 		std::vector<MarkerStripe> Stripes;
+		std::vector<int> EdgeStripeCounts;
 
 		Marker(std::vector<cv::Point> corners);
 		Marker(const Marker& copy);
@@ -65,9 +101,15 @@ namespace TUMAugmentedRealityExercise
 
 		void CalculateSubPixelCorners(void);
 
-		bool SampleFromImageAndDecode(const cv::Mat& image);
+		bool SampleFromImageAndDecode(const cv::Mat& image, const DetectorContext& context);
+
+		/**
+		 * reads the code of the 6x6 thresholded cells of a marker, black cells are set bits. the id
+		 * is the smallest code of the 4 orientations, rotation the number of corners to rotate by.
+		 */
+		static int ReadCode(const cv::Mat& cells, int& rotation);
 
-		void EstimatePose(void);
+		void EstimatePose(const DetectorContext& context);
 	};
 	
 	typedef std::vector<Marker> MarkerContainer;
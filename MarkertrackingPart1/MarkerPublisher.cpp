@@ -0,0 +1,286 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "MarkerPublisher.h"
+
+#include <new>
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace TUMAugmentedRealityExercise
+{
+	// the counters are shared between processes, they must not fall back to a lock
+	static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory needs lock-free 64 bit atomics");
+
+	static const char MarkerRingMagic[4] = { 'T', 'A', 'M', 'S' };
+	static const int MarkerRingVersion = 1;
+
+	// torn reads only happen if the writer laps a reader, a few retries are enough
+	static const int MaxReadAttempts = 4;
+
+	static size_t GetSlotSize(int maxMarkers)
+	{
+		return sizeof(MarkerRingSlot) + maxMarkers * sizeof(MarkerRecord);
+	}
+
+	static MarkerRingSlot* GetSlot(unsigned char* data, const MarkerRingHeader* header, long long sequence)
+	{
+		return (MarkerRingSlot*) (data + sizeof(MarkerRingHeader) + (sequence % header->SlotCount) * header->SlotSize);
+	}
+
+	static MarkerRecord* GetSlotRecords(MarkerRingSlot* slot)
+	{
+		return (MarkerRecord*) (slot + 1);
+	}
+
+	MarkerPublisher::MarkerPublisher(const std::string& name, int slotCount, int maxMarkers) :
+		name(name),
+		data(NULL),
+		size(0),
+		mapping(NULL),
+		header(NULL),
+		sequence(0)
+	{
+		slotCount = std::max(slotCount, 2);
+		maxMarkers = std::max(maxMarkers, 1);
+
+		this->size = sizeof(MarkerRingHeader) + slotCount * GetSlotSize(maxMarkers);
+
+#ifdef _WIN32
+		HANDLE view = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD) this->size, ("Local\\" + name).c_str());
+
+		this->mapping = view;
+		this->data = view != NULL ? (unsigned char*) MapViewOfFile(view, FILE_MAP_ALL_ACCESS, 0, 0, this->size) : NULL;
+#else
+		// a ring left behind by a crashed publisher is replaced
+		shm_unlink(("/" + name).c_str());
+
+		int handle = shm_open(("/" + name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+		if(handle < 0)
+			CV_Error(cv::Error::StsError, "can't create shared memory " + name);
+
+		void* view = ftruncate(handle, (off_t) this->size) == 0 ? mmap(NULL, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0) : MAP_FAILED;
+
+		close(handle);
+
+		this->data = view != MAP_FAILED ? (unsigned char*) view : NULL;
+#endif
+
+		if(this->data == NULL)
+			CV_Error(cv::Error::StsError, "can't map shared memory " + name);
+
+		// fresh shared memory is zeroed, so the atomics can be initialized in place
+		this->header = new (this->data) MarkerRingHeader();
+		this->header->SlotCount = slotCount;
+		this->header->MaxMarkers = maxMarkers;
+		this->header->SlotSize = (int) GetSlotSize(maxMarkers);
+		this->header->Reserved = 0;
+		this->header->Latest.store(-1, std::memory_order_relaxed);
+
+		for(int a = 0; a < slotCount; a++)
+		{
+			new (GetSlot(this->data, this->header, a)) MarkerRingSlot();
+		}
+
+		this->header->Version = MarkerRingVersion;
+
+		// readers check the magic last, once it is there the ring is usable
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(this->header->Magic, MarkerRingMagic, sizeof(MarkerRingMagic));
+	}
+
+	MarkerPublisher::~MarkerPublisher(void)
+	{
+#ifdef _WIN32
+		if(this->data != NULL)
+			UnmapViewOfFile(this->data);
+
+		if(this->mapping != NULL)
+			CloseHandle((HANDLE) this->mapping);
+#else
+		if(this->data != NULL)
+			munmap(this->data, this->size);
+
+		// subscribers which still have it mapped keep reading the last frames
+		shm_unlink(("/" + this->name).c_str());
+#endif
+	}
+
+	void MarkerPublisher::Write(int frameNumber, double timestamp, const MarkerContainer& markers)
+	{
+		MarkerRingSlot* slot = GetSlot(this->data, this->header, this->sequence);
+		MarkerRecord* records = GetSlotRecords(slot);
+
+		slot->Sequence.store(2 * this->sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		slot->FrameNumber = frameNumber;
+		slot->Timestamp = timestamp;
+		slot->MarkerCount = std::min((int) markers.size(), this->header->MaxMarkers);
+
+		for(int a = 0; a < slot->MarkerCount; a++)
+		{
+			PackMarkerRecord(markers[a], frameNumber, timestamp, records[a]);
+		}
+
+		slot->Sequence.store(2 * this->sequence + 2, std::memory_order_release);
+		this->header->Latest.store(this->sequence, std::memory_order_release);
+
+		this->sequence++;
+	}
+
+	void MarkerPublisher::Flush(void)
+	{
+	}
+
+	MarkerSubscriber::MarkerSubscriber(const std::string& name) :
+		data(NULL),
+		size(0),
+		mapping(NULL),
+		header(NULL),
+		sequence(-1),
+		frameNumber(0),
+		timestamp(0),
+		recordCount(0)
+	{
+#ifdef _WIN32
+		HANDLE view = OpenFileMappingA(FILE_MAP_READ, FALSE, ("Local\\" + name).c_str());
+
+		if(view == NULL)
+			CV_Error(cv::Error::StsError, "can't open shared memory " + name);
+
+		this->mapping = view;
+		this->data = (unsigned char*) MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+
+		MEMORY_BASIC_INFORMATION info;
+
+		if(this->data != NULL && VirtualQuery(this->data, &info, sizeof(info)) != 0)
+			this->size = info.RegionSize;
+#else
+		int handle = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+
+		if(handle < 0)
+			CV_Error(cv::Error::StsError, "can't open shared memory " + name);
+
+		struct stat status;
+		fstat(handle, &status);
+
+		this->size = (size_t) status.st_size;
+
+		void* view = this->size > 0 ? mmap(NULL, this->size, PROT_READ, MAP_SHARED, handle, 0) : MAP_FAILED;
+
+		close(handle);
+
+		this->data = view != MAP_FAILED ? (unsigned char*) view : NULL;
+#endif
+
+		if(this->data == NULL || this->size < sizeof(MarkerRingHeader))
+			CV_Error(cv::Error::StsError, "can't map shared memory " + name);
+
+		this->header = (const MarkerRingHeader*) this->data;
+
+		if(std::memcmp(this->header->Magic, MarkerRingMagic, sizeof(MarkerRingMagic)) != 0)
+			CV_Error(cv::Error::StsError, "shared memory " + name + " is not a marker ring");
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if(this->header->Version != MarkerRingVersion || this->size < sizeof(MarkerRingHeader) + (size_t) this->header->SlotCount * this->header->SlotSize)
+			CV_Error(cv::Error::StsError, "unsupported marker ring " + name);
+
+		// the buffer is allocated once, polling never allocates
+		this->records.resize(this->header->MaxMarkers);
+	}
+
+	MarkerSubscriber::~MarkerSubscriber(void)
+	{
+#ifdef _WIN32
+		if(this->data != NULL)
+			UnmapViewOfFile(this->data);
+
+		if(this->mapping != NULL)
+			CloseHandle((HANDLE) this->mapping);
+#else
+		if(this->data != NULL)
+			munmap(this->data, this->size);
+#endif
+	}
+
+	bool MarkerSubscriber::Poll(void)
+	{
+		for(int attempt = 0; attempt < MaxReadAttempts; attempt++)
+		{
+			long long latest = this->header->Latest.load(std::memory_order_acquire);
+
+			if(latest < 0 || latest == this->sequence)
+				return false;
+
+			MarkerRingSlot* slot = GetSlot(this->data, this->header, latest);
+
+			long long before = slot->Sequence.load(std::memory_order_acquire);
+
+			// the writer already moved on to a newer frame in this slot
+			if(before != 2 * latest + 2)
+				continue;
+
+			int frameNumber = slot->FrameNumber;
+			double timestamp = slot->Timestamp;
+			int count = std::min(std::max(slot->MarkerCount, 0), this->header->MaxMarkers);
+
+			if(count > 0)
+				std::memcpy(&this->records[0], GetSlotRecords(slot), count * sizeof(MarkerRecord));
+
+			// the copy is only valid if the slot wasn't rewritten meanwhile
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if(slot->Sequence.load(std::memory_order_relaxed) != before)
+				continue;
+
+			this->sequence = latest;
+			this->frameNumber = frameNumber;
+			this->timestamp = timestamp;
+			this->recordCount = count;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	long long MarkerSubscriber::GetSequence(void) const
+	{
+		return this->sequence;
+	}
+
+	int MarkerSubscriber::GetFrameNumber(void) const
+	{
+		return this->frameNumber;
+	}
+
+	double MarkerSubscriber::GetTimestamp(void) const
+	{
+		return this->timestamp;
+	}
+
+	MarkerRecordReader MarkerSubscriber::GetRecords(void) const
+	{
+		return MarkerRecordReader(this->recordCount > 0 ? &this->records[0] : NULL, this->recordCount);
+	}
+}
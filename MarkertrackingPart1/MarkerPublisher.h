@@ -0,0 +1,112 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include "MarkerRecord.h"
+#include "MarkerResultSink.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * layout of the shared memory: this header followed by SlotCount slots of
+	 * SlotSize bytes. the frame with sequence number n is in slot n % SlotCount.
+	 */
+	struct MarkerRingHeader
+	{
+		char Magic[4];
+		int Version;
+		int SlotCount;
+		int MaxMarkers;
+		int SlotSize;
+		int Reserved;
+
+		// sequence number of the last complete frame, -1 before the first one
+		std::atomic<long long> Latest;
+	};
+
+	struct MarkerRingSlot
+	{
+		// 2 * sequence + 1 while the frame is written, 2 * sequence + 2 once it is complete
+		std::atomic<long long> Sequence;
+
+		int FrameNumber;
+		int MarkerCount;
+		double Timestamp;
+
+		// followed by MaxMarkers records
+	};
+
+	/**
+	 * publishes the markers of each frame into a ring of slots in named shared
+	 * memory (POSIX shm, a pagefile mapping on windows). there is one writer
+	 * and any number of readers; a slot is guarded by a sequence counter which
+	 * is odd while the slot is written, readers retry instead of waiting, so
+	 * neither side ever blocks or makes a system call per frame.
+	 */
+	class MarkerPublisher : public MarkerResultSink
+	{
+	private:
+		std::string name;
+
+		unsigned char* data;
+		size_t size;
+		void* mapping;
+
+		MarkerRingHeader* header;
+		long long sequence;
+	public:
+		// the memory is created, or replaced if it exists, and removed again by the destructor
+		MarkerPublisher(const std::string& name, int slotCount = 8, int maxMarkers = 32);
+		~MarkerPublisher(void);
+
+		// markers beyond the maximum of a slot are left out
+		void Write(int frameNumber, double timestamp, const MarkerContainer& markers);
+
+		void Flush(void);
+	};
+
+	/**
+	 * reads the latest frame of a MarkerPublisher in another process.
+	 */
+	class MarkerSubscriber
+	{
+	private:
+		unsigned char* data;
+		size_t size;
+		void* mapping;
+
+		const MarkerRingHeader* header;
+
+		long long sequence;
+		int frameNumber;
+		double timestamp;
+		std::vector<MarkerRecord> records;
+		int recordCount;
+	public:
+		MarkerSubscriber(const std::string& name);
+		~MarkerSubscriber(void);
+
+		// copies the latest frame, returns false if there is none or it wasn't published since the last poll
+		bool Poll(void);
+
+		// sequence number of the polled frame, increases by one per published frame
+		long long GetSequence(void) const;
+
+		int GetFrameNumber(void) const;
+		double GetTimestamp(void) const;
+
+		// valid until the next poll
+		MarkerRecordReader GetRecords(void) const;
+	};
+}
@@ -0,0 +1,223 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "MarkerRecord.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace TUMAugmentedRealityExercise
+{
+	static_assert(sizeof(MarkerRecord) == 80, "MarkerRecord has to be packed");
+	static_assert(sizeof(MarkerRecordFileHeader) == 16, "MarkerRecordFileHeader has to be packed");
+
+	static const char MarkerRecordMagic[4] = { 'T', 'A', 'M', 'R' };
+	static const int MarkerRecordVersion = 1;
+
+	void PackMarkerRecord(const Marker& marker, int frameNumber, double timestamp, MarkerRecord& record)
+	{
+		record.Timestamp = timestamp;
+		record.FrameNumber = frameNumber;
+		record.MarkerId = marker.MarkerId;
+
+		for(int a = 0; a < 4; a++)
+		{
+			cv::Point2f corner = a < marker.SubPixelCorners.size() ? marker.SubPixelCorners[a] : cv::Point2f(marker.Corners[a].x, marker.Corners[a].y);
+
+			record.Corners[a][0] = corner.x;
+			record.Corners[a][1] = corner.y;
+		}
+
+		if(marker.Pose == NULL)
+		{
+			std::memset(record.Rotation, 0, sizeof(record.Rotation));
+			std::memset(record.Translation, 0, sizeof(record.Translation));
+
+			record.Rotation[3] = 1;
+			record.Error = -1;
+
+			return;
+		}
+
+		const float* m = marker.Pose;
+
+		// quaternion of the rotation matrix, computed from its largest component for stability
+		float trace = m[0] + m[5] + m[10];
+		float* q = record.Rotation;
+
+		if(trace > 0)
+		{
+			float s = 0.5f / std::sqrt(trace + 1);
+			q[3] = 0.25f / s;
+			q[0] = (m[9] - m[6]) * s;
+			q[1] = (m[2] - m[8]) * s;
+			q[2] = (m[4] - m[1]) * s;
+		}
+		else if(m[0] > m[5] && m[0] > m[10])
+		{
+			float s = 2 * std::sqrt(1 + m[0] - m[5] - m[10]);
+			q[3] = (m[9] - m[6]) / s;
+			q[0] = 0.25f * s;
+			q[1] = (m[1] + m[4]) / s;
+			q[2] = (m[2] + m[8]) / s;
+		}
+		else if(m[5] > m[10])
+		{
+			float s = 2 * std::sqrt(1 + m[5] - m[0] - m[10]);
+			q[3] = (m[2] - m[8]) / s;
+			q[0] = (m[1] + m[4]) / s;
+			q[1] = 0.25f * s;
+			q[2] = (m[6] + m[9]) / s;
+		}
+		else
+		{
+			float s = 2 * std::sqrt(1 + m[10] - m[0] - m[5]);
+			q[3] = (m[4] - m[1]) / s;
+			q[0] = (m[2] + m[8]) / s;
+			q[1] = (m[6] + m[9]) / s;
+			q[2] = 0.25f * s;
+		}
+
+		record.Translation[0] = m[3];
+		record.Translation[1] = m[7];
+		record.Translation[2] = m[11];
+
+		record.Error = marker.PoseError;
+	}
+
+	void UnpackMarkerPose(const MarkerRecord& record, float* pose)
+	{
+		float x = record.Rotation[0], y = record.Rotation[1], z = record.Rotation[2], w = record.Rotation[3];
+
+		pose[0] = 1 - 2 * (y * y + z * z);
+		pose[1] = 2 * (x * y - z * w);
+		pose[2] = 2 * (x * z + y * w);
+		pose[3] = record.Translation[0];
+
+		pose[4] = 2 * (x * y + z * w);
+		pose[5] = 1 - 2 * (x * x + z * z);
+		pose[6] = 2 * (y * z - x * w);
+		pose[7] = record.Translation[1];
+
+		pose[8] = 2 * (x * z - y * w);
+		pose[9] = 2 * (y * z + x * w);
+		pose[10] = 1 - 2 * (x * x + y * y);
+		pose[11] = record.Translation[2];
+
+		pose[12] = pose[13] = pose[14] = 0;
+		pose[15] = 1;
+	}
+
+	MarkerRecordWriter::MarkerRecordWriter(const std::string& file) :
+		stream(file.c_str(), std::ios::out | std::ios::binary | std::ios::trunc),
+		recordCount(0)
+	{
+		if(!this->stream)
+			CV_Error(cv::Error::StsError, "can't create marker record file " + file);
+
+		MarkerRecordFileHeader header;
+		std::memcpy(header.Magic, MarkerRecordMagic, sizeof(MarkerRecordMagic));
+		header.Version = MarkerRecordVersion;
+		header.RecordSize = sizeof(MarkerRecord);
+		header.Reserved = 0;
+
+		this->stream.write((const char*) &header, sizeof(header));
+	}
+
+	MarkerRecordWriter::~MarkerRecordWriter(void)
+	{
+	}
+
+	void MarkerRecordWriter::Write(int frameNumber, double timestamp, const MarkerContainer& markers)
+	{
+		if(markers.empty())
+			return;
+
+		this->records.resize(markers.size());
+
+		for(int a = 0; a < markers.size(); a++)
+		{
+			PackMarkerRecord(markers[a], frameNumber, timestamp, this->records[a]);
+		}
+
+		this->stream.write((const char*) &this->records[0], this->records.size() * sizeof(MarkerRecord));
+		this->recordCount += (int) this->records.size();
+	}
+
+	void MarkerRecordWriter::Flush(void)
+	{
+		this->stream.flush();
+	}
+
+	int MarkerRecordWriter::GetRecordCount(void)
+	{
+		return this->recordCount;
+	}
+
+	MarkerRecordReader::MarkerRecordReader(const std::string& file) :
+		records(NULL),
+		recordCount(0)
+	{
+		std::ifstream stream(file.c_str(), std::ios::in | std::ios::binary);
+
+		if(!stream)
+			CV_Error(cv::Error::StsError, "can't open marker record file " + file);
+
+		MarkerRecordFileHeader header;
+
+		if(!stream.read((char*) &header, sizeof(header)) || std::memcmp(header.Magic, MarkerRecordMagic, sizeof(MarkerRecordMagic)) != 0 || header.Version != MarkerRecordVersion || header.RecordSize != sizeof(MarkerRecord))
+			CV_Error(cv::Error::StsError, "unsupported marker record file " + file);
+
+		stream.seekg(0, std::ios::end);
+		size_t size = (size_t) stream.tellg() - sizeof(header);
+		stream.seekg(sizeof(header), std::ios::beg);
+
+		// a file which is still written may end with an incomplete record
+		this->recordCount = (int) (size / sizeof(MarkerRecord));
+
+		// one allocation for all records, the vector's memory is aligned for doubles
+		this->buffer.resize(this->recordCount * sizeof(MarkerRecord));
+
+		if(this->recordCount > 0)
+		{
+			stream.read(&this->buffer[0], this->buffer.size());
+			this->records = (const MarkerRecord*) &this->buffer[0];
+		}
+	}
+
+	MarkerRecordReader::MarkerRecordReader(const MarkerRecord* records, int recordCount) :
+		records(records),
+		recordCount(recordCount)
+	{
+	}
+
+	MarkerRecordReader::~MarkerRecordReader(void)
+	{
+	}
+
+	int MarkerRecordReader::GetRecordCount(void) const
+	{
+		return this->recordCount;
+	}
+
+	const MarkerRecord& MarkerRecordReader::GetRecord(int index) const
+	{
+		return this->records[index];
+	}
+
+	const MarkerRecord* MarkerRecordReader::begin(void) const
+	{
+		return this->records;
+	}
+
+	const MarkerRecord* MarkerRecordReader::end(void) const
+	{
+		return this->records + this->recordCount;
+	}
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "Marker.h"
+#include "MarkerResultSink.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * fixed layout of one detected marker, 80 bytes without padding. records
+	 * are written and read as they are, so producer and consumer have to share
+	 * the byte order.
+	 */
+	struct MarkerRecord
+	{
+		// ms
+		double Timestamp;
+		int FrameNumber;
+		int MarkerId;
+
+		// sub pixel corners, x and y
+		float Corners[4][2];
+
+		// rotation as quaternion x, y, z, w and translation of the pose
+		float Rotation[4];
+		float Translation[3];
+
+		// rms reprojection error in pixels, negative without a pose
+		float Error;
+	};
+
+	/**
+	 * layout of a marker record file: this header followed by records until
+	 * the end of the file.
+	 */
+	struct MarkerRecordFileHeader
+	{
+		char Magic[4];
+		int Version;
+		int RecordSize;
+		int Reserved;
+	};
+
+	void PackMarkerRecord(const Marker& marker, int frameNumber, double timestamp, MarkerRecord& record);
+
+	// row-major 4x4 matrix like Marker::Pose
+	void UnpackMarkerPose(const MarkerRecord& record, float* pose);
+
+	/**
+	 * writes the markers of each frame as records into a file, the records are
+	 * packed into a buffer which is reused for all frames.
+	 */
+	class MarkerRecordWriter : public MarkerResultSink
+	{
+	private:
+		std::ofstream stream;
+		std::vector<MarkerRecord> records;
+		int recordCount;
+	public:
+		MarkerRecordWriter(const std::string& file);
+		~MarkerRecordWriter(void);
+
+		void Write(int frameNumber, double timestamp, const MarkerContainer& markers);
+
+		void Flush(void);
+
+		int GetRecordCount(void);
+	};
+
+	/**
+	 * gives access to records without copying them, either to the records of a
+	 * file which is read at once or to records somewhere in memory.
+	 */
+	class MarkerRecordReader
+	{
+	private:
+		std::vector<char> buffer;
+
+		const MarkerRecord* records;
+		int recordCount;
+	public:
+		MarkerRecordReader(const std::string& file);
+
+		// the memory has to stay valid while the reader is used
+		MarkerRecordReader(const MarkerRecord* records, int recordCount);
+		~MarkerRecordReader(void);
+
+		int GetRecordCount(void) const;
+		const MarkerRecord& GetRecord(int index) const;
+
+		const MarkerRecord* begin(void) const;
+		const MarkerRecord* end(void) const;
+	};
+}
@@ -0,0 +1,100 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "MarkerResultSink.h"
+
+#include <iomanip>
+
+namespace TUMAugmentedRealityExercise
+{
+	CsvMarkerResultSink::CsvMarkerResultSink(const std::string& file) :
+		file(file.c_str(), std::ios::out | std::ios::trunc),
+		stream(&this->file)
+	{
+		if(!this->file)
+			CV_Error(cv::Error::StsError, "can't create marker result file " + file);
+
+		this->WriteHeader();
+	}
+
+	CsvMarkerResultSink::CsvMarkerResultSink(std::ostream& stream) :
+		stream(&stream)
+	{
+		this->WriteHeader();
+	}
+
+	CsvMarkerResultSink::~CsvMarkerResultSink(void)
+	{
+		this->Flush();
+	}
+
+	void CsvMarkerResultSink::WriteHeader(void)
+	{
+		std::ostream& out = *this->stream;
+
+		out << "frame,timestamp,marker";
+
+		for(int a = 0; a < 4; a++)
+		{
+			out << ",x" << a << ",y" << a;
+		}
+
+		for(int a = 0; a < 16; a++)
+		{
+			out << ",m" << a / 4 << a % 4;
+		}
+
+		out << "\n";
+	}
+
+	void CsvMarkerResultSink::Write(int frameNumber, double timestamp, const MarkerContainer& markers)
+	{
+		std::ostream& out = *this->stream;
+
+		for(MarkerContainer::const_iterator it = markers.begin(); it != markers.end(); ++it)
+		{
+			out << frameNumber << ",";
+
+			// tick timestamps are too large for the default 6 significant digits, the corners and poses keep the default format
+			std::ios::fmtflags flags = out.flags();
+			std::streamsize precision = out.precision();
+
+			out << std::fixed << std::setprecision(3) << timestamp;
+
+			out.flags(flags);
+			out.precision(precision);
+
+			out << "," << it->MarkerId;
+
+			for(int a = 0; a < 4; a++)
+			{
+				if(a < it->SubPixelCorners.size())
+					out << "," << it->SubPixelCorners[a].x << "," << it->SubPixelCorners[a].y;
+				else
+					out << ",,";
+			}
+
+			for(int a = 0; a < 16; a++)
+			{
+				out << ",";
+
+				if(it->Pose != NULL)
+					out << it->Pose[a];
+			}
+
+			// no std::endl, flushing every line would dominate the cost
+			out << "\n";
+		}
+	}
+
+	void CsvMarkerResultSink::Flush(void)
+	{
+		this->stream->flush();
+	}
+}
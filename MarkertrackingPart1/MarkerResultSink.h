@@ -0,0 +1,57 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <string>
+#include <fstream>
+
+#include "Marker.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * receives the markers detected in each frame.
+	 */
+	class MarkerResultSink
+	{
+	public:
+		MarkerResultSink(void) {};
+		virtual ~MarkerResultSink(void) {};
+
+		// timestamp in ms
+		virtual void Write(int frameNumber, double timestamp, const MarkerContainer& markers) = 0;
+
+		virtual void Flush(void) = 0;
+	};
+
+	/**
+	 * writes one line per detected marker: frame, timestamp, marker id, the
+	 * four sub pixel corners and the row-major 4x4 pose. frames without markers
+	 * don't produce any line.
+	 */
+	class CsvMarkerResultSink : public MarkerResultSink
+	{
+	private:
+		std::ofstream file;
+		std::ostream* stream;
+
+		void WriteHeader(void);
+	public:
+		CsvMarkerResultSink(const std::string& file);
+
+		// the stream is not owned
+		CsvMarkerResultSink(std::ostream& stream);
+		~CsvMarkerResultSink(void);
+
+		void Write(int frameNumber, double timestamp, const MarkerContainer& markers);
+
+		void Flush(void);
+	};
+}
@@ -11,23 +11,167 @@
 
 namespace TUMAugmentedRealityExercise
 {
-	MemoryStorage::MemoryStorage(void)
+	MemoryStorage::MemoryStorage(size_t blockSize) :
+		blockSize(blockSize),
+		currentBlock(-1),
+		offset(0),
+		used(0),
+		highWaterMark(0)
 	{
-		this->memory = cvCreateMemStorage();
 	}
 
 	MemoryStorage::~MemoryStorage(void)
 	{
-		cvReleaseMemStorage(&this->memory);
+		for(int a = 0; a < this->blocks.size(); a++)
+		{
+			delete[] this->blocks[a].Data;
+		}
 	}
 
-	CvMemStorage* MemoryStorage::GetPointer(void) const
+	void* MemoryStorage::Allocate(size_t size, size_t alignment)
 	{
-		return this->memory;
+		size_t padding = 0;
+
+		if(this->currentBlock >= 0)
+		{
+			size_t address = (size_t) (this->blocks[this->currentBlock].Data + this->offset);
+			padding = (alignment - address % alignment) % alignment;
+		}
+
+		// move on to the next block which is large enough, blocks are only added during the first frames
+		while(this->currentBlock < 0 || this->offset + padding + size > this->blocks[this->currentBlock].Size)
+		{
+			this->currentBlock++;
+			this->offset = 0;
+
+			if(this->currentBlock == this->blocks.size())
+			{
+				Block block;
+				block.Size = std::max(this->blockSize, size + alignment);
+				block.Data = new unsigned char[block.Size];
+
+				this->blocks.push_back(block);
+			}
+
+			size_t address = (size_t) this->blocks[this->currentBlock].Data;
+			padding = (alignment - address % alignment) % alignment;
+		}
+
+		unsigned char* result = this->blocks[this->currentBlock].Data + this->offset + padding;
+
+		this->offset += padding + size;
+		this->used += padding + size;
+
+		if(this->used > this->highWaterMark)
+			this->highWaterMark = this->used;
+
+		return result;
+	}
+
+	cv::Mat MemoryStorage::AllocateImage(int rows, int cols)
+	{
+		return cv::Mat(rows, cols, CV_8UC1, this->Allocate(rows * cols));
 	}
 
 	void MemoryStorage::Clear(void)
 	{
-		cvClearMemStorage(this->memory);
+		this->currentBlock = this->blocks.empty() ? -1 : 0;
+		this->offset = 0;
+		this->used = 0;
+	}
+
+	size_t MemoryStorage::GetUsed(void) const
+	{
+		return this->used;
+	}
+
+	size_t MemoryStorage::GetHighWaterMark(void) const
+	{
+		return this->highWaterMark;
+	}
+
+	size_t MemoryStorage::GetCapacity(void) const
+	{
+		size_t capacity = 0;
+
+		for(int a = 0; a < this->blocks.size(); a++)
+		{
+			capacity += this->blocks[a].Size;
+		}
+
+		return capacity;
+	}
+
+	MemoryStoragePool::MemoryStoragePool(size_t blockSize) : blockSize(blockSize)
+	{
+	}
+
+	MemoryStoragePool::~MemoryStoragePool(void)
+	{
+		for(int a = 0; a < this->storages.size(); a++)
+		{
+			delete this->storages[a];
+		}
+	}
+
+	MemoryStorage* MemoryStoragePool::Lease(void)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		if(this->available.empty())
+		{
+			this->storages.push_back(new MemoryStorage(this->blockSize));
+
+			return this->storages.back();
+		}
+
+		MemoryStorage* storage = this->available.back();
+		this->available.pop_back();
+
+		return storage;
+	}
+
+	void MemoryStoragePool::Release(MemoryStorage* storage)
+	{
+		storage->Clear();
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		this->available.push_back(storage);
+	}
+
+	int MemoryStoragePool::GetStorageCount(void) const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		return (int) this->storages.size();
+	}
+
+	size_t MemoryStoragePool::GetHighWaterMark(void) const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		size_t highWaterMark = 0;
+
+		for(int a = 0; a < this->storages.size(); a++)
+		{
+			highWaterMark += this->storages[a]->GetHighWaterMark();
+		}
+
+		return highWaterMark;
+	}
+
+	size_t MemoryStoragePool::GetCapacity(void) const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		size_t capacity = 0;
+
+		for(int a = 0; a < this->storages.size(); a++)
+		{
+			capacity += this->storages[a]->GetCapacity();
+		}
+
+		return capacity;
 	}
 }
@@ -9,22 +9,103 @@
 
 #pragma once
 
-#include <opencv\cv.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+#include <opencv2/imgproc.hpp>
 
 namespace TUMAugmentedRealityExercise
 {
-
+	/**
+	 * arena handing out memory for the data of one frame. allocations are
+	 * never freed on their own, Clear() releases all of them at once and keeps
+	 * the blocks for the next frame. a storage must only be used by one thread
+	 * at a time.
+	 */
 	class MemoryStorage
 	{
 	private:
-		CvMemStorage* memory;
+		struct Block
+		{
+			unsigned char* Data;
+			size_t Size;
+		};
+
+		std::vector<Block> blocks;
+		size_t blockSize;
+
+		int currentBlock;
+		size_t offset;
+
+		size_t used;
+
+		// only written by the thread using the storage, the pool reads it from others
+		std::atomic<size_t> highWaterMark;
+
+		MemoryStorage(const MemoryStorage&);
+		MemoryStorage& operator=(const MemoryStorage&);
 	public:
-		MemoryStorage(void);
+		MemoryStorage(size_t blockSize = 64 * 1024);
 		virtual ~MemoryStorage(void);
 
-		CvMemStorage* GetPointer(void) const;
+		// the memory is valid until the next Clear()
+		void* Allocate(size_t size, size_t alignment = 16);
+
+		// 8 bit single channel image living in the storage
+		cv::Mat AllocateImage(int rows, int cols);
 
 		void Clear(void);
+
+		// bytes allocated since the last Clear()
+		size_t GetUsed(void) const;
+
+		// largest number of bytes used between two Clear() calls
+		size_t GetHighWaterMark(void) const;
+
+		// bytes reserved in blocks
+		size_t GetCapacity(void) const;
+	};
+
+	/**
+	 * clears a storage when the frame it was used for is done.
+	 */
+	class MemoryFrameScope
+	{
+	private:
+		MemoryStorage* storage;
+
+		MemoryFrameScope(const MemoryFrameScope&);
+		MemoryFrameScope& operator=(const MemoryFrameScope&);
+	public:
+		MemoryFrameScope(MemoryStorage* storage) : storage(storage) {};
+		~MemoryFrameScope(void) { this->storage->Clear(); };
 	};
 
+	/**
+	 * storages for detectors running in parallel, each detector leases its own
+	 * one so they never contend for memory.
+	 */
+	class MemoryStoragePool
+	{
+	private:
+		std::vector<MemoryStorage*> storages;
+		std::vector<MemoryStorage*> available;
+		size_t blockSize;
+
+		mutable std::mutex mutex;
+	public:
+		MemoryStoragePool(size_t blockSize = 64 * 1024);
+		~MemoryStoragePool(void);
+
+		MemoryStorage* Lease(void);
+		void Release(MemoryStorage* storage);
+
+		int GetStorageCount(void) const;
+
+		// sum of the high-water marks of all storages
+		size_t GetHighWaterMark(void) const;
+
+		size_t GetCapacity(void) const;
+	};
 }
@@ -0,0 +1,200 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "OverlayRenderer.h"
+#include "Profiler.h"
+#include "TraceRecorder.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	void OverlaySnapshot::Capture(const MarkerContainer& markers)
+	{
+		this->quads.clear();
+		this->subPixelCorners.clear();
+		this->stripes.clear();
+
+		for(MarkerContainer::const_iterator it = markers.begin(); it != markers.end(); ++it)
+		{
+			if(it->Corners.size() == 4)
+				this->quads.insert(this->quads.end(), it->Corners.begin(), it->Corners.end());
+
+			this->subPixelCorners.insert(this->subPixelCorners.end(), it->SubPixelCorners.begin(), it->SubPixelCorners.end());
+
+			for(int a = 0; a < it->Stripes.size(); a++)
+			{
+				const std::vector<cv::Point2d>& corners = it->Stripes[a].Corners;
+
+				if(corners.size() != 4)
+					continue;
+
+				for(int b = 0; b < 4; b++)
+				{
+					this->stripes.push_back(cv::Point(cvRound(corners[b].x), cvRound(corners[b].y)));
+				}
+			}
+		}
+	}
+
+	void OverlaySnapshot::DrawQuads(cv::Mat& image, const std::vector<cv::Point>& points, const cv::Scalar& color)
+	{
+		int count = (int) points.size() / 4;
+
+		if(count == 0)
+			return;
+
+		this->contours.resize(count);
+		this->contourSizes.assign(count, 4);
+
+		for(int a = 0; a < count; a++)
+		{
+			this->contours[a] = &points[4 * a];
+		}
+
+		cv::polylines(image, &this->contours[0], &this->contourSizes[0], count, true, color, 1);
+	}
+
+	void OverlaySnapshot::Draw(cv::Mat& image, DetailLevel detail)
+	{
+		if(detail >= Stripes)
+			this->DrawQuads(image, this->stripes, cv::Scalar(0, 255, 0));
+
+		if(detail >= Edges)
+		{
+			this->DrawQuads(image, this->quads, cv::Scalar(0, 0, 255));
+
+			for(int a = 0; a < this->quads.size(); a++)
+			{
+				cv::circle(image, this->quads[a], 1, cv::Scalar(0, 255, 0), 1);
+			}
+		}
+
+		// the color tells the order of the corners
+		for(int a = 0; a < this->subPixelCorners.size(); a++)
+		{
+			int r = (a % 4) * 60;
+
+			cv::circle(image, this->subPixelCorners[a], 2, cv::Scalar(255 - r, 0, r), 2);
+		}
+	}
+
+	void OverlaySnapshot::swap(OverlaySnapshot& other)
+	{
+		this->quads.swap(other.quads);
+		this->subPixelCorners.swap(other.subPixelCorners);
+		this->stripes.swap(other.stripes);
+	}
+
+	OverlayRenderer::OverlayRenderer(OverlaySnapshot::DetailLevel detail) :
+		detail(detail),
+		hasPending(false),
+		hasRendered(false),
+		skippedFrames(0),
+		running(true)
+	{
+		this->thread = std::thread(&OverlayRenderer::Render, this);
+	}
+
+	OverlayRenderer::~OverlayRenderer(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->running = false;
+		}
+
+		this->frameAvailable.notify_all();
+		this->thread.join();
+	}
+
+	OverlaySnapshot::DetailLevel OverlayRenderer::GetDetailLevel(void)
+	{
+		return (OverlaySnapshot::DetailLevel) this->detail.load();
+	}
+
+	void OverlayRenderer::SetDetailLevel(OverlaySnapshot::DetailLevel detail)
+	{
+		this->detail = detail;
+	}
+
+	void OverlayRenderer::Submit(const cv::Mat& frame, const MarkerContainer& markers)
+	{
+		TUMAR_PROFILE_SCOPE("OverlayRenderer::Submit");
+
+		// copy outside of the lock, the render thread only waits for the swap
+		frame.copyTo(this->stagingFrame);
+		this->staging.Capture(markers);
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+
+			if(this->hasPending)
+				this->skippedFrames++;
+
+			std::swap(this->stagingFrame, this->pendingFrame);
+			this->staging.swap(this->pending);
+			this->hasPending = true;
+		}
+
+		this->frameAvailable.notify_one();
+	}
+
+	bool OverlayRenderer::GetLatest(cv::Mat& image)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		if(!this->hasRendered)
+			return false;
+
+		this->rendered.copyTo(image);
+		this->hasRendered = false;
+
+		return true;
+	}
+
+	int OverlayRenderer::GetSkippedFrames(void)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		return this->skippedFrames;
+	}
+
+	void OverlayRenderer::Render(void)
+	{
+		TraceRecorder::SetThreadName("overlay");
+
+		for(;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+
+				this->frameAvailable.wait(lock, [this]() { return this->hasPending || !this->running; });
+
+				if(!this->running)
+					return;
+
+				std::swap(this->pendingFrame, this->frame);
+				this->pending.swap(this->snapshot);
+				this->hasPending = false;
+			}
+
+			{
+				TUMAR_TRACE_SCOPE("overlay");
+				TUMAR_PROFILE_SCOPE("OverlayRenderer::Render");
+
+				this->snapshot.Draw(this->frame, this->GetDetailLevel());
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+
+				std::swap(this->frame, this->rendered);
+				this->hasRendered = true;
+			}
+		}
+	}
+}
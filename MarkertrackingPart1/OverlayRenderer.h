@@ -0,0 +1,117 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include <opencv2/imgproc.hpp>
+
+#include "Marker.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * geometry of the detected markers, detached from the markers themselves
+	 * so it can be drawn after they are gone. the outlines of all markers and
+	 * stripes are drawn with one call each.
+	 */
+	class OverlaySnapshot
+	{
+	public:
+		enum DetailLevel
+		{
+			// sub pixel corners
+			Corners,
+			// corners and marker outlines
+			Edges,
+			// corners, outlines and the outlines of all stripes
+			Stripes
+		};
+	private:
+		// 4 points per marker
+		std::vector<cv::Point> quads;
+		std::vector<cv::Point2f> subPixelCorners;
+
+		// 4 points per stripe
+		std::vector<cv::Point> stripes;
+
+		// contour pointers for the batched polylines calls
+		std::vector<const cv::Point*> contours;
+		std::vector<int> contourSizes;
+
+		void DrawQuads(cv::Mat& image, const std::vector<cv::Point>& points, const cv::Scalar& color);
+	public:
+		OverlaySnapshot(void) {};
+		~OverlaySnapshot(void) {};
+
+		// the buffers keep their capacity, after a few frames capturing doesn't allocate
+		void Capture(const MarkerContainer& markers);
+
+		void Draw(cv::Mat& image, DetailLevel detail);
+
+		void swap(OverlaySnapshot& other);
+	};
+
+	/**
+	 * draws the overlay on a background thread. the submitted frame and the
+	 * marker geometry are copied, so rendering never touches the frame or the
+	 * markers of the detection. a frame which wasn't rendered yet is replaced
+	 * by the next one.
+	 */
+	class OverlayRenderer
+	{
+	private:
+		std::atomic<int> detail;
+
+		// owned by the submitting thread
+		cv::Mat stagingFrame;
+		OverlaySnapshot staging;
+
+		cv::Mat pendingFrame;
+		OverlaySnapshot pending;
+		bool hasPending;
+
+		// owned by the render thread
+		cv::Mat frame;
+		OverlaySnapshot snapshot;
+
+		cv::Mat rendered;
+		bool hasRendered;
+
+		int skippedFrames;
+
+		std::mutex mutex;
+		std::condition_variable frameAvailable;
+		bool running;
+
+		std::thread thread;
+
+		void Render(void);
+	public:
+		OverlayRenderer(OverlaySnapshot::DetailLevel detail = OverlaySnapshot::Edges);
+		~OverlayRenderer(void);
+
+		OverlaySnapshot::DetailLevel GetDetailLevel(void);
+		void SetDetailLevel(OverlaySnapshot::DetailLevel detail);
+
+		// only one thread may submit frames
+		void Submit(const cv::Mat& frame, const MarkerContainer& markers);
+
+		// copies the latest rendered frame, returns false if none was rendered since the last call
+		bool GetLatest(cv::Mat& image);
+
+		// frames replaced before they were rendered
+		int GetSkippedFrames(void);
+	};
+}
@@ -0,0 +1,172 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <tuple>
+#include <type_traits>
+
+#include <opencv2/imgproc.hpp>
+
+#include "ImageProcessor.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * how a pipeline may treat the buffers of a stage.
+	 */
+	template<typename Processor>
+	struct ImageProcessorTraits
+	{
+		// the stage can write its output over its input
+		static const bool InPlace = false;
+
+		// the stage only reads its input, the next stage gets the same image
+		static const bool PassThrough = false;
+	};
+
+	template<>
+	struct ImageProcessorTraits<ThresholdImageProcessor>
+	{
+		static const bool InPlace = true;
+		static const bool PassThrough = false;
+	};
+
+	template<>
+	struct ImageProcessorTraits<NullImageProcessor>
+	{
+		static const bool InPlace = false;
+		static const bool PassThrough = true;
+	};
+
+	template<>
+	struct ImageProcessorTraits<MarkerDetectionImageProcessor>
+	{
+		static const bool InPlace = false;
+		static const bool PassThrough = true;
+	};
+
+	/**
+	 * adjacent stages which can run as one pass over the image. Second is void
+	 * for the last stage.
+	 */
+	template<typename First, typename Second>
+	struct ImageProcessorFusion
+	{
+		static const bool Fused = false;
+	};
+
+	template<>
+	struct ImageProcessorFusion<GreyscaleImageProcessor, ThresholdImageProcessor>
+	{
+		static const bool Fused = true;
+
+		static void process(GreyscaleImageProcessor& grey, ThresholdImageProcessor& threshold, cv::Mat& input, cv::Mat& output)
+		{
+			threshold.ProcessColor(input, output);
+		}
+	};
+
+	template<>
+	struct ImageProcessorFusion<GreyscaleImageProcessor, AdaptiveThresholdImageProcessor>
+	{
+		static const bool Fused = true;
+
+		static void process(GreyscaleImageProcessor& grey, AdaptiveThresholdImageProcessor& threshold, cv::Mat& input, cv::Mat& output)
+		{
+			threshold.ProcessColor(input, output);
+		}
+	};
+
+	/**
+	 * a chain of image processors fixed at compile time, e.g.
+	 *
+	 *   Pipeline<GreyscaleImageProcessor, AdaptiveThresholdImageProcessor, MarkerDetectionImageProcessor> pipeline(grey, adaptive, marker);
+	 *
+	 * the stages are called without virtual dispatch, fused stages run as one
+	 * pass and every stage keeps its own buffer, so nothing is cloned between
+	 * stages like ImageProcessorChain does. the output refers to a buffer of the
+	 * pipeline and is overwritten by the next frame. use ImageProcessorChain
+	 * for chains configured at runtime.
+	 */
+	template<typename... Processors>
+	class Pipeline : public ImageProcessor
+	{
+	private:
+		typedef std::tuple<Processors...> Stages;
+
+		static const int StageCount = sizeof...(Processors);
+
+		template<int Index, bool Valid = (Index < StageCount)>
+		struct Stage
+		{
+			typedef void type;
+		};
+
+		template<int Index>
+		struct Stage<Index, true>
+		{
+			typedef typename std::tuple_element<Index, Stages>::type type;
+		};
+
+		std::tuple<Processors&...> stages;
+		cv::Mat buffers[StageCount];
+
+		// Owned tells whether the input is a buffer of the pipeline, which in place stages may overwrite
+		template<int Index, bool Owned>
+		typename std::enable_if<(Index == StageCount)>::type Run(cv::Mat& input, cv::Mat& output)
+		{
+			output = input;
+		}
+
+		template<int Index, bool Owned>
+		typename std::enable_if<(Index < StageCount)>::type Run(cv::Mat& input, cv::Mat& output)
+		{
+			typedef typename Stage<Index>::type Current;
+			typedef typename Stage<Index + 1>::type Next;
+
+			this->template Step<Index, Owned>(input, output, std::integral_constant<bool, ImageProcessorFusion<Current, Next>::Fused>(), std::integral_constant<bool, ImageProcessorTraits<Current>::PassThrough>());
+		}
+
+		// fused with the next stage
+		template<int Index, bool Owned, bool PassThrough>
+		void Step(cv::Mat& input, cv::Mat& output, std::true_type fused, std::integral_constant<bool, PassThrough> passThrough)
+		{
+			ImageProcessorFusion<typename Stage<Index>::type, typename Stage<Index + 1>::type>::process(std::get<Index>(this->stages), std::get<Index + 1>(this->stages), input, this->buffers[Index]);
+
+			this->template Run<Index + 2, true>(this->buffers[Index], output);
+		}
+
+		template<int Index, bool Owned>
+		void Step(cv::Mat& input, cv::Mat& output, std::false_type fused, std::true_type passThrough)
+		{
+			std::get<Index>(this->stages).process(input, this->buffers[Index]);
+
+			this->template Run<Index + 1, Owned>(input, output);
+		}
+
+		template<int Index, bool Owned>
+		void Step(cv::Mat& input, cv::Mat& output, std::false_type fused, std::false_type passThrough)
+		{
+			cv::Mat& result = Owned && ImageProcessorTraits<typename Stage<Index>::type>::InPlace ? input : this->buffers[Index];
+
+			std::get<Index>(this->stages).process(input, result);
+
+			this->template Run<Index + 1, true>(result, output);
+		}
+	public:
+		Pipeline(Processors&... processors) : stages(processors...) {};
+		~Pipeline(void) {};
+
+		void process(cv::Mat& input, cv::Mat& output)
+		{
+			this->template Run<0, false>(input, output);
+		}
+	};
+}
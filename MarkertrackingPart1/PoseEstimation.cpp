@@ -1,11 +1,11 @@
 #define _USE_MATH_DEFINES 
 #include <math.h>
-#include <opencv/cv.h>
-#include <opencv/cxcore.h>
+#include <opencv2/core/core_c.h>
 #include <vector>
 #include <algorithm>
 #include <iostream>
 #include "PoseEstimation.h"
+#include "Profiler.h"
 
 using namespace std;
 
@@ -417,6 +417,7 @@ float computeReprojectionError( float* pError, const CvPoint3D32f* p3D, const Cv
  */
 void optimizePose( float* pRotation, float* pTranslation, int nPoints, const CvPoint2D32f* p2D, const CvPoint3D32f* p3D, float f )
 	{
+	TUMAR_PROFILE_SCOPE("optimizePose");
 	using std::vector;
 	
 	float params[ 7 ];
@@ -527,12 +528,10 @@ void optimizePose( float* pRotation, float* pTranslation, int nPoints, const CvP
  * @param p2D coordinates of the four corners in counter-clock-wise order. 
  *        the origin is assumed to be at the camera's center of projection
  * @param markerSize side-length of marker. Origin is at marker center.
+ * @param fFocalLength focal length, 400 approximates a logitech quickcam 4000 at 320*240 resolution
  */
-void estimateSquarePose( float* mat, const CvPoint2D32f* p2D, float markerSize )
+void estimateSquarePose( float* mat, const CvPoint2D32f* p2D, float markerSize, float fFocalLength, float* error )
 	{
-	// approximate focal length for logitech quickcam 4000 at 320*240 resolution
-	static const float fFocalLength = 400.0f;
-	
 	// compute initial pose
 	float rot[ 4 ], trans[ 3 ];
 	getInitialPose( rot, trans, p2D, markerSize, fFocalLength );
@@ -551,6 +550,12 @@ void estimateSquarePose( float* mat, const CvPoint2D32f* p2D, float markerSize )
 	}
 	optimizePose( rot, trans, 4, points, points3D, fFocalLength );
 
+	if ( error != NULL )
+	{
+		float diff[ 8 ];
+		*error = sqrt( computeReprojectionError( diff, points3D, points, 4, rot, trans, fFocalLength ) / 4 );
+	}
+
 	// convert quaternion to matrix
 	float X = -rot[ 0 ];
 	float Y = -rot[ 1 ];
@@ -1,5 +1,5 @@
 #pragma once
-#include <opencv/cv.h>
+#include <opencv2/core/core_c.h>
 
 /** 
  * computes the orientation and translation of a square
@@ -7,8 +7,10 @@
  * @param p2D coordinates of the four corners in clock-wise order. 
  *        the origin is assumed to be at the camera's center of projection
  * @param markerSize side-length of marker. Origin is at marker center.
+ * @param focalLength focal length in pixels
+ * @param error if given, receives the rms reprojection error of the corners in pixels
  */
-void estimateSquarePose( float* result, const CvPoint2D32f* p2D, float markerSize );
+void estimateSquarePose( float* result, const CvPoint2D32f* p2D, float markerSize, float focalLength = 400.0f, float* error = NULL );
 	
 /**
  * Returns Matrix in Row-major format
@@ -16,3 +18,33 @@ void estimateSquarePose( float* result, const CvPoint2D32f* p2D, float markerSiz
  * @param quadrangle the coordinates of the corners counter-clockwise
  */
 void calcHomography( float* pResult, const CvPoint2D32f* pQuad );
+
+/** 
+ * computes the orientation and translation of a square using homography
+ * @param pRot result as quaternion
+ * @param pTrans result position
+ * @param p2D four input coordinates. the origin is assumed to be at the camera's center of projection
+ * @param fMarkerSize side-length of marker. Origin is at marker center.
+ * @param f focal length
+ */
+void getInitialPose( float* pRot, float *pTrans, const CvPoint2D32f* p2D, float fMarkerSize, float f );
+
+/**
+ * optimize a pose with levenberg-marquardt
+ * @param pRotation rotation as quaternion, both used as output and initial value
+ * @param pTranslation 3-element translation, both used as output and initial value
+ * @param nPoints number of correspondences
+ * @param p2D pointer to camera coordinates
+ * @param p3D pointer to object coordinates
+ * @param f focal length
+ */
+void optimizePose( float* pRotation, float* pTranslation, int nPoints, const CvPoint2D32f* p2D, const CvPoint3D32f* p3D, float f );
+
+/**
+ * computes the Jacobian for optimizing the pose
+ * @param pResult 2x7 matrix
+ * @param pParam rotation parameters: 4 * quaternion rotation + 3 * translation
+ * @param p3D the 3d input vector
+ * @param f focal length
+ */
+void computeJacobian( float* pResult, float* pParam, const CvPoint3D32f& p3D, float f );
@@ -0,0 +1,239 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "Profiler.h"
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <iomanip>
+#include <limits>
+
+namespace TUMAugmentedRealityExercise
+{
+	struct ProfileSiteStatistics
+	{
+		std::atomic<int64> Count;
+		std::atomic<int64> Total;
+		std::atomic<int64> Min;
+		std::atomic<int64> Max;
+		std::atomic<int64> Histogram[Profiler::HistogramBuckets];
+	};
+
+	// only the owning thread writes, so a relaxed load and store replaces the read-modify-write
+	struct ProfileThreadBuffer
+	{
+		ProfileSiteStatistics Sites[Profiler::MaxSites];
+
+		void Add(std::atomic<int64>& value, int64 amount)
+		{
+			value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+		}
+	};
+
+	static std::mutex registryMutex;
+	static std::vector<std::string> siteNames;
+	static std::vector<Profiler::SiteKind> siteKinds;
+	static std::vector<ProfileThreadBuffer*> threadBuffers;
+
+	static thread_local ProfileThreadBuffer* threadBuffer = NULL;
+
+	static std::atomic<bool> enabled(true);
+
+	static const double nsPerTick = 1e9 / cv::getTickFrequency();
+
+	static void ClearStatistics(ProfileSiteStatistics& site)
+	{
+		site.Count.store(0, std::memory_order_relaxed);
+		site.Total.store(0, std::memory_order_relaxed);
+		site.Min.store(std::numeric_limits<int64>::max(), std::memory_order_relaxed);
+		site.Max.store(std::numeric_limits<int64>::min(), std::memory_order_relaxed);
+
+		for(int a = 0; a < Profiler::HistogramBuckets; a++)
+		{
+			site.Histogram[a].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	static ProfileThreadBuffer* GetThreadBuffer(void)
+	{
+		if(threadBuffer == NULL)
+		{
+			// buffers are kept after their thread ended, so its numbers show up in the report
+			threadBuffer = new ProfileThreadBuffer();
+
+			for(int a = 0; a < Profiler::MaxSites; a++)
+			{
+				ClearStatistics(threadBuffer->Sites[a]);
+			}
+
+			std::lock_guard<std::mutex> lock(registryMutex);
+			threadBuffers.push_back(threadBuffer);
+		}
+
+		return threadBuffer;
+	}
+
+	int Profiler::RegisterSite(const char* name, SiteKind kind)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+
+		for(int a = 0; a < siteNames.size(); a++)
+		{
+			if(siteNames[a] == name)
+				return a;
+		}
+
+		if(siteNames.size() == MaxSites)
+			return -1;
+
+		siteNames.push_back(name);
+		siteKinds.push_back(kind);
+
+		return (int) siteNames.size() - 1;
+	}
+
+	void Profiler::Record(int site, int64 ticks)
+	{
+		if(site < 0)
+			return;
+
+		ProfileThreadBuffer* buffer = GetThreadBuffer();
+		ProfileSiteStatistics& statistics = buffer->Sites[site];
+
+		buffer->Add(statistics.Count, 1);
+		buffer->Add(statistics.Total, ticks);
+
+		if(ticks < statistics.Min.load(std::memory_order_relaxed))
+			statistics.Min.store(ticks, std::memory_order_relaxed);
+
+		if(ticks > statistics.Max.load(std::memory_order_relaxed))
+			statistics.Max.store(ticks, std::memory_order_relaxed);
+
+		// bucket n holds durations below 2^n us
+		int64 us = (int64) (ticks * nsPerTick) / 1000;
+		int bucket = 0;
+
+		while(us > 0 && bucket < HistogramBuckets - 1)
+		{
+			us >>= 1;
+			bucket++;
+		}
+
+		buffer->Add(statistics.Histogram[bucket], 1);
+	}
+
+	void Profiler::Count(int site, int64 value)
+	{
+		if(site < 0 || !IsEnabled())
+			return;
+
+		ProfileThreadBuffer* buffer = GetThreadBuffer();
+		ProfileSiteStatistics& statistics = buffer->Sites[site];
+
+		buffer->Add(statistics.Count, 1);
+		buffer->Add(statistics.Total, value);
+
+		if(value < statistics.Min.load(std::memory_order_relaxed))
+			statistics.Min.store(value, std::memory_order_relaxed);
+
+		if(value > statistics.Max.load(std::memory_order_relaxed))
+			statistics.Max.store(value, std::memory_order_relaxed);
+	}
+
+	void Profiler::Report(std::ostream& stream)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+
+		double msPerTick = nsPerTick / 1e6;
+
+		stream << std::left << std::setw(48) << "site" << std::right << std::setw(10) << "count" << std::setw(12) << "total" << std::setw(10) << "mean" << std::setw(10) << "min" << std::setw(10) << "max" << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99" << std::endl;
+
+		for(int site = 0; site < siteNames.size(); site++)
+		{
+			int64 count = 0, total = 0;
+			int64 min = std::numeric_limits<int64>::max(), max = std::numeric_limits<int64>::min();
+			int64 histogram[HistogramBuckets] = { 0 };
+
+			for(int a = 0; a < threadBuffers.size(); a++)
+			{
+				const ProfileSiteStatistics& statistics = threadBuffers[a]->Sites[site];
+
+				count += statistics.Count.load(std::memory_order_relaxed);
+				total += statistics.Total.load(std::memory_order_relaxed);
+				min = std::min(min, statistics.Min.load(std::memory_order_relaxed));
+				max = std::max(max, statistics.Max.load(std::memory_order_relaxed));
+
+				for(int b = 0; b < HistogramBuckets; b++)
+				{
+					histogram[b] += statistics.Histogram[b].load(std::memory_order_relaxed);
+				}
+			}
+
+			if(count == 0)
+				continue;
+
+			stream << std::left << std::setw(48) << siteNames[site] << std::right << std::setw(10) << count << std::fixed << std::setprecision(3);
+
+			if(siteKinds[site] == Counter)
+			{
+				stream << std::setw(12) << (double) total << std::setw(10) << (double) total / count << std::setw(10) << (double) min << std::setw(10) << (double) max << std::endl;
+				continue;
+			}
+
+			stream << std::setw(12) << total * msPerTick << std::setw(10) << total * msPerTick / count << std::setw(10) << min * msPerTick << std::setw(10) << max * msPerTick;
+
+			// percentiles are the upper bound of the bucket they fall into
+			double percentiles[3] = { 0.5, 0.9, 0.99 };
+
+			for(int a = 0; a < 3; a++)
+			{
+				int64 rank = (int64) (percentiles[a] * count);
+				int64 seen = 0;
+				int bucket = 0;
+
+				while(bucket < HistogramBuckets - 1 && seen + histogram[bucket] <= rank)
+				{
+					seen += histogram[bucket];
+					bucket++;
+				}
+
+				stream << std::setw(10) << (1 << bucket) / 1000.0;
+			}
+
+			stream << std::endl;
+		}
+
+		stream.unsetf(std::ios::fixed);
+	}
+
+	void Profiler::Reset(void)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+
+		for(int a = 0; a < threadBuffers.size(); a++)
+		{
+			for(int site = 0; site < MaxSites; site++)
+			{
+				ClearStatistics(threadBuffers[a]->Sites[site]);
+			}
+		}
+	}
+
+	void Profiler::SetEnabled(bool enabled)
+	{
+		TUMAugmentedRealityExercise::enabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	bool Profiler::IsEnabled(void)
+	{
+		return enabled.load(std::memory_order_relaxed);
+	}
+}
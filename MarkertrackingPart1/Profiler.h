@@ -0,0 +1,75 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <ostream>
+
+#include <opencv2/imgproc.hpp>
+
+// define TUMAR_NO_PROFILING to remove all timers and counters
+#ifdef TUMAR_NO_PROFILING
+#define TUMAR_PROFILE_SCOPE(name) ((void) 0)
+#define TUMAR_PROFILE_COUNT(name, value) ((void) 0)
+#else
+#define TUMAR_PROFILE_CONCAT_(a, b) a##b
+#define TUMAR_PROFILE_CONCAT(a, b) TUMAR_PROFILE_CONCAT_(a, b)
+
+// measures the time until the end of the enclosing block
+#define TUMAR_PROFILE_SCOPE(name) \
+	static const int TUMAR_PROFILE_CONCAT(profileSite, __LINE__) = TUMAugmentedRealityExercise::Profiler::RegisterSite(name, TUMAugmentedRealityExercise::Profiler::Timer); \
+	TUMAugmentedRealityExercise::ProfileScope TUMAR_PROFILE_CONCAT(profileScope, __LINE__)(TUMAR_PROFILE_CONCAT(profileSite, __LINE__))
+
+// adds a value to a counter, each call is one sample
+#define TUMAR_PROFILE_COUNT(name, value) \
+	do { static const int profileSite = TUMAugmentedRealityExercise::Profiler::RegisterSite(name, TUMAugmentedRealityExercise::Profiler::Counter); TUMAugmentedRealityExercise::Profiler::Count(profileSite, value); } while(0)
+#endif
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * collects timers and counters of named sites. every thread records into
+	 * its own buffer without locking, reports aggregate the buffers of all
+	 * threads. timings are kept in a histogram with power of two buckets
+	 * starting at 1us.
+	 */
+	class Profiler
+	{
+	public:
+		enum SiteKind { Timer, Counter };
+
+		static const int MaxSites = 256;
+		static const int HistogramBuckets = 24;
+
+		// sites with the same name share their statistics, returns -1 if there are too many sites
+		static int RegisterSite(const char* name, SiteKind kind);
+
+		static void Record(int site, int64 ticks);
+		static void Count(int site, int64 value);
+
+		// one line per site, the values of threads which are still recording may be slightly out of date
+		static void Report(std::ostream& stream);
+
+		static void Reset(void);
+
+		// a disabled profiler neither reads the clock nor records, for measurements the timers would distort
+		static void SetEnabled(bool enabled);
+		static bool IsEnabled(void);
+	};
+
+	class ProfileScope
+	{
+	private:
+		int site;
+		int64 start;
+	public:
+		ProfileScope(int site) : site(Profiler::IsEnabled() ? site : -1), start(this->site >= 0 ? cv::getTickCount() : 0) {};
+		~ProfileScope(void) { if(this->site >= 0) Profiler::Record(this->site, cv::getTickCount() - this->start); };
+	};
+}
@@ -0,0 +1,611 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "QuadFinder.h"
+#include "Profiler.h"
+#include "TraceRecorder.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	// neighbour offsets in counter-clockwise order starting to the right (like the freeman chain code)
+	static const int DeltaX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+	static const int DeltaY[8] = { 0, -1, -1, -1, 0, 1, 1, 1 };
+
+	// polygons with more vertices can't be simplified to a quad anymore
+	static const int MaxPolygonVertices = 16;
+
+	// label rows above the region: background frame and seam row
+	static const int FirstRow = 2;
+
+	static const double Sqrt2 = 1.41421356237309504880;
+
+	BorderTracer::BorderTracer(int minSize, double approximationAccuracy) :
+		minSize(minSize),
+		maxWidth(0),
+		approximationAccuracy(approximationAccuracy),
+		seamTop(false),
+		seamBottom(false),
+		seamAbove(NULL),
+		seamBelow(NULL)
+	{
+	}
+
+	BorderTracer::~BorderTracer(void)
+	{
+	}
+
+	void BorderTracer::Trace(const cv::Mat& binary, const cv::Rect& region, int maxWidth, bool seamTop, bool seamBottom, const std::vector<int>* seams, QuadContainer& quads, std::vector<cv::Rect>* cut)
+	{
+		this->maxWidth = maxWidth;
+		this->seamTop = seamTop;
+		this->seamBottom = seamBottom;
+		this->seamAbove = seamTop ? binary.ptr<unsigned char>(region.y - 1) + region.x : NULL;
+		this->seamBelow = seamBottom ? binary.ptr<unsigned char>(region.y + region.height) + region.x : NULL;
+
+		// the label buffer only grows, regions of different size use a view into it
+		int rows = region.height + 2 * FirstRow;
+		int cols = region.width + 2;
+
+		if(this->buffer.rows < rows || this->buffer.cols < cols)
+		{
+			this->buffer.create(std::max(this->buffer.rows, rows), std::max(this->buffer.cols, cols), CV_8UC1);
+		}
+
+		// background frame around the region, seam rows are foreground framed by background
+		this->labels = this->buffer(cv::Rect(0, 0, cols, rows));
+
+		this->labels.row(0).setTo(cv::Scalar(0));
+		this->labels.row(1).setTo(cv::Scalar(seamTop ? 4 : 0));
+		this->labels.row(rows - 2).setTo(cv::Scalar(seamBottom ? 4 : 0));
+		this->labels.row(rows - 1).setTo(cv::Scalar(0));
+		this->labels.col(0).setTo(cv::Scalar(0));
+		this->labels.col(cols - 1).setTo(cv::Scalar(0));
+
+		cv::Mat inner = this->labels(cv::Rect(1, FirstRow, region.width, region.height));
+		cv::threshold(binary(region), inner, 0, 1, cv::THRESH_BINARY);
+
+		for(int y = FirstRow; y < region.height + FirstRow; y++)
+		{
+			unsigned char* row = this->labels.ptr<unsigned char>(y);
+			int previous = 0;
+
+			for(int x = 1; x <= region.width; x++)
+			{
+				int current = row[x];
+
+				if(current == previous)
+					continue;
+
+				TraceResult result = Dropped;
+				double perimeter = 0;
+
+				if(previous == 0 && current == 1)
+				{
+					// outer border, background on the left
+					result = this->TraceBorder(row + x, x, y, false, perimeter);
+				}
+				else if(current == 0 && (previous == 1 || previous == 2))
+				{
+					// hole border, background on the right
+					result = this->TraceBorder(row + x - 1, x - 1, y, true, perimeter);
+				}
+
+				if(result == Candidate)
+				{
+					int top = region.y + this->bounds.y;
+					int bottom = top + this->bounds.height - 1;
+
+					bool accepted = seams == NULL;
+
+					for(int a = 0; !accepted && a < seams->size(); a++)
+					{
+						accepted = top <= (*seams)[a] && bottom >= (*seams)[a] - 1;
+					}
+
+					Quad quad;
+
+					if(accepted && this->ApproximateQuad(perimeter * this->approximationAccuracy, quad))
+					{
+						for(int a = 0; a < 4; a++)
+						{
+							quad.Corners[a] += region.tl();
+						}
+
+						quads.push_back(quad);
+					}
+				}
+				else if(result == Cut && cut != NULL)
+				{
+					for(int a = 0; a < this->pieces.size(); a++)
+					{
+						cut->push_back(this->pieces[a] + region.tl());
+					}
+				}
+
+				previous = row[x];
+			}
+		}
+	}
+
+	BorderTracer::TraceResult BorderTracer::TraceBorder(unsigned char* start, int x, int y, bool hole, double& perimeter)
+	{
+		int step = (int) this->labels.step;
+		int deltas[8];
+
+		for(int a = 0; a < 8; a++)
+		{
+			deltas[a] = DeltaY[a] * step + DeltaX[a];
+		}
+
+		// search clockwise for the first foreground neighbour, starting at the background pixel
+		int direction = hole ? 0 : 4;
+		int end = direction;
+		unsigned char* first = NULL;
+
+		do
+		{
+			direction = (direction - 1) & 7;
+			first = start + deltas[direction];
+		}
+		while(*first == 0 && direction != end);
+
+		if(*first == 0)
+		{
+			// isolated pixel
+			*start = 3;
+			return Dropped;
+		}
+
+		unsigned char* current = start;
+		int currentX = x;
+		int currentY = y;
+		int previousDirection = direction ^ 4;
+
+		int minX = x, maxX = x, minY = y, maxY = y;
+		int axialSteps = 0, diagonalSteps = 0;
+
+		int lastColumn = this->labels.cols - 2;
+		int lastRow = this->labels.rows - FirstRow - 1;
+
+		bool keep = true;
+		bool cut = false;
+
+		// the part of the border between two seam visits, it may belong to a contour of the whole image
+		int pieceMinX = x, pieceMaxX = x, pieceMinY = y, pieceMaxY = y;
+		bool pieceOpen = false;
+		bool pieceKeep = true;
+
+		// the seam pixel the current piece started at, it may belong to the contour as well
+		int seamX = 0, seamY = 0;
+		bool seamVisited = false;
+
+		this->contour.clear();
+		this->pieces.clear();
+
+		for(;;)
+		{
+			end = direction;
+
+			// search counter-clockwise for the next foreground neighbour
+			unsigned char* next;
+
+			do
+			{
+				direction++;
+				next = current + deltas[direction & 7];
+			}
+			while(*next == 0);
+
+			direction &= 7;
+
+			// contours touching the image border are open
+			bool inside = currentX > 1 && currentX < lastColumn && (currentY > FirstRow || this->seamTop) && (currentY < lastRow || this->seamBottom);
+
+			// next to a seam the neighbouring band decides whether the contour continues
+			cut = cut || (currentY <= FirstRow && this->seamTop) || (currentY >= lastRow && this->seamBottom);
+
+			// mark the pixel, remember whether the right neighbour was examined and is background
+			if(currentY < FirstRow || currentY > lastRow)
+			{
+				// seam pixels belong to the neighbouring band and stay untouched. the contour only runs along
+				// the seam where the neighbouring band has foreground as well, a piece may start or end there
+				const unsigned char* seam = currentY < FirstRow ? this->seamAbove : this->seamBelow;
+
+				if(!pieceOpen && seam[currentX - 1] != 0)
+				{
+					pieceMinX = pieceMaxX = currentX;
+					pieceMinY = pieceMaxY = currentY;
+					pieceOpen = true;
+					pieceKeep = true;
+				}
+				else if(pieceOpen && pieceKeep)
+				{
+					pieceMinX = std::min(pieceMinX, currentX);
+					pieceMaxX = std::max(pieceMaxX, currentX);
+					pieceMinY = std::min(pieceMinY, currentY);
+					pieceMaxY = std::max(pieceMaxY, currentY);
+
+					pieceKeep = pieceMaxX - pieceMinX + 1 <= this->maxWidth;
+				}
+
+				if(pieceOpen && seam[currentX - 1] == 0)
+				{
+					if(pieceKeep)
+					{
+						this->pieces.push_back(cv::Rect(pieceMinX - 1, pieceMinY - FirstRow, pieceMaxX - pieceMinX + 1, pieceMaxY - pieceMinY + 1));
+					}
+
+					pieceOpen = false;
+				}
+
+				seamX = currentX;
+				seamY = currentY;
+				seamVisited = true;
+			}
+			else
+			{
+				if((unsigned) (direction - 1) < (unsigned) end)
+				{
+					*current = 3;
+				}
+				else if(*current == 1)
+				{
+					*current = 2;
+				}
+
+				if(!pieceOpen)
+				{
+					pieceMinX = pieceMaxX = seamVisited ? seamX : currentX;
+					pieceMinY = pieceMaxY = seamVisited ? seamY : currentY;
+					pieceOpen = true;
+					pieceKeep = true;
+				}
+
+				if(pieceKeep)
+				{
+					pieceMinX = std::min(pieceMinX, currentX);
+					pieceMaxX = std::max(pieceMaxX, currentX);
+					pieceMinY = std::min(pieceMinY, currentY);
+					pieceMaxY = std::max(pieceMaxY, currentY);
+
+					pieceKeep = inside && pieceMaxX - pieceMinX + 1 <= this->maxWidth;
+				}
+			}
+
+			if(keep)
+			{
+				minX = std::min(minX, currentX);
+				maxX = std::max(maxX, currentX);
+				minY = std::min(minY, currentY);
+				maxY = std::max(maxY, currentY);
+
+				// too wide contours are the image frame
+				keep = inside && maxX - minX + 1 <= this->maxWidth;
+
+				// only keep the points where the chain changes its direction
+				if(keep && !cut && direction != previousDirection)
+				{
+					this->contour.push_back(cv::Point(currentX - 1, currentY - FirstRow));
+				}
+			}
+
+			previousDirection = direction;
+
+			if((direction & 1) != 0)
+				diagonalSteps++;
+			else
+				axialSteps++;
+
+			if(next == start && current == first)
+				break;
+
+			current = next;
+			currentX += DeltaX[direction];
+			currentY += DeltaY[direction];
+
+			direction = (direction + 4) & 7;
+		}
+
+		if(cut)
+		{
+			// the piece the trace started in, its other end was reported on the first seam visit
+			if(pieceOpen && pieceKeep)
+			{
+				this->pieces.push_back(cv::Rect(pieceMinX - 1, pieceMinY - FirstRow, pieceMaxX - pieceMinX + 1, pieceMaxY - pieceMinY + 1));
+			}
+
+			return this->pieces.empty() ? Dropped : Cut;
+		}
+
+		if(!keep)
+			return Dropped;
+
+		this->bounds = cv::Rect(minX - 1, minY - FirstRow, maxX - minX + 1, maxY - minY + 1);
+
+		if(this->bounds.width < this->minSize || this->bounds.height < this->minSize)
+			return Dropped;
+
+		perimeter = axialSteps + diagonalSteps * Sqrt2;
+
+		return Candidate;
+	}
+
+	QuadFinder::QuadFinder(int minSize, int borderMargin, double approximationAccuracy) :
+		minSize(minSize),
+		borderMargin(borderMargin),
+		approximationAccuracy(approximationAccuracy),
+		bandCount(1),
+		tracers(1, BorderTracer(minSize, approximationAccuracy)),
+		bandQuads(1),
+		bandCuts(1),
+		pool(NULL)
+	{
+	}
+
+	QuadFinder::~QuadFinder(void)
+	{
+		delete this->pool;
+	}
+
+	int QuadFinder::GetBandCount(void) const
+	{
+		return this->bandCount;
+	}
+
+	void QuadFinder::SetBandCount(int bandCount)
+	{
+		bandCount = std::max(bandCount, 1);
+
+		if(bandCount == this->bandCount)
+			return;
+
+		this->bandCount = bandCount;
+
+		this->tracers.assign(bandCount, BorderTracer(this->minSize, this->approximationAccuracy));
+		this->bandQuads.resize(bandCount);
+		this->bandCuts.resize(bandCount);
+
+		// the calling thread traces the first band itself
+		delete this->pool;
+		this->pool = bandCount > 1 ? new ThreadPool(bandCount - 1) : NULL;
+	}
+
+	const QuadContainer& QuadFinder::Find(const cv::Mat& binary)
+	{
+		TUMAR_PROFILE_SCOPE("QuadFinder::Find");
+
+		// the tracer reads one byte per pixel, anything else would silently find nothing
+		CV_Assert(binary.type() == CV_8UC1);
+
+		this->quads.clear();
+
+		cv::Rect image(0, 0, binary.cols, binary.rows);
+		int maxWidth = binary.cols - this->borderMargin;
+
+		// bands lower than a marker would only produce cut contours
+		int bands = std::max(1, std::min(this->bandCount, binary.rows / this->minSize));
+
+		if(bands == 1)
+		{
+			this->tracers[0].Trace(binary, image, maxWidth, false, false, NULL, this->quads, NULL);
+
+			return this->quads;
+		}
+
+		this->seams.clear();
+
+		for(int a = 1; a < bands; a++)
+		{
+			this->seams.push_back(a * binary.rows / bands);
+		}
+
+		this->pool->ParallelFor(bands, [&](int band)
+		{
+			TUMAR_TRACE_SCOPE("contour band");
+
+			int top = band > 0 ? this->seams[band - 1] : 0;
+			int bottom = band < bands - 1 ? this->seams[band] : binary.rows;
+
+			this->bandQuads[band].clear();
+			this->bandCuts[band].clear();
+
+			this->tracers[band].Trace(binary, cv::Rect(0, top, binary.cols, bottom - top), maxWidth, band > 0, band < bands - 1, NULL, this->bandQuads[band], &this->bandCuts[band]);
+		});
+
+		this->stitchRegions.clear();
+
+		for(int band = 0; band < bands; band++)
+		{
+			this->quads.insert(this->quads.end(), this->bandQuads[band].begin(), this->bandQuads[band].end());
+
+			for(int a = 0; a < this->bandCuts[band].size(); a++)
+			{
+				const cv::Rect& piece = this->bandCuts[band][a];
+
+				this->stitchRegions.push_back(cv::Rect(piece.x - 1, piece.y - 1, piece.width + 2, piece.height + 2) & image);
+			}
+		}
+
+		// trace the contours crossing a seam once more, this time in one piece, pieces of the same contour overlap at the seam
+		MergeRegions(this->stitchRegions);
+
+		TUMAR_TRACE_SCOPE("contour stitch");
+
+		for(int a = 0; a < this->stitchRegions.size(); a++)
+		{
+			this->tracers[0].Trace(binary, this->stitchRegions[a], maxWidth, false, false, &this->seams, this->quads, NULL);
+		}
+
+		return this->quads;
+	}
+
+	const QuadContainer& QuadFinder::Find(const cv::Mat& binary, const std::vector<cv::Rect>& regions)
+	{
+		TUMAR_PROFILE_SCOPE("QuadFinder::Find");
+
+		// the tracer reads one byte per pixel, anything else would silently find nothing
+		CV_Assert(binary.type() == CV_8UC1);
+
+		this->quads.clear();
+
+		cv::Rect image(0, 0, binary.cols, binary.rows);
+		int maxWidth = binary.cols - this->borderMargin;
+
+		this->searchRegions.clear();
+
+		for(int a = 0; a < regions.size(); a++)
+		{
+			cv::Rect region = regions[a] & image;
+
+			if(region.width >= this->minSize && region.height >= this->minSize)
+				this->searchRegions.push_back(region);
+		}
+
+		// overlapping regions would report the same quad twice
+		MergeRegions(this->searchRegions);
+
+		for(int a = 0; a < this->searchRegions.size(); a++)
+		{
+			this->tracers[0].Trace(binary, this->searchRegions[a], maxWidth, false, false, NULL, this->quads, NULL);
+		}
+
+		return this->quads;
+	}
+
+	void QuadFinder::MergeRegions(std::vector<cv::Rect>& regions)
+	{
+		bool merged = true;
+
+		while(merged)
+		{
+			merged = false;
+
+			for(int a = 0; a < regions.size(); a++)
+			{
+				for(int b = a + 1; b < regions.size();)
+				{
+					if((regions[a] & regions[b]).area() > 0)
+					{
+						regions[a] |= regions[b];
+						regions.erase(regions.begin() + b);
+
+						merged = true;
+					}
+					else
+					{
+						b++;
+					}
+				}
+			}
+		}
+	}
+
+	bool BorderTracer::ApproximateQuad(double epsilon, Quad& quad)
+	{
+		int count = (int) this->contour.size();
+
+		if(count < 4)
+			return false;
+
+		// split the closed contour at the point farthest away from the first one
+		int farthest = 0;
+		double maxDistance = 0;
+
+		for(int a = 1; a < count; a++)
+		{
+			double dx = this->contour[a].x - this->contour[0].x;
+			double dy = this->contour[a].y - this->contour[0].y;
+			double distance = dx * dx + dy * dy;
+
+			if(distance > maxDistance)
+			{
+				maxDistance = distance;
+				farthest = a;
+			}
+		}
+
+		if(maxDistance <= epsilon * epsilon)
+			return false;
+
+		// douglas-peucker on both halves, the slices are processed in contour order
+		this->polygon.clear();
+		this->slices.clear();
+
+		this->slices.push_back(cv::Vec2i(farthest, count));
+		this->slices.push_back(cv::Vec2i(0, farthest));
+
+		while(!this->slices.empty())
+		{
+			cv::Vec2i slice = this->slices.back();
+			this->slices.pop_back();
+
+			const cv::Point& begin = this->contour[slice[0]];
+			const cv::Point& end = this->contour[slice[1] % count];
+
+			double dx = end.x - begin.x;
+			double dy = end.y - begin.y;
+
+			double maxDeviation = 0;
+			int split = -1;
+
+			for(int a = slice[0] + 1; a < slice[1]; a++)
+			{
+				double deviation = std::abs((this->contour[a].y - begin.y) * dx - (this->contour[a].x - begin.x) * dy);
+
+				if(deviation > maxDeviation)
+				{
+					maxDeviation = deviation;
+					split = a;
+				}
+			}
+
+			if(split >= 0 && maxDeviation * maxDeviation > epsilon * epsilon * (dx * dx + dy * dy))
+			{
+				this->slices.push_back(cv::Vec2i(split, slice[1]));
+				this->slices.push_back(cv::Vec2i(slice[0], split));
+			}
+			else
+			{
+				this->polygon.push_back(begin);
+
+				if(this->polygon.size() > MaxPolygonVertices)
+					return false;
+			}
+		}
+
+		// drop vertices lying (almost) on the line between their neighbours
+		for(int a = 0; a < this->polygon.size() && this->polygon.size() > 3;)
+		{
+			int n = (int) this->polygon.size();
+
+			const cv::Point& previous = this->polygon[(a + n - 1) % n];
+			const cv::Point& next = this->polygon[(a + 1) % n];
+
+			double dx = next.x - previous.x;
+			double dy = next.y - previous.y;
+			double deviation = (this->polygon[a].y - previous.y) * dx - (this->polygon[a].x - previous.x) * dy;
+
+			if(deviation * deviation <= 0.5 * epsilon * epsilon * (dx * dx + dy * dy))
+			{
+				this->polygon.erase(this->polygon.begin() + a);
+			}
+			else
+			{
+				a++;
+			}
+		}
+
+		if(this->polygon.size() != 4)
+			return false;
+
+		std::copy(this->polygon.begin(), this->polygon.end(), quad.Corners);
+
+		return true;
+	}
+}
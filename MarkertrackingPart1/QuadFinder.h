@@ -0,0 +1,129 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include "ThreadPool.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	class Quad
+	{
+	public:
+		cv::Point Corners[4];
+	};
+
+	typedef std::vector<Quad> QuadContainer;
+
+	/**
+	 * follows the borders between foreground and background (Suzuki & Abe)
+	 * inside a region of a binary image. the region is copied into a label
+	 * buffer with a background frame. the rows above and below can be seams to
+	 * the neighbouring bands, they then count as foreground so holes cut by a
+	 * seam stay closed; for contours reaching the row next to a seam the bounds of
+	 * their pieces are reported instead of a polygon. a piece follows the contour
+	 * along a seam as long as the neighbouring band has foreground there, so pieces
+	 * only connected through the seam rows end up in the same stitch region.
+	 */
+	class BorderTracer
+	{
+	private:
+		enum TraceResult { Dropped, Candidate, Cut };
+
+		int minSize;
+		int maxWidth;
+		double approximationAccuracy;
+
+		// 0 background, 1 foreground, 2 visited border, 3 visited border with background on the right, 4 seam
+		cv::Mat buffer;
+		cv::Mat labels;
+
+		bool seamTop;
+		bool seamBottom;
+
+		// the rows of the neighbouring bands behind the seams
+		const unsigned char* seamAbove;
+		const unsigned char* seamBelow;
+
+		std::vector<cv::Point> contour;
+		std::vector<cv::Point> polygon;
+		std::vector<cv::Vec2i> slices;
+
+		cv::Rect bounds;
+		std::vector<cv::Rect> pieces;
+
+		TraceResult TraceBorder(unsigned char* start, int x, int y, bool hole, double& perimeter);
+
+		bool ApproximateQuad(double epsilon, Quad& quad);
+	public:
+		BorderTracer(int minSize, double approximationAccuracy);
+		~BorderTracer(void);
+
+		/**
+		 * @param seams if given, only contours touching one of these rows or the row above are accepted
+		 * @param cut if given, receives the bounds of the contour pieces cut by a seam of the region
+		 */
+		void Trace(const cv::Mat& binary, const cv::Rect& region, int maxWidth, bool seamTop, bool seamBottom, const std::vector<int>* seams, QuadContainer& quads, std::vector<cv::Rect>* cut);
+	};
+
+	/**
+	 * finds 4-vertex polygons in a binary image. contours which are too small,
+	 * too large or touch the image border are dropped while they are traced,
+	 * all buffers are reused between frames.
+	 *
+	 * with more than one band the image is split into horizontal bands which
+	 * are traced in parallel. contours cut by a seam between two bands are
+	 * traced again in a region covering all of their pieces, so the result is
+	 * the same as the one of a single band.
+	 */
+	class QuadFinder
+	{
+	private:
+		int minSize;
+		int borderMargin;
+		double approximationAccuracy;
+
+		int bandCount;
+
+		std::vector<BorderTracer> tracers;
+		std::vector<QuadContainer> bandQuads;
+		std::vector<std::vector<cv::Rect> > bandCuts;
+
+		std::vector<int> seams;
+		std::vector<cv::Rect> stitchRegions;
+		std::vector<cv::Rect> searchRegions;
+
+		ThreadPool* pool;
+
+		QuadContainer quads;
+
+		// merges overlapping regions until all of them are disjoint
+		static void MergeRegions(std::vector<cv::Rect>& regions);
+
+		// owns the thread pool
+		QuadFinder(const QuadFinder&);
+		QuadFinder& operator=(const QuadFinder&);
+	public:
+		QuadFinder(int minSize = 35, int borderMargin = 10, double approximationAccuracy = 0.02);
+		~QuadFinder(void);
+
+		int GetBandCount(void) const;
+		void SetBandCount(int bandCount);
+
+		// the binary image has to be CV_8UC1
+		const QuadContainer& Find(const cv::Mat& binary);
+
+		// only traces inside the regions, contours crossing a region border are dropped
+		const QuadContainer& Find(const cv::Mat& binary, const std::vector<cv::Rect>& regions);
+	};
+}
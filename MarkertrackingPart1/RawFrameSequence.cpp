@@ -0,0 +1,237 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "RawFrameSequence.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace TUMAugmentedRealityExercise
+{
+	static const char RawFrameMagic[4] = { 'T', 'A', 'R', 'F' };
+	static const int RawFrameVersion = 1;
+
+	static int GetRawFrameStride(int width, int type)
+	{
+		int bytes = width * CV_ELEM_SIZE(type);
+
+		return (bytes + 15) & ~15;
+	}
+
+	RawFrameVideoSource::RawFrameVideoSource(const std::string& file) :
+		data(NULL),
+		size(0),
+		recordSize(0),
+		file(NULL),
+		mapping(NULL),
+		currentFrame(0),
+		timestamp(0),
+		looping(true)
+	{
+#ifdef _WIN32
+		HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+		if(handle == INVALID_HANDLE_VALUE)
+			CV_Error(cv::Error::StsError, "can't open raw frame sequence " + file);
+
+		LARGE_INTEGER length;
+		GetFileSizeEx(handle, &length);
+
+		HANDLE view = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+		this->file = handle;
+		this->mapping = view;
+		this->size = (size_t) length.QuadPart;
+		this->data = view != NULL ? (unsigned char*) MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+		int handle = open(file.c_str(), O_RDONLY);
+
+		if(handle < 0)
+			CV_Error(cv::Error::StsError, "can't open raw frame sequence " + file);
+
+		struct stat status;
+		fstat(handle, &status);
+
+		this->size = (size_t) status.st_size;
+
+		// read only, writing into a frame faults instead of changing it for the next loop
+		void* view = this->size > 0 ? mmap(NULL, this->size, PROT_READ, MAP_PRIVATE, handle, 0) : MAP_FAILED;
+
+		// the mapping stays valid without the descriptor
+		close(handle);
+
+		this->data = view != MAP_FAILED ? (unsigned char*) view : NULL;
+
+		if(this->data != NULL)
+			madvise(this->data, this->size, MADV_SEQUENTIAL);
+#endif
+
+		if(this->data == NULL || this->size < sizeof(RawFrameSequenceHeader))
+			CV_Error(cv::Error::StsError, "can't map raw frame sequence " + file);
+
+		std::memcpy(&this->header, this->data, sizeof(RawFrameSequenceHeader));
+
+		if(std::memcmp(this->header.Magic, RawFrameMagic, sizeof(RawFrameMagic)) != 0 || this->header.Version != RawFrameVersion)
+			CV_Error(cv::Error::StsError, "unsupported raw frame sequence " + file);
+
+		// the images are built over the mapping, so a row must fit into the stride and a frame into the file
+		bool valid =
+			this->header.Width > 0 && this->header.Height > 0 &&
+			this->header.Type == CV_MAT_TYPE(this->header.Type) &&
+			(long long) this->header.Stride >= (long long) this->header.Width * CV_ELEM_SIZE(this->header.Type) &&
+			this->header.FrameCount >= 0;
+
+		if(!valid)
+			CV_Error(cv::Error::StsError, "corrupt raw frame sequence header " + file);
+
+		this->recordSize = sizeof(RawFrameHeader) + (size_t) this->header.Height * this->header.Stride;
+
+		size_t frames = (this->size - sizeof(RawFrameSequenceHeader)) / this->recordSize;
+
+		if((size_t) this->header.FrameCount > frames)
+			CV_Error(cv::Error::StsError, "raw frame sequence " + file + " ends before its last frame");
+
+		// a recording which wasn't closed properly has no frame count, but still all complete frames
+		if(this->header.FrameCount == 0)
+			this->header.FrameCount = (int) frames;
+
+		if(this->header.FrameCount == 0)
+			CV_Error(cv::Error::StsError, "empty raw frame sequence " + file);
+	}
+
+	RawFrameVideoSource::~RawFrameVideoSource(void)
+	{
+#ifdef _WIN32
+		if(this->data != NULL)
+			UnmapViewOfFile(this->data);
+
+		if(this->mapping != NULL)
+			CloseHandle((HANDLE) this->mapping);
+
+		if(this->file != NULL)
+			CloseHandle((HANDLE) this->file);
+#else
+		if(this->data != NULL)
+			munmap(this->data, this->size);
+#endif
+	}
+
+	int RawFrameVideoSource::GetFPS(void)
+	{
+		return this->header.FPS;
+	}
+
+	void RawFrameVideoSource::GetNextImage(cv::Mat& buffer)
+	{
+		if(!this->HasNextImage())
+		{
+			buffer = cv::Mat();
+			return;
+		}
+
+		if(this->currentFrame == this->header.FrameCount)
+			this->currentFrame = 0;
+
+		unsigned char* record = this->data + sizeof(RawFrameSequenceHeader) + this->currentFrame * this->recordSize;
+
+		this->timestamp = ((RawFrameHeader*) record)->Timestamp;
+
+		buffer = cv::Mat(this->header.Height, this->header.Width, this->header.Type, record + sizeof(RawFrameHeader), this->header.Stride);
+
+		this->currentFrame++;
+	}
+
+	void RawFrameVideoSource::SetLooping(bool looping)
+	{
+		this->looping = looping;
+	}
+
+	bool RawFrameVideoSource::HasNextImage(void)
+	{
+		return this->header.FrameCount > 0 && (this->looping || this->currentFrame < this->header.FrameCount);
+	}
+
+	int RawFrameVideoSource::GetFrameCount(void)
+	{
+		return this->header.FrameCount;
+	}
+
+	double RawFrameVideoSource::GetTimestamp(void)
+	{
+		return this->timestamp;
+	}
+
+	RawFrameRecorder::RawFrameRecorder(const std::string& file, int fps) :
+		stream(file.c_str(), std::ios::out | std::ios::binary | std::ios::trunc)
+	{
+		if(!this->stream)
+			CV_Error(cv::Error::StsError, "can't create raw frame sequence " + file);
+
+		std::memset(&this->header, 0, sizeof(RawFrameSequenceHeader));
+		std::memcpy(this->header.Magic, RawFrameMagic, sizeof(RawFrameMagic));
+
+		this->header.Version = RawFrameVersion;
+		this->header.FPS = fps;
+	}
+
+	RawFrameRecorder::~RawFrameRecorder(void)
+	{
+		// the frame count is only known now
+		this->stream.seekp(0);
+		this->stream.write((const char*) &this->header, sizeof(RawFrameSequenceHeader));
+	}
+
+	void RawFrameRecorder::Write(const cv::Mat& frame, double timestamp)
+	{
+		if(this->header.FrameCount == 0)
+		{
+			this->header.Width = frame.cols;
+			this->header.Height = frame.rows;
+			this->header.Type = frame.type();
+			this->header.Stride = GetRawFrameStride(frame.cols, frame.type());
+
+			this->padding.assign(this->header.Stride - frame.cols * frame.elemSize(), 0);
+
+			this->stream.write((const char*) &this->header, sizeof(RawFrameSequenceHeader));
+		}
+
+		CV_Assert(frame.cols == this->header.Width && frame.rows == this->header.Height && frame.type() == this->header.Type);
+
+		RawFrameHeader record;
+		record.Timestamp = timestamp;
+		record.Index = this->header.FrameCount;
+		record.Reserved = 0;
+
+		this->stream.write((const char*) &record, sizeof(RawFrameHeader));
+
+		for(int y = 0; y < frame.rows; y++)
+		{
+			this->stream.write((const char*) frame.ptr<unsigned char>(y), frame.cols * frame.elemSize());
+
+			if(!this->padding.empty())
+				this->stream.write(&this->padding[0], this->padding.size());
+		}
+
+		this->header.FrameCount++;
+	}
+
+	int RawFrameRecorder::GetFrameCount(void)
+	{
+		return this->header.FrameCount;
+	}
+}
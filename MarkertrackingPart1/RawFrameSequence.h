@@ -0,0 +1,105 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include <opencv2/imgproc.hpp>
+
+#include "VideoSource.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * layout of a raw frame sequence file: this header followed by FrameCount
+	 * records of a RawFrameHeader and Height rows of Stride bytes each. the
+	 * stride is a multiple of 16, so all rows of a mapped file are aligned.
+	 */
+	struct RawFrameSequenceHeader
+	{
+		char Magic[4];
+		int Version;
+		int Width;
+		int Height;
+		int Type;
+		int Stride;
+		int FPS;
+		int FrameCount;
+	};
+
+	struct RawFrameHeader
+	{
+		// capture time in ms
+		double Timestamp;
+		int Index;
+		int Reserved;
+	};
+
+	/**
+	 * replays a raw frame sequence from a memory mapping. the images are views
+	 * into the mapping, no frame is copied or decoded. the mapping is read only,
+	 * so every loop replays the same pixels: clone a frame before writing to it.
+	 */
+	class RawFrameVideoSource : public VideoSource
+	{
+	private:
+		RawFrameSequenceHeader header;
+
+		unsigned char* data;
+		size_t size;
+		size_t recordSize;
+
+		// platform handles of the mapping
+		void* file;
+		void* mapping;
+
+		int currentFrame;
+		double timestamp;
+
+		bool looping;
+	public:
+		RawFrameVideoSource(const std::string& file);
+		~RawFrameVideoSource(void);
+
+		int GetFPS(void);
+
+		void GetNextImage(cv::Mat& buffer);
+
+		void SetLooping(bool looping);
+		bool HasNextImage(void);
+
+		int GetFrameCount(void);
+
+		// capture time of the last returned frame in ms
+		double GetTimestamp(void);
+	};
+
+	/**
+	 * writes frames to a raw frame sequence file, all frames must have the size
+	 * and type of the first one.
+	 */
+	class RawFrameRecorder
+	{
+	private:
+		std::ofstream stream;
+		RawFrameSequenceHeader header;
+
+		std::vector<char> padding;
+	public:
+		RawFrameRecorder(const std::string& file, int fps);
+		~RawFrameRecorder(void);
+
+		void Write(const cv::Mat& frame, double timestamp);
+
+		int GetFrameCount(void);
+	};
+}
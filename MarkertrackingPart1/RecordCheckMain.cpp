@@ -0,0 +1,305 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "MarkerRecord.h"
+#include "MarkerPublisher.h"
+
+using namespace TUMAugmentedRealityExercise;
+
+// markers whose id, corners and pose are derived from the frame number, so a torn copy can be told apart
+static void FillMarkers(MarkerContainer& markers, int frameNumber)
+{
+	for(int a = 0; a < markers.size(); a++)
+	{
+		Marker& marker = markers[a];
+		marker.MarkerId = frameNumber * (int) markers.size() + a;
+
+		for(int b = 0; b < 4; b++)
+		{
+			marker.Corners[b] = cv::Point(frameNumber + b, a + b);
+		}
+	}
+}
+
+static MarkerContainer CreateMarkers(int count)
+{
+	std::vector<cv::Point> corners(4);
+
+	return MarkerContainer(count, Marker(corners));
+}
+
+static bool IsConsistent(const MarkerRecordReader& records, int frameNumber, double timestamp)
+{
+	for(int a = 0; a < records.GetRecordCount(); a++)
+	{
+		const MarkerRecord& record = records.GetRecord(a);
+
+		if(record.FrameNumber != frameNumber || record.Timestamp != timestamp || record.MarkerId != frameNumber * records.GetRecordCount() + a || record.Corners[3][0] != frameNumber + 3)
+			return false;
+	}
+
+	return true;
+}
+
+// a second, writable view of a publisher's ring, to put its slots into the states a reader has to retry on
+class RingView
+{
+private:
+	unsigned char* data;
+	size_t size;
+	void* mapping;
+public:
+	RingView(const std::string& name, size_t size) : data(NULL), size(size), mapping(NULL)
+	{
+#ifdef _WIN32
+		HANDLE view = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, ("Local\\" + name).c_str());
+
+		this->mapping = view;
+		this->data = view != NULL ? (unsigned char*) MapViewOfFile(view, FILE_MAP_ALL_ACCESS, 0, 0, size) : NULL;
+#else
+		int handle = shm_open(("/" + name).c_str(), O_RDWR, 0);
+		void* view = handle >= 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0) : MAP_FAILED;
+
+		if(handle >= 0)
+			close(handle);
+
+		this->data = view != MAP_FAILED ? (unsigned char*) view : NULL;
+#endif
+
+		if(this->data == NULL)
+			CV_Error(cv::Error::StsError, "can't map shared memory " + name);
+	}
+
+	~RingView(void)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(this->data);
+		CloseHandle((HANDLE) this->mapping);
+#else
+		munmap(this->data, this->size);
+#endif
+	}
+
+	MarkerRingSlot& GetSlot(long long sequence)
+	{
+		const MarkerRingHeader* header = (const MarkerRingHeader*) this->data;
+
+		return *(MarkerRingSlot*) (this->data + sizeof(MarkerRingHeader) + (sequence % header->SlotCount) * header->SlotSize);
+	}
+};
+
+static bool Check(bool condition, const std::string& message)
+{
+	std::cout << (condition ? "passed: " : "FAILED: ") << message << std::endl;
+
+	return condition;
+}
+
+// frames written to a file are read back with their poses, an incomplete record at the end is left out
+static bool CheckRecordFile(const std::string& file)
+{
+	MarkerContainer markers = CreateMarkers(3);
+
+	markers[1].Pose = new float[16];
+
+	// a rotation of 90 degrees about z and a translation
+	float pose[16] = { 0, -1, 0, 1, 1, 0, 0, 2, 0, 0, 1, 3, 0, 0, 0, 1 };
+	std::copy(pose, pose + 16, markers[1].Pose);
+	markers[1].PoseError = 0.5f;
+
+	{
+		MarkerRecordWriter writer(file);
+
+		FillMarkers(markers, 0);
+		writer.Write(0, 0, markers);
+
+		// frames without markers don't write anything
+		writer.Write(1, 40, MarkerContainer());
+
+		FillMarkers(markers, 2);
+		writer.Write(2, 80, markers);
+	}
+
+	bool passed = true;
+
+	{
+		MarkerRecordReader reader(file);
+
+		passed = Check(reader.GetRecordCount() == 6, "6 records in the file") && passed;
+		passed = Check(reader.GetRecordCount() == 6 && reader.GetRecord(3).FrameNumber == 2 && reader.GetRecord(3).Timestamp == 80 && reader.GetRecord(5).MarkerId == 8, "records keep their frame, timestamp and id") && passed;
+
+		float unpacked[16];
+		UnpackMarkerPose(reader.GetRecord(4), unpacked);
+
+		double difference = 0;
+
+		for(int a = 0; a < 16; a++)
+		{
+			difference = std::max(difference, (double) std::abs(unpacked[a] - pose[a]));
+		}
+
+		passed = Check(difference < 1e-6 && reader.GetRecord(4).Error == 0.5f && reader.GetRecord(3).Error < 0, "poses survive packing") && passed;
+	}
+
+	{
+		// a writer which was interrupted in the middle of a record
+		std::ofstream stream(file.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+		stream.write("partial", 7);
+	}
+
+	MarkerRecordReader truncated(file);
+	passed = Check(truncated.GetRecordCount() == 6, "an incomplete record at the end is left out") && passed;
+
+	std::remove(file.c_str());
+
+	return passed;
+}
+
+// a subscriber which polls less often than frames are published gets the latest frame
+static bool CheckOverrun(const std::string& name)
+{
+	MarkerPublisher publisher(name, 4, 8);
+	MarkerSubscriber subscriber(name);
+
+	bool passed = Check(!subscriber.Poll(), "nothing to poll before the first frame");
+
+	MarkerContainer markers = CreateMarkers(5);
+
+	for(int a = 0; a < 10; a++)
+	{
+		FillMarkers(markers, a);
+		publisher.Write(a, a * 40.0, markers);
+	}
+
+	passed = Check(subscriber.Poll() && subscriber.GetSequence() == 9 && subscriber.GetFrameNumber() == 9, "a subscriber lapped by the publisher skips to the latest frame") && passed;
+	passed = Check(IsConsistent(subscriber.GetRecords(), 9, 360.0) && subscriber.GetRecords().GetRecordCount() == 5, "the latest frame is read completely") && passed;
+	passed = Check(!subscriber.Poll(), "the same frame isn't polled twice") && passed;
+
+	// markers beyond the size of a slot are left out
+	markers = CreateMarkers(12);
+	FillMarkers(markers, 10);
+	publisher.Write(10, 400.0, markers);
+
+	passed = Check(subscriber.Poll() && subscriber.GetSequence() == 10 && subscriber.GetRecords().GetRecordCount() == 8, "a slot holds at most its maximum of markers") && passed;
+
+	return passed;
+}
+
+// a slot which is written or already holds a newer frame is retried a few times and then left for the next poll
+static bool CheckRetry(const std::string& name)
+{
+	MarkerPublisher publisher(name, 4, 8);
+	MarkerSubscriber subscriber(name);
+	RingView ring(name, sizeof(MarkerRingHeader) + 4 * (sizeof(MarkerRingSlot) + 8 * sizeof(MarkerRecord)));
+
+	MarkerContainer markers = CreateMarkers(5);
+
+	for(int a = 0; a < 3; a++)
+	{
+		FillMarkers(markers, a);
+		publisher.Write(a, a * 40.0, markers);
+	}
+
+	MarkerRingSlot& slot = ring.GetSlot(2);
+	long long complete = slot.Sequence.load();
+
+	slot.Sequence.store(2 * 2 + 1);
+	bool passed = Check(!subscriber.Poll() && subscriber.GetSequence() == -1, "a slot which is written isn't read");
+
+	// the writer lapped the reader and started on this slot before it published the frame as latest
+	slot.Sequence.store(2 * (2 + 4) + 1);
+	passed = Check(!subscriber.Poll() && subscriber.GetSequence() == -1, "a slot which holds a newer frame isn't read") && passed;
+
+	slot.Sequence.store(complete);
+	passed = Check(subscriber.Poll() && subscriber.GetSequence() == 2 && IsConsistent(subscriber.GetRecords(), 2, 80.0), "the frame is read once its slot is complete") && passed;
+
+	return passed;
+}
+
+// the publisher rewrites the slots of a two slot ring while the subscriber copies them, no torn copy may be returned.
+// it only races on more than one core
+static bool CheckConcurrentReads(const std::string& name, int frames)
+{
+	MarkerPublisher publisher(name, 2, 1024);
+	MarkerSubscriber subscriber(name);
+
+	std::thread writer([&]()
+	{
+		MarkerContainer markers = CreateMarkers(1024);
+
+		for(int a = 0; a < frames; a++)
+		{
+			FillMarkers(markers, a);
+			publisher.Write(a, a * 40.0, markers);
+		}
+	});
+
+	int polled = 0;
+	int torn = 0;
+	int skipped = 0;
+	long long last = -1;
+
+	// the last frame stays in its slot once the writer is done, so it is always polled
+	while(last < frames - 1)
+	{
+		if(!subscriber.Poll())
+			continue;
+
+		if(!IsConsistent(subscriber.GetRecords(), subscriber.GetFrameNumber(), subscriber.GetFrameNumber() * 40.0) || subscriber.GetRecords().GetRecordCount() != 1024 || subscriber.GetSequence() <= last)
+			torn++;
+
+		skipped += (int) (subscriber.GetSequence() - last - 1);
+		last = subscriber.GetSequence();
+		polled++;
+	}
+
+	writer.join();
+
+	std::ostringstream message;
+	message << polled << " of " << frames << " frames polled while they were written, " << skipped << " overrun, " << torn << " torn";
+
+	return Check(torn == 0, message.str());
+}
+
+// markertracking_record_check [frames=2000], writes records to a file and through shared memory and reads them back
+int main(int argc, char* argv[])
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 2000;
+
+	std::ostringstream name;
+	name << "tumar-record-check-" << cv::getTickCount();
+
+	bool passed = CheckRecordFile(name.str() + ".markers");
+	passed = CheckOverrun(name.str()) && passed;
+	passed = CheckRetry(name.str()) && passed;
+	passed = CheckConcurrentReads(name.str(), frames) && passed;
+
+	std::cout << (passed ? "passed" : "FAILED") << std::endl;
+
+	return passed ? 0 : 1;
+}
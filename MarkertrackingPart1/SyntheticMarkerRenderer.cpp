@@ -0,0 +1,251 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "SyntheticMarkerRenderer.h"
+#include "Marker.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace TUMAugmentedRealityExercise
+{
+	// the texture holds the 6x6 cells of the marker and a white quiet zone of one cell around them
+	static const int CellPixels = 16;
+	static const int TextureCells = 8;
+
+	static const int MaxPlacementAttempts = 20;
+
+	static const double DegreesToRadians = 3.14159265358979323846 / 180.0;
+
+	// row-major product of two 3x3 matrices
+	static void Multiply(const double* a, const double* b, double* result)
+	{
+		for(int row = 0; row < 3; row++)
+		{
+			for(int col = 0; col < 3; col++)
+			{
+				result[row * 3 + col] = a[row * 3] * b[col] + a[row * 3 + 1] * b[3 + col] + a[row * 3 + 2] * b[6 + col];
+			}
+		}
+	}
+
+	SyntheticMarkerRenderer::SyntheticMarkerRenderer(const cv::Size& size, float focalLength, float markerSize, unsigned long long seed, const SyntheticFrameSettings& settings) :
+		size(size),
+		focalLength(focalLength),
+		principalPoint(0.5f * size.width, 0.5f * size.height),
+		markerSize(markerSize),
+		settings(settings),
+		rng(seed),
+		texture(TextureCells * CellPixels, TextureCells * CellPixels, CV_8UC1),
+		textureMask(TextureCells * CellPixels, TextureCells * CellPixels, CV_8UC1)
+	{
+		this->textureMask.setTo(cv::Scalar(255));
+	}
+
+	SyntheticMarkerRenderer::~SyntheticMarkerRenderer(void)
+	{
+	}
+
+	const cv::Point2f& SyntheticMarkerRenderer::GetPrincipalPoint(void) const
+	{
+		return this->principalPoint;
+	}
+
+	// a random code which the detector accepts, the id is read back like the detector does
+	int SyntheticMarkerRenderer::NextCode(int& markerId)
+	{
+		cv::Mat cells(6, 6, CV_8UC1);
+
+		for(;;)
+		{
+			int code = this->rng.uniform(1, 0xffff);
+
+			cells.setTo(cv::Scalar(0));
+
+			for(int a = 0; a < 16; a++)
+			{
+				if((code & (0x8000 >> a)) == 0)
+					cells.at<unsigned char>(1 + (a >> 2), 1 + (a & 3)) = 255;
+			}
+
+			int rotation;
+			markerId = Marker::ReadCode(cells, rotation);
+
+			if(markerId != 0 && markerId != 0xffff)
+				return code;
+		}
+	}
+
+	void SyntheticMarkerRenderer::DrawTexture(int code, int black, int white)
+	{
+		this->texture.setTo(cv::Scalar(white));
+
+		for(int row = 1; row < TextureCells - 1; row++)
+		{
+			for(int col = 1; col < TextureCells - 1; col++)
+			{
+				bool border = row == 1 || row == TextureCells - 2 || col == 1 || col == TextureCells - 2;
+				bool set = !border && (code & (0x8000 >> ((row - 2) * 4 + col - 2))) != 0;
+
+				if(border || set)
+					this->texture(cv::Rect(col * CellPixels, row * CellPixels, CellPixels, CellPixels)).setTo(cv::Scalar(black));
+			}
+		}
+	}
+
+	bool SyntheticMarkerRenderer::PlaceMarker(const cv::Rect& area, SyntheticMarker& marker, cv::Point2f* quietZone)
+	{
+		double half = 0.5 * this->markerSize;
+		double quiet = half * TextureCells / (TextureCells - 2);
+
+		// clockwise in the image when the marker faces the camera
+		double corners[8][2] = {
+			{ -half, -half }, { half, -half }, { half, half }, { -half, half },
+			{ -quiet, -quiet }, { quiet, -quiet }, { quiet, quiet }, { -quiet, quiet }
+		};
+
+		for(int attempt = 0; attempt < MaxPlacementAttempts; attempt++)
+		{
+			double pixels = this->rng.uniform((double) this->settings.MinMarkerPixels, (double) std::min(this->settings.MaxMarkerPixels, 0.6f * std::min(area.width, area.height)));
+			double distance = this->focalLength * this->markerSize / pixels;
+
+			double tiltX = this->rng.uniform(-1.0, 1.0) * this->settings.MaxTilt * DegreesToRadians;
+			double tiltY = this->rng.uniform(-1.0, 1.0) * this->settings.MaxTilt * DegreesToRadians;
+			double spin = this->rng.uniform(0.0, 360.0) * DegreesToRadians;
+
+			double rx[9] = { 1, 0, 0, 0, std::cos(tiltX), -std::sin(tiltX), 0, std::sin(tiltX), std::cos(tiltX) };
+			double ry[9] = { std::cos(tiltY), 0, std::sin(tiltY), 0, 1, 0, -std::sin(tiltY), 0, std::cos(tiltY) };
+			double rz[9] = { std::cos(spin), -std::sin(spin), 0, std::sin(spin), std::cos(spin), 0, 0, 0, 1 };
+
+			double tilt[9];
+			double rotation[9];
+			Multiply(ry, rx, tilt);
+			Multiply(tilt, rz, rotation);
+
+			double u = this->rng.uniform(area.x + 0.5 * pixels, area.x + area.width - 0.5 * pixels);
+			double v = this->rng.uniform(area.y + 0.5 * pixels, area.y + area.height - 0.5 * pixels);
+
+			double translation[3] = { (u - this->principalPoint.x) * distance / this->focalLength, (v - this->principalPoint.y) * distance / this->focalLength, -distance };
+
+			bool inside = true;
+			cv::Point2f projected[8];
+
+			// the camera looks along -z, like projectPoint of the pose estimation
+			for(int a = 0; a < 8; a++)
+			{
+				double x = rotation[0] * corners[a][0] + rotation[1] * corners[a][1] + translation[0];
+				double y = rotation[3] * corners[a][0] + rotation[4] * corners[a][1] + translation[1];
+				double z = rotation[6] * corners[a][0] + rotation[7] * corners[a][1] + translation[2];
+
+				projected[a] = cv::Point2f((float) (this->principalPoint.x + this->focalLength * x / -z), (float) (this->principalPoint.y + this->focalLength * y / -z));
+
+				inside = inside && z < 0 && projected[a].x >= area.x + 2 && projected[a].x < area.x + area.width - 2 && projected[a].y >= area.y + 2 && projected[a].y < area.y + area.height - 2;
+			}
+
+			if(!inside)
+				continue;
+
+			for(int a = 0; a < 9; a++)
+			{
+				marker.Rotation[a] = (float) rotation[a];
+			}
+
+			for(int a = 0; a < 3; a++)
+			{
+				marker.Translation[a] = (float) translation[a];
+			}
+
+			for(int a = 0; a < 4; a++)
+			{
+				marker.Corners[a] = projected[a];
+				quietZone[a] = projected[4 + a];
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void SyntheticMarkerRenderer::Render(cv::Mat& frame, std::vector<SyntheticMarker>& markers, int count)
+	{
+		markers.clear();
+
+		cv::Mat grey(this->size, CV_8UC1);
+		grey.setTo(cv::Scalar(this->rng.uniform(60, 200)));
+
+		int black = this->rng.uniform(0, std::max(256 - this->settings.MinContrast, 1));
+		int white = this->rng.uniform(std::min(black + this->settings.MinContrast, 255), 256);
+
+		// the texture coordinates of the marker corners, pixel centers are at integer coordinates
+		float first = CellPixels - 0.5f;
+		float last = (TextureCells - 1) * CellPixels - 0.5f;
+		cv::Point2f textureCorners[4] = { cv::Point2f(first, first), cv::Point2f(last, first), cv::Point2f(last, last), cv::Point2f(first, last) };
+
+		int width = this->size.width / std::max(count, 1);
+
+		for(int a = 0; a < count; a++)
+		{
+			SyntheticMarker marker;
+			cv::Point2f quietZone[4];
+
+			if(!this->PlaceMarker(cv::Rect(a * width, 0, width, this->size.height), marker, quietZone))
+				continue;
+
+			this->DrawTexture(this->NextCode(marker.MarkerId), black, white);
+
+			cv::Mat transform = cv::getPerspectiveTransform(textureCorners, marker.Corners);
+
+			// the texture is replicated beyond its border, so the interpolation doesn't darken the quiet zone
+			cv::warpPerspective(this->texture, this->warped, transform, this->size, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+			cv::warpPerspective(this->textureMask, this->warpedMask, transform, this->size, cv::INTER_NEAREST, cv::BORDER_CONSTANT, cv::Scalar(0));
+
+			this->warped.copyTo(grey, this->warpedMask);
+
+			markers.push_back(marker);
+		}
+
+		// uneven lighting
+		double gradientX = this->rng.uniform(-1.0, 1.0) * this->settings.MaxGradient;
+		double gradientY = this->rng.uniform(-1.0, 1.0) * this->settings.MaxGradient;
+
+		for(int y = 0; y < grey.rows; y++)
+		{
+			unsigned char* row = grey.ptr<unsigned char>(y);
+
+			for(int x = 0; x < grey.cols; x++)
+			{
+				double gain = 1 + gradientX * ((double) x / grey.cols - 0.5) + gradientY * ((double) y / grey.rows - 0.5);
+
+				row[x] = cv::saturate_cast<unsigned char>(row[x] * gain);
+			}
+		}
+
+		double blur = this->rng.uniform(0.0, (double) this->settings.MaxBlur);
+
+		if(blur > 0.2)
+			cv::GaussianBlur(grey, grey, cv::Size(), blur);
+
+		double noise = this->rng.uniform(0.0, (double) this->settings.MaxNoise);
+
+		if(noise > 0.5)
+		{
+			cv::Mat noisy;
+			cv::Mat offsets(this->size, CV_16SC1);
+
+			this->rng.fill(offsets, cv::RNG::NORMAL, cv::Scalar(0), cv::Scalar(noise));
+
+			grey.convertTo(noisy, CV_16SC1);
+			noisy += offsets;
+			noisy.convertTo(grey, CV_8UC1);
+		}
+
+		cv::cvtColor(grey, frame, cv::COLOR_GRAY2BGR);
+	}
+}
@@ -0,0 +1,104 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * ground truth of a rendered marker. the pose maps marker coordinates,
+	 * origin at the center, to camera coordinates like estimateSquarePose.
+	 */
+	struct SyntheticMarker
+	{
+		// the id the detector reports for the marker
+		int MarkerId;
+
+		// row-major 3x3 rotation and the translation of the marker center
+		float Rotation[9];
+		float Translation[3];
+
+		// the outer corners in pixels, clockwise in the image
+		cv::Point2f Corners[4];
+	};
+
+	/**
+	 * how hard the rendered frames are, each frame draws its conditions at random within these bounds.
+	 */
+	struct SyntheticFrameSettings
+	{
+		// side length of the markers in pixels when seen from the front
+		float MinMarkerPixels;
+		float MaxMarkerPixels;
+
+		// largest rotation out of the image plane, in degrees
+		float MaxTilt;
+
+		// largest gaussian blur and noise, in pixels and grey values
+		float MaxBlur;
+		float MaxNoise;
+
+		// smallest difference between the black and white cells in grey values
+		int MinContrast;
+
+		// strongest brightness change across the frame, relative to the brightness
+		float MaxGradient;
+
+		SyntheticFrameSettings(void) :
+			MinMarkerPixels(45),
+			MaxMarkerPixels(160),
+			MaxTilt(50),
+			MaxBlur(1.2f),
+			MaxNoise(6),
+			MinContrast(90),
+			MaxGradient(0.4f)
+		{
+		};
+	};
+
+	/**
+	 * renders grey frames with markers of known ids and poses for the
+	 * camera model of estimateSquarePose. the same seed renders the same
+	 * frames on every machine.
+	 */
+	class SyntheticMarkerRenderer
+	{
+	private:
+		cv::Size size;
+		float focalLength;
+		cv::Point2f principalPoint;
+		float markerSize;
+
+		SyntheticFrameSettings settings;
+
+		cv::RNG rng;
+
+		cv::Mat texture;
+		cv::Mat textureMask;
+		cv::Mat warped;
+		cv::Mat warpedMask;
+
+		int NextCode(int& markerId);
+		void DrawTexture(int code, int black, int white);
+
+		bool PlaceMarker(const cv::Rect& area, SyntheticMarker& marker, cv::Point2f* quietZone);
+	public:
+		SyntheticMarkerRenderer(const cv::Size& size, float focalLength, float markerSize, unsigned long long seed, const SyntheticFrameSettings& settings = SyntheticFrameSettings());
+		~SyntheticMarkerRenderer(void);
+
+		const cv::Point2f& GetPrincipalPoint(void) const;
+
+		// renders a BGR frame with up to count markers side by side, markers which don't fit are left out
+		void Render(cv::Mat& frame, std::vector<SyntheticMarker>& markers, int count = 1);
+	};
+}
@@ -0,0 +1,120 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "ThreadPool.h"
+#include "TraceRecorder.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	ThreadPool::ThreadPool(int threadCount) : running(true)
+	{
+		if(threadCount <= 0)
+			threadCount = GetDefaultThreadCount();
+
+		for(int a = 0; a < threadCount; a++)
+		{
+			this->threads.push_back(std::thread(&ThreadPool::Work, this));
+		}
+	}
+
+	ThreadPool::~ThreadPool(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->running = false;
+		}
+
+		this->jobAvailable.notify_all();
+
+		for(int a = 0; a < this->threads.size(); a++)
+		{
+			this->threads[a].join();
+		}
+	}
+
+	int ThreadPool::GetThreadCount(void) const
+	{
+		return (int) this->threads.size();
+	}
+
+	int ThreadPool::GetDefaultThreadCount(void)
+	{
+		return std::max(1, (int) std::thread::hardware_concurrency());
+	}
+
+	void ThreadPool::Enqueue(const std::function<void(void)>& job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->jobs.push_back(job);
+		}
+
+		this->jobAvailable.notify_one();
+	}
+
+	void ThreadPool::ParallelFor(int count, const std::function<void(int)>& body)
+	{
+		if(count <= 0)
+			return;
+
+		std::mutex doneMutex;
+		std::condition_variable done;
+		int remaining = count - 1;
+
+		for(int a = 1; a < count; a++)
+		{
+			this->Enqueue([&, a]()
+			{
+				body(a);
+
+				std::lock_guard<std::mutex> lock(doneMutex);
+
+				if(--remaining == 0)
+					done.notify_one();
+			});
+		}
+
+		// the calling thread takes the first chunk instead of idling
+		body(0);
+
+		std::unique_lock<std::mutex> lock(doneMutex);
+
+		while(remaining > 0)
+		{
+			done.wait(lock);
+		}
+	}
+
+	void ThreadPool::Work(void)
+	{
+		TraceRecorder::SetThreadName("pool");
+
+		for(;;)
+		{
+			std::function<void(void)> job;
+
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+
+				while(this->running && this->jobs.empty())
+				{
+					this->jobAvailable.wait(lock);
+				}
+
+				if(!this->running && this->jobs.empty())
+					return;
+
+				job = this->jobs.front();
+				this->jobs.pop_front();
+			}
+
+			job();
+		}
+	}
+}
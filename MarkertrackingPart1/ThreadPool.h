@@ -0,0 +1,51 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * fixed set of worker threads processing queued jobs in FIFO order.
+	 */
+	class ThreadPool
+	{
+	private:
+		std::vector<std::thread> threads;
+		std::deque<std::function<void(void)> > jobs;
+
+		std::mutex mutex;
+		std::condition_variable jobAvailable;
+
+		bool running;
+
+		void Work(void);
+	public:
+		// 0 creates one thread per core
+		ThreadPool(int threadCount = 0);
+		~ThreadPool(void);
+
+		int GetThreadCount(void) const;
+
+		void Enqueue(const std::function<void(void)>& job);
+
+		// calls body(0) ... body(count - 1) on the pool and the calling thread, returns when all calls are done
+		void ParallelFor(int count, const std::function<void(int)>& body);
+
+		static int GetDefaultThreadCount(void);
+	};
+}
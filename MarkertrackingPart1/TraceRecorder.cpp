@@ -0,0 +1,237 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "TraceRecorder.h"
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <iomanip>
+
+namespace TUMAugmentedRealityExercise
+{
+	struct TraceEvent
+	{
+		const char* Name;
+		int64 Begin;
+		int64 End;
+		int ThreadId;
+		int Frame;
+
+		// ring index of the last complete write to this slot, -1 if it is empty and -2 while it is written
+		std::atomic<int64> Committed;
+	};
+
+	static std::atomic<bool> recording(false);
+	static std::atomic<int64> nextEvent(0);
+	static std::vector<TraceEvent> events;
+	static std::atomic<int64> origin(0);
+
+	// threads inside Record, the ring is only replaced or read once there are none
+	static std::atomic<int> recordingThreads(0);
+
+	// serializes Start, Stop and Write
+	static std::mutex controlMutex;
+
+	static std::mutex threadMutex;
+	static std::map<int, std::string> threadNames;
+	static std::atomic<int> nextThreadId(0);
+
+	static thread_local int threadId = -1;
+	static thread_local int currentFrame = -1;
+
+	static int GetThreadId(void)
+	{
+		if(threadId < 0)
+			threadId = nextThreadId++;
+
+		return threadId;
+	}
+
+	// writes the string as a json string literal
+	static void WriteString(std::ostream& stream, const std::string& value)
+	{
+		static const char hex[] = "0123456789abcdef";
+
+		stream << '"';
+
+		for(int a = 0; a < value.size(); a++)
+		{
+			unsigned char c = (unsigned char) value[a];
+
+			if(c == '"' || c == '\\')
+				stream << '\\' << value[a];
+			else if(c == '\n')
+				stream << "\\n";
+			else if(c == '\r')
+				stream << "\\r";
+			else if(c == '\t')
+				stream << "\\t";
+			else if(c < 0x20 || c == 0x7f)
+				stream << "\\u00" << hex[c >> 4] << hex[c & 15];
+			else
+				stream << value[a];
+		}
+
+		stream << '"';
+	}
+
+	// stops the recording and waits for the threads which are still inside Record
+	static void StopRecording(void)
+	{
+		recording = false;
+
+		while(recordingThreads.load() != 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	void TraceRecorder::Start(int capacity)
+	{
+		std::lock_guard<std::mutex> lock(controlMutex);
+
+		StopRecording();
+
+		std::vector<TraceEvent> ring(std::max(capacity, 1));
+
+		for(int a = 0; a < ring.size(); a++)
+		{
+			ring[a].Committed.store(-1, std::memory_order_relaxed);
+		}
+
+		events.swap(ring);
+		nextEvent = 0;
+		origin = cv::getTickCount();
+
+		// publishes the ring and the origin to the threads which see the recording
+		recording = true;
+	}
+
+	void TraceRecorder::Stop(void)
+	{
+		std::lock_guard<std::mutex> lock(controlMutex);
+
+		StopRecording();
+	}
+
+	bool TraceRecorder::IsRecording(void)
+	{
+		return recording.load(std::memory_order_relaxed);
+	}
+
+	void TraceRecorder::SetThreadName(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(threadMutex);
+
+		threadNames[GetThreadId()] = name;
+	}
+
+	void TraceRecorder::SetFrame(int frame)
+	{
+		currentFrame = frame;
+	}
+
+	void TraceRecorder::Record(const char* name, int64 begin, int64 end)
+	{
+		// announced before the check, so a thread replacing the ring either waits for this one or is seen stopped
+		recordingThreads++;
+
+		if(!recording.load())
+		{
+			recordingThreads--;
+			return;
+		}
+
+		int64 index = nextEvent.fetch_add(1, std::memory_order_relaxed);
+		TraceEvent& event = events[index % events.size()];
+
+		// a thread which lapped the ring may still write this slot, the later span is dropped then
+		int64 committed = event.Committed.load(std::memory_order_relaxed);
+
+		if(committed == -2 || !event.Committed.compare_exchange_strong(committed, -2, std::memory_order_acquire))
+		{
+			recordingThreads--;
+			return;
+		}
+
+		event.Name = name;
+		event.Begin = begin;
+		event.End = end;
+		event.ThreadId = GetThreadId();
+		event.Frame = currentFrame;
+
+		event.Committed.store(index, std::memory_order_release);
+
+		recordingThreads--;
+	}
+
+	bool TraceRecorder::Write(const std::string& file)
+	{
+		std::lock_guard<std::mutex> lock(controlMutex);
+
+		StopRecording();
+
+		std::ofstream stream(file.c_str());
+
+		if(!stream)
+			return false;
+
+		double usPerTick = 1e6 / cv::getTickFrequency();
+		int64 start = origin.load();
+
+		int64 count = nextEvent.load();
+		int64 first = std::max<int64>(0, count - (int64) events.size());
+
+		stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+		stream << std::fixed << std::setprecision(3);
+
+		bool separator = false;
+
+		{
+			std::lock_guard<std::mutex> lock(threadMutex);
+
+			for(std::map<int, std::string>::const_iterator it = threadNames.begin(); it != threadNames.end(); ++it)
+			{
+				stream << (separator ? ",\n" : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << it->first << ",\"args\":{\"name\":";
+				WriteString(stream, it->second);
+				stream << "}}";
+
+				separator = true;
+			}
+		}
+
+		for(int64 index = first; index < count; index++)
+		{
+			const TraceEvent& event = events[index % events.size()];
+
+			// skip slots which were overwritten or are not complete
+			if(event.Committed.load(std::memory_order_acquire) != index)
+				continue;
+
+			stream << (separator ? ",\n" : "") << "{\"name\":";
+			WriteString(stream, event.Name);
+			stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.ThreadId << ",\"ts\":" << (event.Begin - start) * usPerTick << ",\"dur\":" << (event.End - event.Begin) * usPerTick;
+
+			if(event.Frame >= 0)
+				stream << ",\"args\":{\"frame\":" << event.Frame << "}";
+
+			stream << "}";
+
+			separator = true;
+		}
+
+		stream << std::endl << "]}" << std::endl;
+
+		return stream.good();
+	}
+}
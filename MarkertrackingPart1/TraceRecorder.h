@@ -0,0 +1,70 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <string>
+
+#include <opencv2/imgproc.hpp>
+
+// define TUMAR_NO_TRACING to remove all trace spans
+#ifdef TUMAR_NO_TRACING
+#define TUMAR_TRACE_SCOPE(name) ((void) 0)
+#define TUMAR_TRACE_FRAME(number) ((void) 0)
+#else
+#define TUMAR_TRACE_CONCAT_(a, b) a##b
+#define TUMAR_TRACE_CONCAT(a, b) TUMAR_TRACE_CONCAT_(a, b)
+
+// records a span until the end of the enclosing block, the name has to be a string literal
+#define TUMAR_TRACE_SCOPE(name) \
+	TUMAugmentedRealityExercise::TraceScope TUMAR_TRACE_CONCAT(traceScope, __LINE__)(name)
+
+// tags the following spans of this thread with the frame number and records a span for the frame itself
+#define TUMAR_TRACE_FRAME(number) \
+	TUMAugmentedRealityExercise::TraceRecorder::SetFrame(number); \
+	TUMAugmentedRealityExercise::TraceScope TUMAR_TRACE_CONCAT(traceFrame, __LINE__)("frame")
+#endif
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * records spans of all threads into a bounded ring and exports them in the
+	 * chrome trace event format (chrome://tracing, ui.perfetto.dev). a full
+	 * ring overwrites its oldest spans, so the export always shows the last
+	 * moments before it was written. while no recording is running a span
+	 * costs one atomic load. Start, Stop and Write wait for the threads which
+	 * are recording a span, so the ring can be replaced at any time.
+	 */
+	class TraceRecorder
+	{
+	public:
+		static void Start(int capacity = 1 << 16);
+		static void Stop(void);
+
+		static bool IsRecording(void);
+
+		static void SetThreadName(const std::string& name);
+		static void SetFrame(int frame);
+
+		static void Record(const char* name, int64 begin, int64 end);
+
+		// stops the recording, waiting for the spans other threads are recording
+		static bool Write(const std::string& file);
+	};
+
+	class TraceScope
+	{
+	private:
+		const char* name;
+		int64 begin;
+	public:
+		TraceScope(const char* name) : name(name), begin(TraceRecorder::IsRecording() ? cv::getTickCount() : 0) {};
+		~TraceScope(void) { if(this->begin != 0) TraceRecorder::Record(this->name, this->begin, cv::getTickCount()); };
+	};
+}
@@ -0,0 +1,314 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#include "UndistortionMap.h"
+#include "Profiler.h"
+
+#include <opencv2/calib3d.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+namespace TUMAugmentedRealityExercise
+{
+	struct UndistortionTableHeader
+	{
+		char Magic[4];
+		int Version;
+		int Width;
+		int Height;
+
+		// the table is rebuilt once the calibration changes
+		unsigned long long CoefficientHash;
+	};
+
+	static const char UndistortionTableMagic[4] = { 'T', 'A', 'U', 'M' };
+	static const int UndistortionTableVersion = 1;
+
+	// the inverse distortion has no closed form, a few fixed point iterations converge for any sane lens
+	static const int UndistortIterations = 5;
+
+	// rows per band of the multi-threaded remap
+	static const int RemapBandRows = 32;
+
+	static cv::Mat ReadMatrix(const cv::FileStorage& storage, const char* name)
+	{
+		cv::Mat matrix;
+		storage[name] >> matrix;
+
+		if(matrix.empty())
+			return cv::Mat();
+
+		cv::Mat result;
+		matrix.convertTo(result, CV_64FC1);
+
+		return result;
+	}
+
+	UndistortionMap::UndistortionMap(void) :
+		fx(1), fy(1), cx(0), cy(0),
+		k1(0), k2(0), p1(0), p2(0), k3(0)
+	{
+	}
+
+	UndistortionMap::~UndistortionMap(void)
+	{
+	}
+
+	bool UndistortionMap::Load(const std::string& calibrationFile)
+	{
+		cv::FileStorage storage;
+
+		if(!storage.open(calibrationFile, cv::FileStorage::READ))
+			return false;
+
+		cv::Mat intrinsic = ReadMatrix(storage, "intrinsic");
+		cv::Mat distortion = ReadMatrix(storage, "distortion");
+
+		// older calibrations don't know their image size
+		cv::Size calibrationSize((int) storage["image_width"], (int) storage["image_height"]);
+
+		storage.release();
+
+		if(intrinsic.rows != 3 || intrinsic.cols != 3 || distortion.total() < 4)
+			return false;
+
+		this->calibrationSize = calibrationSize;
+		this->resolution = calibrationSize;
+		this->calibratedIntrinsic = intrinsic;
+		this->intrinsic = intrinsic.clone();
+		this->distortion = cv::Mat::zeros(1, 5, CV_64FC1);
+
+		for(int a = 0; a < std::min((int) distortion.total(), 5); a++)
+		{
+			this->distortion.at<double>(0, a) = distortion.at<double>(a);
+		}
+
+		this->fx = intrinsic.at<double>(0, 0);
+		this->fy = intrinsic.at<double>(1, 1);
+		this->cx = intrinsic.at<double>(0, 2);
+		this->cy = intrinsic.at<double>(1, 2);
+
+		this->k1 = this->distortion.at<double>(0, 0);
+		this->k2 = this->distortion.at<double>(0, 1);
+		this->p1 = this->distortion.at<double>(0, 2);
+		this->p2 = this->distortion.at<double>(0, 3);
+		this->k3 = this->distortion.at<double>(0, 4);
+
+		size_t separator = calibrationFile.find_last_of("/\\");
+		this->cacheFolder = separator != std::string::npos ? calibrationFile.substr(0, separator) : ".";
+
+		// a table of the previous calibration is stale
+		this->size = cv::Size();
+		this->map1.release();
+		this->map2.release();
+
+		return true;
+	}
+
+	bool UndistortionMap::IsCalibrated(void) const
+	{
+		return !this->intrinsic.empty();
+	}
+
+	bool UndistortionMap::SetResolution(const cv::Size& resolution)
+	{
+		if(!this->IsCalibrated() || this->calibrationSize.area() == 0 || resolution == this->resolution)
+			return false;
+
+		double sx = (double) resolution.width / this->calibrationSize.width;
+		double sy = (double) resolution.height / this->calibrationSize.height;
+
+		this->resolution = resolution;
+
+		this->intrinsic = this->calibratedIntrinsic.clone();
+
+		for(int a = 0; a < 3; a++)
+		{
+			this->intrinsic.at<double>(0, a) *= sx;
+			this->intrinsic.at<double>(1, a) *= sy;
+		}
+
+		this->fx = this->intrinsic.at<double>(0, 0);
+		this->fy = this->intrinsic.at<double>(1, 1);
+		this->cx = this->intrinsic.at<double>(0, 2);
+		this->cy = this->intrinsic.at<double>(1, 2);
+
+		// the table belongs to the old intrinsics
+		this->size = cv::Size();
+		this->map1.release();
+		this->map2.release();
+
+		return true;
+	}
+
+	float UndistortionMap::GetFocalLength(void) const
+	{
+		return (float) (0.5 * (this->fx + this->fy));
+	}
+
+	cv::Point2f UndistortionMap::GetPrincipalPoint(void) const
+	{
+		return cv::Point2f((float) this->cx, (float) this->cy);
+	}
+
+	unsigned long long UndistortionMap::GetCoefficientHash(void) const
+	{
+		double coefficients[] = { this->fx, this->fy, this->cx, this->cy, this->k1, this->k2, this->p1, this->p2, this->k3 };
+
+		const unsigned char* bytes = (const unsigned char*) coefficients;
+		unsigned long long hash = 14695981039346656037ULL;
+
+		for(int a = 0; a < sizeof(coefficients); a++)
+		{
+			hash = (hash ^ bytes[a]) * 1099511628211ULL;
+		}
+
+		return hash;
+	}
+
+	std::string UndistortionMap::GetCacheFile(const cv::Size& resolution) const
+	{
+		return this->cacheFolder + "/undistort_" + std::to_string((long long) resolution.width) + "x" + std::to_string((long long) resolution.height) + ".map";
+	}
+
+	bool UndistortionMap::LoadTable(const cv::Size& resolution)
+	{
+		std::ifstream stream(this->GetCacheFile(resolution).c_str(), std::ios::in | std::ios::binary);
+
+		UndistortionTableHeader header;
+
+		if(!stream.read((char*) &header, sizeof(header)))
+			return false;
+
+		if(std::memcmp(header.Magic, UndistortionTableMagic, sizeof(UndistortionTableMagic)) != 0 || header.Version != UndistortionTableVersion ||
+			header.Width != resolution.width || header.Height != resolution.height || header.CoefficientHash != this->GetCoefficientHash())
+			return false;
+
+		cv::Mat map1(resolution, CV_16SC2);
+		cv::Mat map2(resolution, CV_16UC1);
+
+		// the maps are allocated continuous, so each is read with one call
+		if(!stream.read((char*) map1.data, map1.total() * map1.elemSize()) || !stream.read((char*) map2.data, map2.total() * map2.elemSize()))
+			return false;
+
+		this->map1 = map1;
+		this->map2 = map2;
+
+		return true;
+	}
+
+	void UndistortionMap::SaveTable(void) const
+	{
+		std::ofstream stream(this->GetCacheFile(this->size).c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+		UndistortionTableHeader header;
+		std::memcpy(header.Magic, UndistortionTableMagic, sizeof(UndistortionTableMagic));
+		header.Version = UndistortionTableVersion;
+		header.Width = this->size.width;
+		header.Height = this->size.height;
+		header.CoefficientHash = this->GetCoefficientHash();
+
+		stream.write((const char*) &header, sizeof(header));
+		stream.write((const char*) this->map1.data, this->map1.total() * this->map1.elemSize());
+		stream.write((const char*) this->map2.data, this->map2.total() * this->map2.elemSize());
+	}
+
+	void UndistortionMap::Prepare(const cv::Size& resolution)
+	{
+		this->SetResolution(resolution);
+
+		if(!this->IsCalibrated() || resolution == this->size)
+			return;
+
+		TUMAR_PROFILE_SCOPE("UndistortionMap::Prepare");
+
+		this->size = resolution;
+
+		if(this->LoadTable(resolution))
+			return;
+
+		// 16 bit fixed point maps are a third of the float ones and remap faster
+		cv::initUndistortRectifyMap(this->intrinsic, this->distortion, cv::Mat(), this->intrinsic, resolution, CV_16SC2, this->map1, this->map2);
+
+		this->SaveTable();
+	}
+
+	void UndistortionMap::Remap(const cv::Mat& input, cv::Mat& output, ThreadPool* pool)
+	{
+		TUMAR_PROFILE_SCOPE("UndistortionMap::Remap");
+
+		this->Prepare(input.size());
+
+		if(this->map1.empty())
+		{
+			input.copyTo(output);
+			return;
+		}
+
+		output.create(input.size(), input.type());
+
+		int bands = (input.rows + RemapBandRows - 1) / RemapBandRows;
+
+		// each band writes its own rows of the output, the maps are indexed by output row
+		std::function<void(int)> remap = [&](int band)
+		{
+			int first = band * RemapBandRows;
+			int last = std::min(first + RemapBandRows, input.rows);
+
+			cv::Mat rows = output.rowRange(first, last);
+
+			cv::remap(input, rows, this->map1.rowRange(first, last), this->map2.rowRange(first, last), cv::INTER_LINEAR);
+		};
+
+		if(pool != NULL)
+		{
+			pool->ParallelFor(bands, remap);
+		}
+		else
+		{
+			for(int a = 0; a < bands; a++)
+			{
+				remap(a);
+			}
+		}
+	}
+
+	void UndistortionMap::UndistortPoints(const cv::Point2f* input, cv::Point2f* output, int count) const
+	{
+		if(!this->IsCalibrated())
+		{
+			std::copy(input, input + count, output);
+			return;
+		}
+
+		for(int a = 0; a < count; a++)
+		{
+			double x0 = (input[a].x - this->cx) / this->fx;
+			double y0 = (input[a].y - this->cy) / this->fy;
+			double x = x0;
+			double y = y0;
+
+			for(int iteration = 0; iteration < UndistortIterations; iteration++)
+			{
+				double r2 = x * x + y * y;
+				double radial = 1 / (1 + ((this->k3 * r2 + this->k2) * r2 + this->k1) * r2);
+				double dx = 2 * this->p1 * x * y + this->p2 * (r2 + 2 * x * x);
+				double dy = this->p1 * (r2 + 2 * y * y) + 2 * this->p2 * x * y;
+
+				x = (x0 - dx) * radial;
+				y = (y0 - dy) * radial;
+			}
+
+			output[a].x = (float) (x * this->fx + this->cx);
+			output[a].y = (float) (y * this->fy + this->cy);
+		}
+	}
+}
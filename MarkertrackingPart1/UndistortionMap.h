@@ -0,0 +1,85 @@
+/*
+ * This file is part of the TUMAugmentedRealityExercise.
+ *
+ * (c) Christian Kerl <christian.kerl@in.tum.de>
+ *
+ * This source file is subject to the MIT license that is bundled
+ * with this source code in the file LICENSE.
+ */
+
+#pragma once
+
+#include <string>
+
+#include <opencv2/imgproc.hpp>
+
+#include "ThreadPool.h"
+
+namespace TUMAugmentedRealityExercise
+{
+	/**
+	 * removes the lens distortion of the calibrated 5 coefficient model. single
+	 * points are undistorted analytically, whole frames through a fixed point
+	 * lookup table which is built once per resolution and cached on disk next
+	 * to the calibration.
+	 */
+	class UndistortionMap
+	{
+	private:
+		std::string cacheFolder;
+
+		// the intrinsics are scaled from the resolution of the calibration to the one of the frames
+		cv::Size calibrationSize;
+		cv::Size resolution;
+		cv::Mat calibratedIntrinsic;
+
+		cv::Mat intrinsic;
+		cv::Mat distortion;
+
+		double fx, fy, cx, cy;
+		double k1, k2, p1, p2, k3;
+
+		// the table the maps were built for
+		cv::Size size;
+
+		// integer source coordinates and the index of the interpolation weights
+		cv::Mat map1;
+		cv::Mat map2;
+
+		unsigned long long GetCoefficientHash(void) const;
+		std::string GetCacheFile(const cv::Size& resolution) const;
+
+		bool LoadTable(const cv::Size& resolution);
+		void SaveTable(void) const;
+	public:
+		UndistortionMap(void);
+		~UndistortionMap(void);
+
+		// reads the camera.xml written by the calibrator, returns false if there is none
+		bool Load(const std::string& calibrationFile);
+
+		bool IsCalibrated(void) const;
+
+		/**
+		 * scales the intrinsics to frames of this resolution, returns true if they changed. frames must
+		 * have the aspect ratio of the calibration. calibrations without an image size are used as they are.
+		 */
+		bool SetResolution(const cv::Size& resolution);
+
+		float GetFocalLength(void) const;
+		cv::Point2f GetPrincipalPoint(void) const;
+
+		/**
+		 * makes the lookup table for frames of this resolution available, reading
+		 * it from the cache if it was built before. does nothing if the table
+		 * already has this resolution. changes the resolution of the intrinsics too.
+		 */
+		void Prepare(const cv::Size& resolution);
+
+		// remaps the frame in bands on the pool and the calling thread, input and output must differ
+		void Remap(const cv::Mat& input, cv::Mat& output, ThreadPool* pool = NULL);
+
+		// undistorts pixel coordinates without a lookup table, input and output may be the same
+		void UndistortPoints(const cv::Point2f* input, cv::Point2f* output, int count) const;
+	};
+}
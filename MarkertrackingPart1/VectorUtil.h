@@ -9,7 +9,7 @@
 
 #pragma once
 
-#include <opencv\cv.h>
+#include <opencv2/imgproc.hpp>
 
 namespace TUMAugmentedRealityExercise
 {	
@@ -9,11 +9,13 @@
 
 #include "VideoSource.h"
 
+#include <opencv2/imgcodecs.hpp>
+
 namespace TUMAugmentedRealityExercise
 {
-	CameraVideoSource::CameraVideoSource(void)
+	CameraVideoSource::CameraVideoSource(int device)
 	{
-		this->video = new cv::VideoCapture(0);
+		this->video = new cv::VideoCapture(device);
 	}
 	
 	CameraVideoSource::~CameraVideoSource(void)
@@ -23,7 +25,7 @@ namespace TUMAugmentedRealityExercise
 
 	int CameraVideoSource::GetFPS(void)
 	{
-		return (int) this->video->get(CV_CAP_PROP_FPS);
+		return (int) this->video->get(cv::CAP_PROP_FPS);
 	}
 
 	void CameraVideoSource::GetNextImage(cv::Mat& buffer)
@@ -31,48 +33,84 @@ namespace TUMAugmentedRealityExercise
 		*this->video >> buffer;
 	}
 	
-	FileVideoSource::FileVideoSource(const std::string& file)
+	FileVideoSource::FileVideoSource(const std::string& file) :
+		looping(true),
+		finished(false)
 	{
-		this->capture = cvCreateFileCapture(file.c_str());
+		this->capture.open(file);
+
+		this->frames = this->GetFrames();
+		this->currentFrame = this->GetCurrentFrame();
 	}
 	
 	FileVideoSource::~FileVideoSource(void)
 	{
-		cvReleaseCapture(&this->capture);
+		this->capture.release();
 	}
 
 	int FileVideoSource::GetFPS(void)
 	{
-		return (int) cvGetCaptureProperty(this->capture, CV_CAP_PROP_FPS);
+		return (int) this->capture.get(cv::CAP_PROP_FPS);
 	}
 
 	void FileVideoSource::GetNextImage(cv::Mat& buffer)
 	{
-		if(this->GetFrames() <= this->GetCurrentFrame())
+		if(this->looping && this->frames <= this->currentFrame)
 		{
 			this->SetCurrentFrame(0);
 		}
-		
-		buffer = cv::Mat(cvQueryFrame(this->capture));
+
+		bool read = this->capture.read(buffer);
+
+		// the frame count of some containers is only an estimate
+		if(!read && this->looping)
+		{
+			this->SetCurrentFrame(0);
+			read = this->capture.read(buffer);
+		}
+
+		if(!read)
+		{
+			this->finished = true;
+
+			buffer = cv::Mat();
+			return;
+		}
+
+		this->currentFrame++;
+	}
+
+	void FileVideoSource::SetLooping(bool looping)
+	{
+		this->looping = looping;
+	}
+
+	bool FileVideoSource::HasNextImage(void)
+	{
+		return this->looping || !this->finished;
 	}
 
 	int FileVideoSource::GetFrames(void)
 	{
-		return (int) cvGetCaptureProperty(this->capture, CV_CAP_PROP_FRAME_COUNT);
+		return (int) this->capture.get(cv::CAP_PROP_FRAME_COUNT);
 	}
 
 	int FileVideoSource::GetCurrentFrame(void)
 	{
-		return (int) cvGetCaptureProperty(this->capture, CV_CAP_PROP_POS_FRAMES);
+		return (int) this->capture.get(cv::CAP_PROP_POS_FRAMES);
 	}
 
 	void FileVideoSource::SetCurrentFrame(int frame)
 	{
-		cvSetCaptureProperty(this->capture, CV_CAP_PROP_POS_FRAMES, frame);
+		this->capture.set(cv::CAP_PROP_POS_FRAMES, frame);
+
+		this->currentFrame = frame;
 	}
 	
 	StaticFileVideoSource::StaticFileVideoSource(const std::string& file) :
-		buffer(cvLoadImageM(file.c_str()))
+		buffer(cv::imread(file)),
+		looping(true),
+		finished(false)
 	{
 		
 	}
@@ -88,6 +126,210 @@ namespace TUMAugmentedRealityExercise
 
 	void StaticFileVideoSource::GetNextImage(cv::Mat& buffer)
 	{
+		if(this->finished)
+		{
+			buffer = cv::Mat();
+			return;
+		}
+
 		buffer = this->buffer.clone();
+
+		this->finished = !this->looping;
+	}
+
+	void StaticFileVideoSource::SetLooping(bool looping)
+	{
+		this->looping = looping;
+	}
+
+	bool StaticFileVideoSource::HasNextImage(void)
+	{
+		return !this->finished;
+	}
+
+	AsyncVideoSource::AsyncVideoSource(VideoSource* source, int capacity, OverflowPolicy policy) :
+		source(source),
+		fps(source->GetFPS()),
+		policy(policy),
+		ring(std::max(capacity, 1)),
+		timestamps(std::max(capacity, 1)),
+		head(0),
+		count(0),
+		droppedFrames(0),
+		timestamp(0),
+		looping(true),
+		loopingChanged(false),
+		running(true),
+		finished(false)
+	{
+		this->thread = std::thread(&AsyncVideoSource::Capture, this);
+	}
+
+	AsyncVideoSource::~AsyncVideoSource(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->running = false;
+		}
+
+		this->slotAvailable.notify_all();
+		this->thread.join();
+
+		delete this->source;
+	}
+
+	int AsyncVideoSource::GetFPS(void)
+	{
+		return this->fps;
+	}
+
+	void AsyncVideoSource::GetNextImage(cv::Mat& buffer)
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+
+		while(this->count == 0 && !this->finished)
+		{
+			this->frameAvailable.wait(lock);
+		}
+
+		if(this->count == 0)
+		{
+			buffer = cv::Mat();
+			return;
+		}
+
+		this->Pop(buffer);
+	}
+
+	bool AsyncVideoSource::TryGetNextImage(cv::Mat& buffer)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		if(this->count == 0)
+			return false;
+
+		this->Pop(buffer);
+
+		return true;
+	}
+
+	void AsyncVideoSource::SetLooping(bool looping)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		this->looping = looping;
+		this->loopingChanged = true;
+	}
+
+	bool AsyncVideoSource::HasNextImage(void)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		return this->count > 0 || !this->finished;
+	}
+
+	double AsyncVideoSource::GetTimestamp(void)
+	{
+		return this->timestamp;
+	}
+
+	int AsyncVideoSource::GetDroppedFrames(void)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		return this->droppedFrames;
+	}
+
+	void AsyncVideoSource::Pop(cv::Mat& buffer)
+	{
+		// exchange instead of copying under the lock, the capture thread reuses the caller's old buffer
+		std::swap(this->ring[this->head], buffer);
+		this->timestamp = this->timestamps[this->head];
+
+		this->head = (this->head + 1) % this->ring.size();
+		this->count--;
+
+		this->slotAvailable.notify_one();
+	}
+
+	void AsyncVideoSource::Capture(void)
+	{
+		double ticksPerMs = cv::getTickFrequency() / 1000;
+		cv::Mat frame;
+
+		for(;;)
+		{
+			bool looping;
+			bool loopingChanged;
+
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+
+				looping = this->looping;
+				loopingChanged = this->loopingChanged;
+				this->loopingChanged = false;
+			}
+
+			if(loopingChanged)
+				this->source->SetLooping(looping);
+
+			bool available = this->source->HasNextImage();
+
+			if(available)
+			{
+				this->source->GetNextImage(frame);
+
+				// a camera which is gone returns empty frames
+				available = !frame.empty();
+			}
+
+			if(!available)
+			{
+				{
+					std::lock_guard<std::mutex> lock(this->mutex);
+					this->finished = true;
+				}
+
+				this->frameAvailable.notify_all();
+				return;
+			}
+
+			double captured = cv::getTickCount() / ticksPerMs;
+
+			// the buffer came from a caller, it is only reused if it owns its data and nobody else refers to it.
+			// it may be a view into a read only mapping as well
+			if(this->back.u == NULL || this->back.u->refcount > 1)
+				this->back.release();
+
+			// sources may return their internal buffer, the buffers are only reallocated if the frame size changes
+			frame.copyTo(this->back);
+
+			std::unique_lock<std::mutex> lock(this->mutex);
+
+			while(this->running && this->policy == Block && this->count == this->ring.size())
+			{
+				this->slotAvailable.wait(lock);
+			}
+
+			if(!this->running)
+				return;
+
+			if(this->count == this->ring.size())
+			{
+				this->head = (this->head + 1) % this->ring.size();
+				this->count--;
+				this->droppedFrames++;
+			}
+
+			int tail = (this->head + this->count) % this->ring.size();
+
+			std::swap(this->ring[tail], this->back);
+			this->timestamps[tail] = captured;
+			this->count++;
+
+			lock.unlock();
+
+			this->frameAvailable.notify_one();
+		}
 	}
 }
@@ -9,8 +9,14 @@
 
 #pragma once
 
-#include <opencv\cv.h>
-#include <opencv\highgui.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/videoio.hpp>
 
 namespace TUMAugmentedRealityExercise
 {
@@ -23,6 +29,12 @@ namespace TUMAugmentedRealityExercise
 		virtual int GetFPS(void) = 0;
 
 		virtual void GetNextImage(cv::Mat& buffer) = 0;
+
+		// sources with a last frame start over unless looping is turned off, the others ignore it
+		virtual void SetLooping(bool looping) {};
+
+		// false once a source which doesn't loop is out of frames, GetNextImage then returns an empty buffer
+		virtual bool HasNextImage(void) { return true; };
 	};
 
 	class CameraVideoSource : public VideoSource
@@ -30,7 +42,7 @@ namespace TUMAugmentedRealityExercise
 	private:
 		cv::VideoCapture* video;
 	public:
-		CameraVideoSource(void);
+		CameraVideoSource(int device = 0);
 		~CameraVideoSource(void);
 
 		int GetFPS(void);
@@ -42,7 +54,14 @@ namespace TUMAugmentedRealityExercise
 	class FileVideoSource : public VideoSource
 	{
 	private:
-		CvCapture* capture;
+		cv::VideoCapture capture;
+
+		// the capture properties are expensive to query, so the position is tracked here
+		int frames;
+		int currentFrame;
+
+		bool looping;
+		bool finished;
 
 		int GetFrames(void);
 		int GetCurrentFrame(void);
@@ -54,6 +73,9 @@ namespace TUMAugmentedRealityExercise
 		int GetFPS(void);
 
 		void GetNextImage(cv::Mat& buffer);
+
+		void SetLooping(bool looping);
+		bool HasNextImage(void);
 	};
 
 	
@@ -61,13 +83,93 @@ namespace TUMAugmentedRealityExercise
 	{
 	private:
 		cv::Mat buffer;
+
+		bool looping;
+		bool finished;
 	public:
 		StaticFileVideoSource(const std::string& file);
 		~StaticFileVideoSource(void);
 
 		int GetFPS(void);
 
+		// without looping the image is returned once
 		void GetNextImage(cv::Mat& buffer);
+
+		void SetLooping(bool looping);
+		bool HasNextImage(void);
 	};
-}
 
+	/**
+	 * decorator grabbing frames of another video source on a background thread
+	 * into a fixed ring of buffers, so capturing and decoding overlap with the
+	 * processing of the previous frame. the wrapped source is owned and must
+	 * not be used by anyone else. the capture ends when the wrapped source runs
+	 * out of frames or returns an empty one.
+	 *
+	 * the returned frames are exchanged with the buffers passed in, which are
+	 * reused for later frames unless their data is still referenced elsewhere.
+	 */
+	class AsyncVideoSource : public VideoSource
+	{
+	public:
+		enum OverflowPolicy
+		{
+			// a full ring drops its oldest frame, the consumer always gets the most recent ones
+			DropOldest,
+			// a full ring stops capturing until the consumer took a frame, no frame is lost
+			Block
+		};
+	private:
+		VideoSource* source;
+		int fps;
+		OverflowPolicy policy;
+
+		std::vector<cv::Mat> ring;
+		std::vector<double> timestamps;
+		int head;
+		int count;
+
+		// the capture thread decodes into this buffer before swapping it into the ring
+		cv::Mat back;
+
+		int droppedFrames;
+		double timestamp;
+
+		// applied to the wrapped source by the capture thread before its next frame
+		bool looping;
+		bool loopingChanged;
+
+		std::mutex mutex;
+		std::condition_variable frameAvailable;
+		std::condition_variable slotAvailable;
+		bool running;
+
+		// the wrapped source is out of frames, the ring may still hold some
+		bool finished;
+
+		std::thread thread;
+
+		void Capture(void);
+		void Pop(cv::Mat& buffer);
+	public:
+		AsyncVideoSource(VideoSource* source, int capacity = 3, OverflowPolicy policy = DropOldest);
+		~AsyncVideoSource(void);
+
+		int GetFPS(void);
+
+		// waits for the next frame, the buffer is empty once the capture ended and all frames were taken
+		void GetNextImage(cv::Mat& buffer);
+
+		// returns false if no new frame was captured since the last call
+		bool TryGetNextImage(cv::Mat& buffer);
+
+		// the frames captured before the call are returned as they are
+		void SetLooping(bool looping);
+		bool HasNextImage(void);
+
+		// capture time of the last returned frame in ms, on the cv::getTickCount() clock
+		double GetTimestamp(void);
+
+		int GetDroppedFrames(void);
+	};
+}
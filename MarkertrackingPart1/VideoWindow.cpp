@@ -16,12 +16,12 @@ namespace TUMAugmentedRealityExercise
 		this->name = name;
 		this->processor = processor;
 
-		cvNamedWindow(this->name.c_str());
+		cv::namedWindow(this->name);
 	}
 
 	VideoWindow::~VideoWindow(void)
 	{
-		cvDestroyWindow(this->name.c_str());
+		cv::destroyWindow(this->name);
 	}
 
 	std::string VideoWindow::GetName(void)
@@ -33,7 +33,7 @@ namespace TUMAugmentedRealityExercise
 	{
 		this->processor->process(image, resultBuffer);
 
-		cvShowImage(this->name.c_str(), &((CvMat) resultBuffer));
+		cv::imshow(this->name, resultBuffer);
 	}
 
 	ThresholdTrackbar::ThresholdTrackbar(const std::string& window, ThresholdImageProcessor* processor)
@@ -43,7 +43,7 @@ namespace TUMAugmentedRealityExercise
 		this->processor = processor;
 		this->value = (int)processor->threshold;
 
-		cvCreateTrackbar2(this->name.c_str(), this->window.c_str(), &this->value, 255, &ThresholdTrackbar::onChange, this);
+		cv::createTrackbar(this->name, this->window, &this->value, 255, &ThresholdTrackbar::onChange, this);
 	}
 
 	void ThresholdTrackbar::onChange(int value, void* data)
@@ -12,8 +12,8 @@
 #include <string>
 #include <iostream>
 
-#include <opencv\cv.h>
-#include <opencv\highgui.h>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
 
 #include "ImageProcessor.h"
 
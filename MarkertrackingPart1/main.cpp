@@ -10,88 +10,484 @@
 #include <ostream>
 #include <iostream>
 
-#include <opencv\cv.h>
-#include <opencv\highgui.h>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
 
-#include "MemoryStorage.h"
 #include "ImageProcessor.h"
+#include "Pipeline.h"
 #include "VideoSource.h"
+#include "RawFrameSequence.h"
 #include "VideoWindow.h"
 #include "FPSMonitor.h"
+#include "FrameDeadlineController.h"
 #include "DebugImage.h"
+#include "DetectionWorker.h"
+#include "MemoryStorage.h"
+#include "MarkerResultSink.h"
+#include "MarkerRecord.h"
+#include "MarkerPublisher.h"
+#include "CandidateRecording.h"
+#include "ChessboardCameraCalibrator.h"
+#include "CameraCalibrationApp.h"
+#include "UndistortionMap.h"
+#include "DetectorAccuracyCheck.h"
+#include "DetectorConsistencyCheck.h"
+#include "KernelBenchmark.h"
+#include "Profiler.h"
+#include "TraceRecorder.h"
 
 #define ESCAPE_KEY 27
 #define C_KEY 99
+#define D_KEY 100
+#define P_KEY 112
+#define R_KEY 114
+#define U_KEY 117
 #define V_KEY 118
 
 using namespace cv;
 using namespace TUMAugmentedRealityExercise;
 
-int main(int argc, char* argv[])
+// estimates the poses with the calibration written by --calibrate if there is one
+bool LoadCalibration(UndistortionMap& undistortion, DetectorContext& context)
+{
+	if(!undistortion.Load("./media/camera.xml"))
+		return false;
+
+	context.FocalLength = undistortion.GetFocalLength();
+	context.PrincipalPoint = undistortion.GetPrincipalPoint();
+	context.Undistortion = &undistortion;
+
+	return true;
+}
+
+// scales the calibration to the resolution of the frames once it is known or changes
+void UpdateCalibration(UndistortionMap& undistortion, const cv::Size& resolution, MarkerDetectionImageProcessor& marker)
+{
+	if(!undistortion.SetResolution(resolution))
+		return;
+
+	DetectorContext context = marker.GetContext();
+	context.FocalLength = undistortion.GetFocalLength();
+	context.PrincipalPoint = undistortion.GetPrincipalPoint();
+
+	marker.SetContext(context);
+}
+
+// detects markers in several cameras at once, one worker per camera
+int RunCameras(int count)
+{
+	// no debug sink, it would be shared by all workers
+	DetectorContext context;
+	context.MarkerSize = 3.25;
+
+	UndistortionMap undistortion;
+	bool calibrated = LoadCalibration(undistortion, context);
+
+	DetectionResultStream stream;
+	MemoryStoragePool pool;
+	std::vector<DetectionWorker*> workers;
+
+	for(int a = 0; a < count; a++)
+	{
+		// every worker scales its own copy of the calibration to the resolution of its camera
+		workers.push_back(new DetectionWorker(a, new AsyncVideoSource(new CameraVideoSource(a)), &stream, context, calibrated ? &undistortion : NULL, &pool));
+		workers.back()->Start();
+	}
+
+	// the window is only needed to receive key events
+	namedWindow("AR-EX1-Cameras");
+
+	DetectionResult result;
+
+	bool running = true;
+
+	while(running && waitKey(1) != ESCAPE_KEY)
+	{
+		// stop once every camera is gone
+		running = false;
+
+		for(int a = 0; a < workers.size(); a++)
+		{
+			running = running || workers[a]->IsRunning();
+		}
+
+		while(stream.Poll(result))
+		{
+			std::cout << "camera " << result.CameraId << " frame " << result.FrameNumber << " at " << result.Timestamp << "ms:";
+
+			for(MarkerContainer::const_iterator it = result.Markers.begin(); it != result.Markers.end(); ++it)
+			{
+				std::cout << " " << it->MarkerId;
+			}
+
+			std::cout << std::endl;
+		}
+	}
+
+	for(int a = 0; a < workers.size(); a++)
+	{
+		delete workers[a];
+	}
+
+	std::cout << "memory high-water mark: " << pool.GetHighWaterMark() << " bytes in " << pool.GetStorageCount() << " storages" << std::endl;
+
+	Profiler::Report(std::cout);
+
+	destroyWindow("AR-EX1-Cameras");
+
+	return 0;
+}
+
+// opens a recording by its extension, "camera" opens the default camera
+VideoSource* OpenVideoSource(const std::string& name)
+{
+	std::string extension = name.substr(name.find_last_of('.') + 1);
+
+	if(name == "camera")
+		return new CameraVideoSource();
+	if(extension == "raw")
+		return new RawFrameVideoSource(name);
+	if(extension == "png" || extension == "jpg" || extension == "bmp")
+		return new StaticFileVideoSource(name);
+
+	return new FileVideoSource(name);
+}
+
+// detects the markers of every frame of a recording as fast as possible without any window,
+// the results are written as csv unless the output ends with .markers, "-" writes csv to the console
+// and shm:<name> publishes them to other processes. the candidates of every frame are recorded
+// for --replay-candidates if a candidate file is given
+int RunHeadless(const std::string& input, const std::string& output, const std::string& candidateFile)
+{
+	VideoSource* source = OpenVideoSource(input);
+	source->SetLooping(false);
+
+	// the raw recordings know when their frames were grabbed, otherwise the position in the video is used
+	RawFrameVideoSource* raw = dynamic_cast<RawFrameVideoSource*>(source);
+	double msPerFrame = 1000.0 / std::max(source->GetFPS(), 1);
+
+	MarkerResultSink* sink;
+
+	if(output == "-")
+		sink = new CsvMarkerResultSink(std::cout);
+	else if(output.compare(0, 4, "shm:") == 0)
+		sink = new MarkerPublisher(output.substr(4));
+	else if(output.size() > 8 && output.substr(output.size() - 8) == ".markers")
+		sink = new MarkerRecordWriter(output);
+	else
+		sink = new CsvMarkerResultSink(output);
+
+	DetectorContext context;
+	context.MarkerSize = 3.25;
+
+	UndistortionMap undistortion;
+	LoadCalibration(undistortion, context);
+
+	CandidateRecorder* candidates = candidateFile.empty() ? NULL : new CandidateRecorder(candidateFile);
+	context.Debug = candidates;
+
+	MarkerContainer markers;
+	MemoryStorage storage;
+
+	GreyscaleImageProcessor grey;
+	AdaptiveThresholdImageProcessor adaptive;
+	MarkerDetectionImageProcessor marker(&markers, &storage, context);
+	marker.SetContourBands(ThreadPool::GetDefaultThreadCount());
+
+	// greyscale and threshold run as one pass, see Pipeline
+	Pipeline<GreyscaleImageProcessor, AdaptiveThresholdImageProcessor, MarkerDetectionImageProcessor> chain(grey, adaptive, marker);
+
+	Mat inBuffer;
+	Mat outBuffer;
+
+	int frame = 0;
+	int detected = 0;
+	int64 start = cv::getTickCount();
+
+	while(source->HasNextImage())
+	{
+		TUMAR_TRACE_FRAME(frame);
+
+		{
+			TUMAR_TRACE_SCOPE("grab");
+
+			source->GetNextImage(inBuffer);
+		}
+
+		if(inBuffer.empty())
+			break;
+
+		UpdateCalibration(undistortion, inBuffer.size(), marker);
+
+		{
+			TUMAR_TRACE_SCOPE("process");
+
+			chain.process(inBuffer, outBuffer);
+		}
+
+		{
+			TUMAR_TRACE_SCOPE("write");
+
+			sink->Write(frame, raw != NULL ? raw->GetTimestamp() : frame * msPerFrame, markers);
+		}
+
+		detected += (int) markers.size();
+		frame++;
+
+		markers.clear();
+		storage.Clear();
+	}
+
+	delete sink;
+	delete source;
+
+	if(candidates != NULL)
+	{
+		// completes the recording, fails if it couldn't be written
+		candidates->Close();
+
+		std::cerr << candidates->GetCandidateCount() << " candidates recorded to " << candidateFile << std::endl;
+	}
+
+	delete candidates;
+
+	double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+	// the console may carry the results, so the summary goes to the error stream
+	std::cerr << frame << " frames, " << detected << " markers in " << seconds << "s (" << frame / std::max(seconds, 1e-9) << " fps)" << std::endl;
+
+	return 0;
+}
+
+// calibrates the camera from the chessboard images of a directory, the detected corners
+// are cached in the output folder so only new images are searched on the next run
+int RunCalibration(const std::string& directory, const std::string& outputFolder, const cv::Size& patternSize, float squareSize)
+{
+	ChessboardCameraCalibrator calibrator(outputFolder, patternSize, squareSize);
+	ThreadPool pool;
+
+	int64 start = cv::getTickCount();
+	int sampled;
+
+	{
+		TUMAR_TRACE_SCOPE("sample chessboards");
+
+		sampled = calibrator.SampleChessboardDirectory(directory, &pool);
+	}
+
+	double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+	std::cout << "Sampled " << sampled << " chessboard images from " << directory << " in " << seconds << "s" << std::endl;
+
+	if(sampled == 0)
+		return 1;
+
+	{
+		TUMAR_TRACE_SCOPE("calibrate");
+
+		calibrator.CalculateCalibration();
+	}
+
+	return 0;
+}
+
+// checks the detection and pose estimation against synthetic frames of known markers, fails if they got less accurate
+int RunAccuracyCheck(int frames, unsigned long long seed)
+{
+	DetectorAccuracyCheck check;
+	AccuracyReport report = check.Run(frames, seed);
+
+	report.Print(std::cout);
+
+	return report.Passed ? 0 : 1;
+}
+
+// checks that the parallel and fused paths of the detector give exactly the results of the plain ones on random images
+int RunConsistencyCheck(int images, unsigned long long seed)
+{
+	DetectorConsistencyCheck check(seed);
+	ConsistencyReport report = check.Run(images);
+
+	report.Print(std::cout);
+
+	return report.Passed ? 0 : 1;
+}
+
+// times the detector kernels. compares them to the baseline file if it exists, otherwise writes the results to it
+int RunBenchmark(const std::string& filter, const std::string& baselineFile)
+{
+	KernelBenchmark benchmark;
+	benchmark.AddDetectorKernels();
+
+	return benchmark.RunAgainstBaseline(filter, baselineFile, std::cout);
+}
+
+// runs the stripes, corners, decoding and pose estimation on the candidates recorded by --headless,
+// without the contour search, and compares them to the recorded results. the profile shows the stages
+int RunCandidateReplay(const std::string& file, int runs)
+{
+	CandidateReplay replay(file);
+
+	DetectorContext context;
+	UndistortionMap undistortion;
+
+	bool calibrated = LoadCalibration(undistortion, context);
+
+	if(calibrated)
+		undistortion.SetResolution(replay.GetResolution());
+	else if(replay.IsUndistorted())
+		std::cout << "the candidates were undistorted, but there is no calibration, the poses will differ" << std::endl;
+
+	Profiler::Reset();
+
+	CandidateReplayReport report = replay.Run(std::max(runs, 1), calibrated ? &undistortion : NULL);
+
+	report.Print(std::cout);
+	Profiler::Report(std::cout);
+
+	return report.Mismatches == 0 ? 0 : 1;
+}
+
+// shows the detected markers of one camera or recording
+int RunInteractive(int argc, char* argv[])
 {
 	bool running = true;
+	int frame = 0;
 	Mat inBuffer;
 	Mat outBuffer;
 	
 	// setup video input
 	VideoSource* source;
-	VideoSource* camera = new CameraVideoSource();
-	VideoSource* video  = new StaticFileVideoSource("marker.png");
+	VideoSource* camera = new AsyncVideoSource(new CameraVideoSource());
+	VideoSource* video  = argc > 1 ? (VideoSource*) new RawFrameVideoSource(argv[1]) : new StaticFileVideoSource("marker.png");
+	RawFrameRecorder* recorder = NULL;
 
 	source = video;
 	
 	FPSMonitor fps;
 	fps.SetVideoSourceFPS(source->GetFPS());
 
-	// create dynamic memory
-	MemoryStorage memory;
+	DebugImage dbg;
+
+	DetectorContext context;
+	context.MarkerSize = 3.25;
+	context.Debug = &dbg;
+
+	// the pose uses undistorted corners, the frames are only undistorted for display
+	UndistortionMap undistortion;
+	bool undistortDisplay = false;
+	Mat undistortedBuffer;
+	ThreadPool displayPool(2);
+
+	if(LoadCalibration(undistortion, context))
+		std::cout << "using the calibration in ./media/camera.xml, u key shows undistorted frames" << std::endl;
 
-	Marker::RealSize = 3.25;
 	MarkerContainer markers;
+	MemoryStorage storage;
 
 	// create image processors
 	ResizeImageProcessor resize(10);
 	GreyscaleImageProcessor grey;
 	AdaptiveThresholdImageProcessor adaptive;
-	MarkerDetectionImageProcessor marker(&memory, &markers);
+	MarkerDetectionImageProcessor marker(&markers, &storage, context);
+	marker.SetContourBands(ThreadPool::GetDefaultThreadCount());
+
+	// lower the detection quality while frames take longer than 16ms
+	FrameDeadlineController deadline(16.0);
+	deadline.Apply(marker);
 
-	MarkerHighlightImageProcessor highlight(&markers);
+	// draws the markers on a copy of the frame on its own thread
+	OverlayRenderer overlay;
+	Mat overlayBuffer;
+	NullImageProcessor null;
 
 	// chain various image processors
 	ImageProcessorChain chain1;
 	chain1.add(&grey);
 	chain1.add(&adaptive);
 	chain1.add(&marker);
-	
-	DebugImage dbg;
 
 	// create ui
-	VideoWindow originWindow("AR-EX1-Origin", &highlight);
+	VideoWindow originWindow("AR-EX1-Origin", &null);
 	VideoWindow stripeWindow("AR-EX3-Marker", &resize);
 	
 	// start ui event loop
 	while(running)
 	{
+		TUMAR_TRACE_FRAME(frame++);
+
 		fps.BeginProcessing();
 
 		// grab next frame
-		source->GetNextImage(inBuffer);
+		{
+			TUMAR_TRACE_SCOPE("grab");
+
+			source->GetNextImage(inBuffer);
+		}
+
+		fps.EndGrab();
+
+		UpdateCalibration(undistortion, inBuffer.size(), marker);
+
+		if(recorder != NULL)
+		{
+			TUMAR_TRACE_SCOPE("record");
+
+			recorder->Write(inBuffer, cv::getTickCount() * 1000.0 / cv::getTickFrequency());
+		}
 
 		// process and display current frame
-		chain1.process(inBuffer, outBuffer);
+		{
+			TUMAR_TRACE_SCOPE("process");
+
+			chain1.process(inBuffer, outBuffer);
+		}
 		
-		//thresholdWindow.update(inBuffer);
-		originWindow.update(inBuffer);
+		overlay.Submit(inBuffer, markers);
 
-		stripeWindow.update(dbg.Buffer);
+		{
+			TUMAR_TRACE_SCOPE("display");
+
+			// shows the last rendered overlay, which may be one frame behind
+			if(overlay.GetLatest(overlayBuffer))
+			{
+				if(undistortDisplay)
+				{
+					undistortion.Remap(overlayBuffer, undistortedBuffer, &displayPool);
+					originWindow.update(undistortedBuffer);
+				}
+				else
+				{
+					originWindow.update(overlayBuffer);
+				}
+			}
 
-		// clear memory resources
-		memory.Clear();
+			stripeWindow.update(dbg.Buffer);
+		}
+
+		// clear detection results, the stripe buffers live in the storage
 		markers.clear();
+		storage.Clear();
 
 		fps.EndProcessing();
 
-		switch(waitKey(fps.GetMsUntilNextFrame()))
+		// waiting for the camera is not part of the budget, lowering the quality wouldn't shorten it
+		if(deadline.Update(fps.GetProcessingMs(), marker.GetLastProcessingMs()))
+		{
+			deadline.Apply(marker);
+
+			std::cout << "frame time " << deadline.GetAverageMs() << "ms -> detection quality level " << deadline.GetLevel() << std::endl;
+		}
+
+		int key;
+
+		{
+			TUMAR_TRACE_SCOPE("wait");
+
+			key = waitKey(fps.GetMsUntilNextFrame());
+		}
+
+		switch(key)
 		{
 		case C_KEY:
 			std::cout << "c key pressed -> switching to camera mode" << std::endl;
@@ -99,6 +495,14 @@ int main(int argc, char* argv[])
 
 			fps.SetVideoSourceFPS(source->GetFPS());
 			break;
+		case D_KEY:
+			overlay.SetDetailLevel((OverlaySnapshot::DetailLevel) ((overlay.GetDetailLevel() + 1) % (OverlaySnapshot::Stripes + 1)));
+			std::cout << "d key pressed -> overlay detail level " << overlay.GetDetailLevel() << std::endl;
+			break;
+		case U_KEY:
+			undistortDisplay = !undistortDisplay && undistortion.IsCalibrated();
+			std::cout << "u key pressed -> undistorted display " << (undistortDisplay ? "on" : "off") << std::endl;
+			break;
 		case V_KEY:
 			std::cout << "v key pressed -> switching to video mode" << std::endl;
 			if(video != NULL)
@@ -106,13 +510,82 @@ int main(int argc, char* argv[])
 
 			fps.SetVideoSourceFPS(source->GetFPS());
 			break;
+		case P_KEY:
+			std::cout << "p key pressed -> profile since the last report" << std::endl;
+			Profiler::Report(std::cout);
+			Profiler::Reset();
+			break;
+		case R_KEY:
+			if(recorder == NULL)
+			{
+				std::cout << "r key pressed -> recording to recording.raw" << std::endl;
+				recorder = new RawFrameRecorder("recording.raw", source->GetFPS());
+			}
+			else
+			{
+				std::cout << "r key pressed -> stopped recording after " << recorder->GetFrameCount() << " frames" << std::endl;
+				delete recorder;
+				recorder = NULL;
+			}
+			break;
 		case ESCAPE_KEY:
 			running = false;
 			break;
 		}
 	}
 
+	delete recorder;
 	delete camera, video;
 
 	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	// --trace <file> writes a timeline of the session when it ends, it has to be the first option
+	const char* traceFile = NULL;
+
+	if(argc > 2 && std::string(argv[1]) == "--trace")
+	{
+		traceFile = argv[2];
+		TraceRecorder::Start();
+		TraceRecorder::SetThreadName("main");
+
+		argc -= 2;
+		argv += 2;
+	}
+
+	int result;
+
+	if(argc > 2 && std::string(argv[1]) == "--cameras")
+		result = RunCameras(atoi(argv[2]));
+	else if(argc > 2 && std::string(argv[1]) == "--headless")
+		// --headless <input> [output] [candidates]
+		result = RunHeadless(argv[2], argc > 3 ? argv[3] : "-", argc > 4 ? argv[4] : "");
+	else if(argc > 2 && std::string(argv[1]) == "--replay-candidates")
+		result = RunCandidateReplay(argv[2], argc > 3 ? atoi(argv[3]) : 1);
+	else if(argc > 1 && std::string(argv[1]) == "--accuracy-check")
+		result = RunAccuracyCheck(argc > 2 ? atoi(argv[2]) : 300, argc > 3 ? strtoull(argv[3], NULL, 10) : 1);
+	else if(argc > 1 && std::string(argv[1]) == "--consistency-check")
+		result = RunConsistencyCheck(argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? strtoull(argv[3], NULL, 10) : 1);
+	else if(argc > 1 && std::string(argv[1]) == "--benchmark")
+		// a filter of - runs all kernels
+		result = RunBenchmark(argc > 2 && std::string(argv[2]) != "-" ? argv[2] : "", argc > 3 ? argv[3] : "");
+	else if(argc > 2 && std::string(argv[1]) == "--calibrate")
+		// --calibrate <directory> [outputFolder] [columns rows squareSize], counting the inner corners of the board
+		result = RunCalibration(argv[2], argc > 3 ? argv[3] : "./media", argc > 5 ? cv::Size(atoi(argv[4]), atoi(argv[5])) : cv::Size(8, 6), argc > 6 ? (float) atof(argv[6]) : 1.0f);
+	else if(argc > 1 && std::string(argv[1]) == "--calibrate-live")
+	{
+		// --calibrate-live [outputFolder] [columns rows squareSize], like --calibrate but sampling the camera.
+		// space samples the current frame and enter calibrates
+		CameraCalibrationApp app(argc > 2 ? argv[2] : "./media", argc > 4 ? cv::Size(atoi(argv[3]), atoi(argv[4])) : cv::Size(8, 6), argc > 5 ? (float) atof(argv[5]) : 1.0f);
+		result = app.Run(argc - 1, argv + 1);
+	}
+	else
+		result = RunInteractive(argc, argv);
+
+	if(traceFile != NULL && !TraceRecorder::Write(traceFile))
+		std::cout << "writing the trace to " << traceFile << " failed" << std::endl;
+
+	return result;
 }
\ No newline at end of file